@@ -0,0 +1,519 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Host benchmark of the KVStore backends and decorators.
+ *
+ * Every backend is measured across a matrix of value sizes, key counts and access patterns,
+ * the results are written as a JSON document, in order to compare the numbers between releases:
+ *
+ *   benchmarkArduinoKVStore [--quick] [--backend name] [--ops n] [--output file.json]
+ */
+#include <kvstore/implementation/ram.h>
+#include <kvstore/implementation/tdb.h>
+#include <kvstore/utility/blockdevice.h>
+#include <kvstore/decorators/cached.h>
+#include <kvstore/decorators/instrumented.h>
+#include <kvstore/decorators/compressed.h>
+#if defined(__linux__)
+#include <kvstore/implementation/file.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef KVSTORE_VERSION
+#define KVSTORE_VERSION "unknown"
+#endif // KVSTORE_VERSION
+
+typedef std::chrono::steady_clock bench_clock;
+
+/*
+ * Fixtures own a store under test together with everything it depends on,
+ * a decorator is measured by wrapping the fixture of another backend.
+ */
+class Fixture {
+public:
+    virtual ~Fixture() {}
+    virtual KVStoreInterface& store() = 0;
+};
+
+class RamFixture: public Fixture {
+public:
+    RamFixture(size_t) {}
+    KVStoreInterface& store() override { return kvstore; }
+
+private:
+    RamKVStore kvstore;
+};
+
+class TDBFixture: public Fixture {
+public:
+    // the device holds two areas, each of them with room for the data set and its overwrites
+    TDBFixture(size_t dataSize): bd(deviceSize(dataSize), 1, 4096), kvstore(bd) {}
+    KVStoreInterface& store() override { return kvstore; }
+
+private:
+    static size_t deviceSize(size_t dataSize) {
+        return (4 * dataSize / 4096 + 16) * 4096;
+    }
+
+    RamBlockDevice bd;
+    TDBKVStore kvstore;
+};
+
+#if defined(__linux__)
+class FileFixture: public Fixture {
+public:
+    // writes are not synced, otherwise the numbers only measure the disk flushes
+    FileFixture(size_t): path(tempPath()), kvstore(path.c_str(), DEFAULT_COMPACTION_RATIO, false) {}
+    ~FileFixture() { kvstore.end(); unlink(path.c_str()); }
+    KVStoreInterface& store() override { return kvstore; }
+
+private:
+    static std::string tempPath() {
+        char path[] = "/tmp/kvstore_bench_XXXXXX";
+        int fd = mkstemp(path);
+        close(fd);
+        unlink(path);
+
+        return path;
+    }
+
+    std::string path;
+    FileKVStore kvstore;
+};
+#endif // __linux__
+
+template<typename Inner>
+class CachedFixture: public Fixture {
+public:
+    CachedFixture(size_t dataSize): inner(dataSize), cached(inner.store()) {}
+    KVStoreInterface& store() override { return cached; }
+
+private:
+    Inner inner;
+    CachedKVStore cached;
+};
+
+template<typename Inner>
+class InstrumentedFixture: public Fixture {
+public:
+    InstrumentedFixture(size_t dataSize): inner(dataSize), instrumented(inner.store()) {}
+    KVStoreInterface& store() override { return instrumented; }
+
+private:
+    Inner inner;
+    InstrumentedKVStore instrumented;
+};
+
+template<typename Inner>
+class CompressedFixture: public Fixture {
+public:
+    CompressedFixture(size_t dataSize): inner(dataSize), compressed(inner.store()) {}
+    KVStoreInterface& store() override { return compressed; }
+
+private:
+    Inner inner;
+    CompressedKVStore compressed;
+};
+
+template<typename F>
+static Fixture* make(size_t dataSize) { return new F(dataSize); }
+
+struct backend_t {
+    const char* name;
+    Fixture* (*make)(size_t dataSize);
+    size_t maxDataSize;   // bigger data sets are skipped, since they do not fit the backend
+};
+
+static const backend_t backends[] = {
+    { "ram",                make<RamFixture>,                         SIZE_MAX },
+    { "instrumented+ram",   make<InstrumentedFixture<RamFixture>>,    SIZE_MAX },
+    { "tdb",                make<TDBFixture>,                         8 * 1024 * 1024 },
+    { "cached+tdb",         make<CachedFixture<TDBFixture>>,          8 * 1024 * 1024 },
+    { "compressed+tdb",     make<CompressedFixture<TDBFixture>>,      8 * 1024 * 1024 },
+#if defined(__linux__)
+    { "file",               make<FileFixture>,                        SIZE_MAX },
+    { "cached+file",        make<CachedFixture<FileFixture>>,         SIZE_MAX },
+#endif // __linux__
+};
+
+/*
+ * Access patterns: keys are picked either uniformly or with a Zipfian distribution,
+ * the read and write heavy mixes use the Zipfian distribution, as the YCSB workloads do
+ */
+enum Distribution { UNIFORM, ZIPFIAN };
+
+struct pattern_t {
+    const char* name;
+    Distribution distribution;
+    int readPercent;        // -1 for the patterns that measure every operation separately
+};
+
+static const pattern_t patterns[] = {
+    { "uniform",        UNIFORM,    -1 },
+    { "zipfian",        ZIPFIAN,    -1 },
+    { "read_heavy",     ZIPFIAN,    95 },
+    { "write_heavy",    ZIPFIAN,    10 },
+};
+
+class KeyChooser {
+public:
+    KeyChooser(Distribution distribution, size_t keys, std::mt19937_64& rng)
+    : distribution(distribution), keys(keys), rng(rng) {
+        if(distribution == ZIPFIAN) {
+            double sum = 0;
+
+            cdf.resize(keys);
+            for(size_t i=0; i<keys; i++) {
+                sum += 1.0 / std::pow(i + 1, ZIPF_THETA);
+                cdf[i] = sum;
+            }
+            for(size_t i=0; i<keys; i++) {
+                cdf[i] /= sum;
+            }
+        }
+    }
+
+    size_t next() {
+        if(distribution == UNIFORM) {
+            return std::uniform_int_distribution<size_t>(0, keys - 1)(rng);
+        }
+
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        size_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+
+        // the hot keys are scattered in the key space, multiplying by a prime is a permutation of the ranks
+        return (std::min(rank, keys - 1) * 2654435761ull) % keys;
+    }
+
+private:
+    static constexpr double ZIPF_THETA = 0.99;
+
+    Distribution distribution;
+    size_t keys;
+    std::mt19937_64& rng;
+    std::vector<double> cdf;
+};
+
+constexpr double KeyChooser::ZIPF_THETA;
+
+struct result_t {
+    const char* backend;
+    const char* pattern;
+    const char* op;
+    size_t valueSize;
+    size_t keys;
+    size_t ops;
+    size_t errors;
+    double opsPerSec;
+    uint64_t p50;
+    uint64_t p99;
+};
+
+/*
+ * Collects the latency of every operation of a run
+ */
+class Recorder {
+public:
+    Recorder(size_t ops): errors(0) {
+        latencies.reserve(ops);
+        start = bench_clock::now();
+    }
+
+    template<typename Op>
+    void measure(Op op) {
+        bench_clock::time_point begin = bench_clock::now();
+        bool res = op();
+        bench_clock::time_point end = bench_clock::now();
+
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        errors += res ? 0 : 1;
+    }
+
+    result_t finish(const char* op) {
+        double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+        result_t res = {};
+
+        res.op = op;
+        res.ops = latencies.size();
+        res.errors = errors;
+        res.opsPerSec = elapsed > 0 ? latencies.size() / elapsed : 0;
+        res.p50 = percentile(50);
+        res.p99 = percentile(99);
+
+        return res;
+    }
+
+private:
+    uint64_t percentile(size_t p) {
+        if(latencies.empty()) {
+            return 0;
+        }
+
+        size_t index = std::min(latencies.size() * p / 100, latencies.size() - 1);
+        std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+
+        return latencies[index];
+    }
+
+    std::vector<uint64_t> latencies;
+    size_t errors;
+    bench_clock::time_point start;
+};
+
+struct options_t {
+    bool quick;
+    const char* backend;
+    size_t ops;
+    const char* output;
+};
+
+class Benchmark {
+public:
+    Benchmark(const options_t& options): options(options), rng(0x4b5653746f7265ull) {}
+
+    void run(const backend_t& backend, size_t valueSize, size_t keys) {
+        std::unique_ptr<Fixture> fixture(backend.make(keys * (valueSize + KEY_SIZE)));
+        KVStoreInterface& store = fixture->store();
+
+        if(!store.begin()) {
+            fprintf(stderr, "%s: begin failed\n", backend.name);
+            return;
+        }
+
+        fprintf(stderr, "%s: %zu keys of %zu bytes\n", backend.name, keys, valueSize);
+
+        fillKeys(keys);
+        std::string value(valueSize, 'v');
+        std::vector<uint8_t> buffer(valueSize + 1);
+
+        // strings are stored without the terminator, so that every entry has the size under test
+        for(size_t i=0; i<keys; i++) {
+            store.putString(names[i].c_str(), value.c_str());
+        }
+
+        for(const pattern_t& pattern: patterns) {
+            KeyChooser chooser(pattern.distribution, keys, rng);
+            size_t ops = options.ops;
+
+            if(pattern.readPercent >= 0) {
+                Recorder recorder(ops);
+                for(size_t i=0; i<ops; i++) {
+                    const char* key = names[chooser.next()].c_str();
+                    bool read = (int)std::uniform_int_distribution<int>(0, 99)(rng) < pattern.readPercent;
+
+                    recorder.measure([&]() {
+                        return read ?
+                            store.getBytes(key, buffer.data(), valueSize) > 0 :
+                            store.putBytes(key, (const uint8_t*)value.data(), valueSize) > 0;
+                    });
+                }
+                add(recorder.finish("mixed"), backend, pattern, valueSize, keys);
+                continue;
+            }
+
+            {
+                Recorder recorder(ops);
+                for(size_t i=0; i<ops; i++) {
+                    const char* key = names[chooser.next()].c_str();
+                    recorder.measure([&]() {
+                        return store.getString(key, (char*)buffer.data(), valueSize + 1) == valueSize;
+                    });
+                }
+                add(recorder.finish("getString"), backend, pattern, valueSize, keys);
+            }
+
+            {
+                Recorder recorder(ops);
+                for(size_t i=0; i<ops; i++) {
+                    const char* key = names[chooser.next()].c_str();
+                    recorder.measure([&]() {
+                        return store.getBytes(key, buffer.data(), valueSize) > 0;
+                    });
+                }
+                add(recorder.finish("get"), backend, pattern, valueSize, keys);
+            }
+
+            {
+                Recorder recorder(ops);
+                for(size_t i=0; i<ops; i++) {
+                    const char* key = names[chooser.next()].c_str();
+                    recorder.measure([&]() {
+                        return store.exists(key);
+                    });
+                }
+                add(recorder.finish("exists"), backend, pattern, valueSize, keys);
+            }
+
+            {
+                Recorder recorder(ops);
+                for(size_t i=0; i<ops; i++) {
+                    const char* key = names[chooser.next()].c_str();
+                    recorder.measure([&]() {
+                        return store.putString(key, value.c_str()) == valueSize;
+                    });
+                }
+                add(recorder.finish("put"), backend, pattern, valueSize, keys);
+            }
+        }
+
+        // every key is removed once, in random order, the access pattern does not apply
+        std::vector<size_t> order(keys);
+        for(size_t i=0; i<keys; i++) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        order.resize(std::min(keys, options.ops));
+
+        Recorder recorder(order.size());
+        for(size_t index: order) {
+            const char* key = names[index].c_str();
+            recorder.measure([&]() {
+                return store.remove(key) > 0;
+            });
+        }
+        add(recorder.finish("remove"), backend, patterns[0], valueSize, keys);
+
+        store.end();
+    }
+
+    bool write() const {
+        FILE* out = options.output != nullptr ? fopen(options.output, "w") : stdout;
+
+        if(out == nullptr) {
+            return false;
+        }
+
+        char date[32];
+        time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+        fprintf(out, "{\n");
+        fprintf(out, "  \"library\": \"Arduino_KVStore\",\n");
+        fprintf(out, "  \"version\": \"%s\",\n", KVSTORE_VERSION);
+        fprintf(out, "  \"date\": \"%s\",\n", date);
+        fprintf(out, "  \"ops_per_run\": %zu,\n", options.ops);
+        fprintf(out, "  \"results\": [\n");
+
+        for(size_t i=0; i<results.size(); i++) {
+            const result_t& r = results[i];
+
+            fprintf(out, "    {\"backend\": \"%s\", \"pattern\": \"%s\", \"op\": \"%s\", "
+                "\"value_size\": %zu, \"keys\": %zu, \"ops\": %zu, \"errors\": %zu, "
+                "\"ops_per_sec\": %.1f, \"p50_ns\": %llu, \"p99_ns\": %llu}%s\n",
+                r.backend, r.pattern, r.op, r.valueSize, r.keys, r.ops, r.errors,
+                r.opsPerSec, (unsigned long long)r.p50, (unsigned long long)r.p99,
+                i + 1 < results.size() ? "," : "");
+        }
+
+        fprintf(out, "  ]\n}\n");
+
+        if(out != stdout) {
+            fclose(out);
+        }
+
+        return true;
+    }
+
+    static constexpr size_t KEY_SIZE = 16;
+
+private:
+    void fillKeys(size_t keys) {
+        char name[32];
+
+        for(size_t i=names.size(); i<keys; i++) {
+            snprintf(name, sizeof(name), "k%07zu", i);
+            names.push_back(name);
+        }
+    }
+
+    void add(result_t res, const backend_t& backend, const pattern_t& pattern, size_t valueSize, size_t keys) {
+        res.backend = backend.name;
+        res.pattern = pattern.name;
+        res.valueSize = valueSize;
+        res.keys = keys;
+
+        results.push_back(res);
+    }
+
+    const options_t& options;
+    std::mt19937_64 rng;
+    std::vector<std::string> names;
+    std::vector<result_t> results;
+};
+
+constexpr size_t Benchmark::KEY_SIZE;
+
+int main(int argc, char* argv[]) {
+    options_t options = { false, nullptr, 0, nullptr };
+
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--quick") == 0) {
+            options.quick = true;
+        } else if(strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            options.backend = argv[++i];
+        } else if(strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            options.ops = strtoul(argv[++i], nullptr, 10);
+        } else if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--backend name] [--ops n] [--output file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<size_t> sizes = options.quick ?
+        std::vector<size_t>{ 1, 256, 4096 } :
+        std::vector<size_t>{ 1, 16, 256, 4096, 65536 };
+    const std::vector<size_t> counts = options.quick ?
+        std::vector<size_t>{ 10, 1000 } :
+        std::vector<size_t>{ 10, 1000, 10000, 100000 };
+
+    // the whole data set is kept in memory by most backends, bigger combinations are skipped
+    const size_t maxDataSize = options.quick ? 1024 * 1024 : 64 * 1024 * 1024;
+
+    if(options.ops == 0) {
+        options.ops = options.quick ? 1000 : 10000;
+    }
+
+    Benchmark benchmark(options);
+
+    for(const backend_t& backend: backends) {
+        if(options.backend != nullptr && strcmp(options.backend, backend.name) != 0) {
+            continue;
+        }
+
+        for(size_t valueSize: sizes) {
+            for(size_t keys: counts) {
+                size_t dataSize = keys * (valueSize + Benchmark::KEY_SIZE);
+
+                if(dataSize > maxDataSize || dataSize > backend.maxDataSize) {
+                    continue;
+                }
+
+                benchmark.run(backend, valueSize, keys);
+            }
+        }
+    }
+
+    return benchmark.write() ? 0 : 1;
+}
@@ -0,0 +1,387 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Host microbenchmark of the encoding of the scalar values exchanged by Unor4KVStore with its coprocessor.
+ *
+ * The "legacy" path reproduces what the backend did through the modem object: a std::string format and
+ * reply per call, vsnprintf to build the command, the reply accumulated in a std::string and sscanf to
+ * parse it. The "direct" path is the current one: atScalarCommand, ATPipeline and atScalarValue.
+ * Both talk to the same stand-in coprocessor, whose work is not counted in the allocations and the bytes
+ * but is part of the time of both, thus the difference of the times is the saving on the host.
+ *
+ *   benchmarkModemKVStore [--ops n] [--output file.json]
+ */
+#include <kvstore/utility/atcommand.h>
+#include <kvstore/utility/pipeline.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifndef KVSTORE_VERSION
+#define KVSTORE_VERSION "unknown"
+#endif // KVSTORE_VERSION
+
+// heap allocations performed by the code under measure
+static size_t allocations = 0;
+static bool counting = false;
+
+void* operator new(size_t size) {
+    if(counting) {
+        allocations++;
+    }
+
+    void* p = malloc(size > 0 ? size : 1);
+    if(p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// the stand-in is not part of the host code under measure
+class Pause {
+public:
+    Pause(): was(counting) { counting = false; }
+    ~Pause() { counting = was; }
+private:
+    bool was;
+};
+
+/*
+ * Coprocessor that answers +PREFPUT and +PREFGET of integer values, replies are available
+ * as soon as the command line is complete
+ */
+class StandInModem: public KVModemTransport {
+public:
+    size_t available() override { return rxLen - rxPos; }
+
+    int read() override {
+        if(rxPos == rxLen) {
+            return -1;
+        }
+        rxBytes++;
+        return (uint8_t)rx[rxPos++];
+    }
+
+    size_t write(const uint8_t data[], size_t len) override {
+        Pause pause;
+        txBytes += len;
+
+        for(size_t i=0; i<len; i++) {
+            if(cmdLen < sizeof(cmd) - 1) {
+                cmd[cmdLen++] = data[i];
+            }
+            if(data[i] == '\n') {
+                cmd[cmdLen] = '\0';
+                execute();
+                cmdLen = 0;
+            }
+        }
+
+        return len;
+    }
+
+    size_t txBytes = 0;
+    size_t rxBytes = 0;
+
+private:
+    void execute() {
+        // AT+PREFxxx=<key>,<type>[,<value>]
+        char* args = strchr(cmd, '=');
+        char* comma = args != nullptr ? strchr(args, ',') : nullptr;
+        if(comma == nullptr) {
+            reply("ERROR\r\n");
+            return;
+        }
+
+        char* end;
+        strtol(comma + 1, &end, 10);
+        bool put = strncmp(cmd, "AT+PREFPUT=", 11) == 0;
+
+        if(put && *end == ',') {
+            value = strtoll(end + 1, nullptr, 10);
+            reply("+PREFPUT: 4\r\nOK\r\n");
+        } else if(!put) {
+            char res[48];
+            snprintf(res, sizeof(res), "+PREFGET: %lld\r\nOK\r\n", value);
+            reply(res);
+        } else {
+            reply("ERROR\r\n");
+        }
+    }
+
+    void reply(const char* s) {
+        // the previous replies have been read, since every command waits for its own
+        rxPos = 0;
+        rxLen = strlen(s);
+        memcpy(rx, s, rxLen);
+    }
+
+    char cmd[96];
+    size_t cmdLen = 0;
+    char rx[64];
+    size_t rxLen = 0;
+    size_t rxPos = 0;
+    long long value = 0;
+};
+
+/*
+ * what ModemClass::write did: format the command, then read the reply in a string
+ * until OK or ERROR and keep what follows the prompt
+ */
+static bool legacyWrite(StandInModem& modem, const std::string& prompt, std::string& res, const char* fmt, ...) {
+    char tx[256];
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(tx, sizeof(tx), fmt, va);
+    va_end(va);
+
+    modem.write((const uint8_t*)tx, strlen(tx));
+
+    std::string data;
+    while(modem.available() > 0) {
+        data += (char)modem.read();
+    }
+
+    if(data.find("OK\r\n") == std::string::npos) {
+        return false;
+    }
+
+    size_t pos = data.find(prompt);
+    if(pos != std::string::npos) {
+        size_t start = data.find_first_not_of(' ', pos + prompt.size());
+        res = data.substr(start, data.find("\r\n", start) - start);
+    }
+
+    return true;
+}
+
+static int legacyPut(StandInModem& modem, const char* key, KVStoreInterface::Type t, const uint8_t value[], size_t len) {
+    std::string res = "";
+    std::string format = "%s%s,%d,%hu\r\n";
+
+    switch(t) {
+    case KVStoreInterface::PT_I8:     format = "%s%s,%d,%hd\r\n"; break;
+    case KVStoreInterface::PT_U8:     format = "%s%s,%d,%hu\r\n"; break;
+    case KVStoreInterface::PT_I16:    format = "%s%s,%d,%hd\r\n"; break;
+    case KVStoreInterface::PT_U16:    format = "%s%s,%d,%hu\r\n"; break;
+    case KVStoreInterface::PT_I32:    format = "%s%s,%d,%d\r\n";  break;
+    case KVStoreInterface::PT_U32:    format = "%s%s,%d,%u\r\n";  break;
+    default: break;
+    }
+
+    uint32_t tmp = 0;
+    memcpy(&tmp, value, len);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    if(legacyWrite(modem, std::string("+PREFPUT:"), res, format.c_str(), "AT+PREFPUT=", key, t, tmp)) {
+        return atoi(res.c_str());
+    }
+#pragma GCC diagnostic pop
+
+    return 0;
+}
+
+static int legacyGet(StandInModem& modem, const char* key, KVStoreInterface::Type t, uint8_t value[], size_t len) {
+    std::string res = "";
+    std::string format = "%s%s,%d,%u\r\n";
+
+    switch(t) {
+    case KVStoreInterface::PT_I8:     format = "%hd"; break;
+    case KVStoreInterface::PT_U8:     format = "%hu"; break;
+    case KVStoreInterface::PT_I16:    format = "%hd"; break;
+    case KVStoreInterface::PT_U16:    format = "%hu"; break;
+    case KVStoreInterface::PT_I32:    format = "%d";  break;
+    case KVStoreInterface::PT_U32:    format = "%u";  break;
+    default: break;
+    }
+
+    if(legacyWrite(modem, std::string("+PREFGET:"), res, "%s%s,%d\r\n", "AT+PREFGET=", key, t)) {
+        sscanf(res.c_str(), format.c_str(), value);
+        return len;
+    }
+
+    return 0;
+}
+
+static int directPut(ATPipeline& pipeline, const char* key, KVStoreInterface::Type t, const uint8_t value[], size_t) {
+    char cmd[AT_COMMAND_SIZE];
+
+    if(atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", key, t, value) == 0) {
+        return 0;
+    }
+
+    int res = pipeline.wait(pipeline.submit("+PREFPUT:", cmd));
+    return res > 0 ? res : 0;
+}
+
+static int directGet(ATPipeline& pipeline, const char* key, KVStoreInterface::Type t, uint8_t value[], size_t len) {
+    char cmd[AT_COMMAND_SIZE];
+    int64_t number;
+
+    if(atScalarCommand(cmd, sizeof(cmd), "AT+PREFGET=", key, t) == 0) {
+        return 0;
+    }
+
+    ATPipeline::handle_t handle = pipeline.submit("+PREFGET:", cmd);
+    pipeline.wait(handle);
+
+    return pipeline.number(handle, &number) ? atScalarValue(number, t, value, len) : 0;
+}
+
+typedef struct {
+    const char* path;
+    const char* op;
+    const char* type;
+    size_t ops;
+    size_t errors;
+    double nsPerOp;
+    double txBytes;
+    double rxBytes;
+    double allocations;
+} result_t;
+
+typedef struct {
+    const char* name;
+    KVStoreInterface::Type type;
+    size_t size;
+    int32_t value;
+} scalar_t;
+
+static const scalar_t scalars[] = {
+    { "i8",     KVStoreInterface::PT_I8,    1,  -100 },
+    { "u16",    KVStoreInterface::PT_U16,   2,  60000 },
+    { "i32",    KVStoreInterface::PT_I32,   4,  -2000000000 },
+    { "u32",    KVStoreInterface::PT_U32,   4,  2000000000 },
+};
+
+template<typename F>
+static result_t measure(const char* path, const char* op, const scalar_t& scalar, StandInModem& modem, size_t ops, F f) {
+    size_t tx = modem.txBytes;
+    size_t rx = modem.rxBytes;
+    size_t errors = 0;
+
+    allocations = 0;
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t i=0; i<ops; i++) {
+        if(f() != (int)scalar.size) {
+            errors++;
+        }
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    counting = false;
+
+    result_t res = {
+        path, op, scalar.name, ops, errors,
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ops,
+        (double)(modem.txBytes - tx) / ops,
+        (double)(modem.rxBytes - rx) / ops,
+        (double)allocations / ops,
+    };
+
+    return res;
+}
+
+int main(int argc, char* argv[]) {
+    size_t ops = 100000;
+    const char* output = nullptr;
+
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops = strtoul(argv[++i], nullptr, 10);
+        } else if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--ops n] [--output file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(ops == 0) {
+        ops = 1;
+    }
+
+    StandInModem modem;
+    ATPipeline pipeline(&modem);
+    std::vector<result_t> results;
+
+    for(const scalar_t& scalar: scalars) {
+        // the value is read in a bigger buffer, since sscanf of the legacy path may write past its size
+        uint8_t value[8];
+        uint8_t out[8];
+        memcpy(value, &scalar.value, sizeof(scalar.value));
+
+        results.push_back(measure("legacy", "put", scalar, modem, ops, [&]() {
+            return legacyPut(modem, "sensor.period", scalar.type, value, scalar.size) > 0 ? (int)scalar.size : 0;
+        }));
+        results.push_back(measure("direct", "put", scalar, modem, ops, [&]() {
+            return directPut(pipeline, "sensor.period", scalar.type, value, scalar.size) > 0 ? (int)scalar.size : 0;
+        }));
+        results.push_back(measure("legacy", "get", scalar, modem, ops, [&]() {
+            return legacyGet(modem, "sensor.period", scalar.type, out, scalar.size);
+        }));
+        results.push_back(measure("direct", "get", scalar, modem, ops, [&]() {
+            return directGet(pipeline, "sensor.period", scalar.type, out, scalar.size);
+        }));
+    }
+
+    FILE* out = output != nullptr ? fopen(output, "w") : stdout;
+    if(out == nullptr) {
+        fprintf(stderr, "cannot write %s\n", output);
+        return 1;
+    }
+
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"library\": \"Arduino_KVStore\",\n");
+    fprintf(out, "  \"version\": \"%s\",\n", KVSTORE_VERSION);
+    fprintf(out, "  \"date\": \"%s\",\n", date);
+    fprintf(out, "  \"ops_per_run\": %zu,\n", ops);
+    fprintf(out, "  \"results\": [\n");
+
+    for(size_t i=0; i<results.size(); i++) {
+        const result_t& r = results[i];
+
+        fprintf(out, "    {\"path\": \"%s\", \"op\": \"%s\", \"type\": \"%s\", \"ops\": %zu, \"errors\": %zu, "
+            "\"ns_per_op\": %.1f, \"tx_bytes_per_op\": %.1f, \"rx_bytes_per_op\": %.1f, \"allocs_per_op\": %.2f}%s\n",
+            r.path, r.op, r.type, r.ops, r.errors, r.nsPerOp, r.txBytes, r.rxBytes, r.allocations,
+            i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+
+    if(out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,345 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/decorators/cached.h>
+#include "../mock_kvstore.h"
+
+TEST_CASE( "CachedKVStore serves repeated reads from RAM", "[cached][read]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    REQUIRE( mock.putUInt("0", 0x55555555) == 4 );
+    mock.resetCounters();
+
+    REQUIRE( store.getUInt("0") == 0x55555555 );
+    size_t reads = mock.reads;
+    REQUIRE( reads > 0 );
+
+    for(int i=0; i<100; i++) {
+        REQUIRE( store.getUInt("0") == 0x55555555 );
+    }
+    REQUIRE( mock.reads == reads );
+
+    SECTION( "a missing key is always looked up in the wrapped store" ) {
+        REQUIRE( store.getUInt("1", 0x56) == 0x56 );
+        REQUIRE( mock.reads > reads );
+    }
+}
+
+TEST_CASE( "CachedKVStore defers writes until they are flushed", "[cached][write]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    for(uint32_t i=0; i<100; i++) {
+        REQUIRE( store.putUInt("0", i) == 4 );
+    }
+    REQUIRE( store.putString("1", "pippo") == 5 );
+
+    REQUIRE( mock.writes == 0 );
+    REQUIRE( store.getUInt("0") == 99 );
+    REQUIRE( store.exists("1") );
+
+    SECTION( "flush writes all the dirty entries in a single batch" ) {
+        REQUIRE( store.flush() );
+        REQUIRE( mock.batches == 1 );
+        REQUIRE( mock.writes == 2 );
+        REQUIRE( mock.getUInt("0") == 99 );
+
+        char res[6];
+        mock.getString("1", res, 6);
+        REQUIRE( strcmp(res, "pippo") == 0 );
+
+        REQUIRE( store.flush() );
+        REQUIRE( mock.writes == 2 );
+    }
+
+    SECTION( "end writes back the dirty entries" ) {
+        REQUIRE( store.end() );
+        REQUIRE( mock.getUInt("0") == 99 );
+    }
+
+    SECTION( "removing a dirty entry drops it without writing it" ) {
+        REQUIRE( store.remove("0") == 1 );
+        REQUIRE_FALSE( store.exists("0") );
+        REQUIRE( store.flush() );
+        REQUIRE_FALSE( mock.exists("0") );
+    }
+
+    SECTION( "clear drops every entry" ) {
+        REQUIRE( store.clear() );
+        REQUIRE( store.flush() );
+        REQUIRE( mock.kvmap.empty() );
+    }
+}
+
+TEST_CASE( "CachedKVStore evicts the least recently used entries", "[cached][eviction]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock, 2, 64);
+    store.begin();
+
+    REQUIRE( store.putUInt("0", 0) == 4 );
+    REQUIRE( store.putUInt("1", 1) == 4 );
+    REQUIRE( store.getUInt("0") == 0 );
+
+    // "1" is the least recently used and gets written back to make space for "2"
+    REQUIRE( store.putUInt("2", 2) == 4 );
+    REQUIRE( mock.writes == 1 );
+    REQUIRE( mock.getUInt("1") == 1 );
+    REQUIRE_FALSE( mock.exists("0") );
+
+    SECTION( "values bigger than the memory budget are written through" ) {
+        uint8_t buf[128] = { 0x55 };
+
+        REQUIRE( store.putBytes("3", buf, sizeof(buf)) == sizeof(buf) );
+        REQUIRE( mock.getBytesLength("3") == sizeof(buf) );
+        REQUIRE( store.size() <= 64 );
+    }
+}
+
+TEST_CASE( "CachedKVStore transactions write back the dirty entries on commit", "[cached][transaction]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    REQUIRE( store.putUInt("0", 0) == 4 );
+
+    // the mock store does not support transactions, but the cache still groups the writes
+    REQUIRE_FALSE( store.beginTransaction() );
+    REQUIRE( mock.getUInt("0") == 0 );
+
+    REQUIRE( store.putUInt("1", 1) == 4 );
+    REQUIRE( store.putUInt("2", 2) == 4 );
+
+    SECTION( "commit writes the entries in a single batch" ) {
+        mock.resetCounters();
+        store.commit();
+
+        REQUIRE( mock.batches == 1 );
+        REQUIRE( mock.getUInt("1") == 1 );
+        REQUIRE( mock.getUInt("2") == 2 );
+    }
+
+    SECTION( "rollback drops the entries that were not written back" ) {
+        store.rollback();
+
+        REQUIRE_FALSE( store.exists("1") );
+        REQUIRE_FALSE( store.exists("2") );
+        REQUIRE( store.getUInt("0", 0x55) == 0 );
+    }
+
+    SECTION( "rollback drops also the entries read during the transaction" ) {
+        REQUIRE( store.getUInt("0") == 0 );
+        store.rollback();
+
+        mock.resetCounters();
+        REQUIRE( store.getUInt("0", 0x55) == 0 );
+        REQUIRE( mock.reads > 0 );
+    }
+}
+
+TEST_CASE( "CachedKVStore checks the type of the cached values", "[cached][type]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    float f = 0;
+    int32_t i = 0;
+
+    REQUIRE( store.putInt("0", 42) == 4 );
+    REQUIRE( store.tryGet("0", f) == KVStoreInterface::ST_TYPE_MISMATCH );
+    REQUIRE( store.tryGet("0", i) == KVStoreInterface::ST_FOUND );
+    REQUIRE( i == 42 );
+
+    SECTION( "entries read as bytes leave the check to the wrapped store" ) {
+        REQUIRE( store.flush() );
+        store.invalidate();
+
+        uint8_t b[4];
+        REQUIRE( store.getBytes("0", b, sizeof(b)) == 4 );
+        REQUIRE( store.tryGet("0", i) == KVStoreInterface::ST_FOUND );
+        REQUIRE( i == 42 );
+    }
+}
+
+TEST_CASE( "CachedKVStore iteration includes the entries not yet written back", "[cached][foreach]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    REQUIRE( mock.putUInt("0", 0) == 4 );
+    REQUIRE( store.putUInt("1", 1) == 4 );
+    REQUIRE( store.putUShort("0", 0) == 2 );
+
+    size_t count = 0, total = 0;
+    REQUIRE( store.forEach([&](const KVStoreInterface::KeyInfo& info) {
+        count++;
+        total += info.size;
+        return true;
+    }, true) == 2 );
+
+    REQUIRE( count == 2 );
+    REQUIRE( total == 6 );
+}
+
+TEST_CASE( "CachedKVStore prefix removal drops the cached entries", "[cached][prefix]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    REQUIRE( mock.putUInt("dev/0", 0) == 4 );
+    REQUIRE( store.getUInt("dev/0") == 0 );
+    REQUIRE( store.putUInt("dev/1", 1) == 4 );
+    REQUIRE( store.putUInt("other", 2) == 4 );
+
+    REQUIRE( store.scanPrefix("dev/", [](const KVStoreInterface::KeyInfo&) { return true; }) == 2 );
+    REQUIRE( store.removePrefix("dev/") == 2 );
+
+    REQUIRE_FALSE( store.exists("dev/0") );
+    REQUIRE_FALSE( store.exists("dev/1") );
+    REQUIRE( store.exists("other") );
+
+    REQUIRE( store.flush() );
+    REQUIRE( mock.kvmap.size() == 1 );
+}
+
+TEST_CASE( "CachedKVStore provides views over the cached values", "[cached][view]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    uint8_t value[] = { 0x55, 0x56, 0x57, 0x58 };
+    REQUIRE( mock.putBytes("0", value, sizeof(value)) == sizeof(value) );
+    REQUIRE( store.putBytes("1", value, 2) == 2 );
+    mock.resetCounters();
+
+    SECTION( "dirty entries are viewed from the cache" ) {
+        KVStoreInterface::View view = store.getView("1");
+
+        REQUIRE( view.len == 2 );
+        REQUIRE( memcmp(view.data, value, 2) == 0 );
+        REQUIRE( mock.reads == 0 );
+    }
+
+    SECTION( "values in RAM in the wrapped store are not duplicated" ) {
+        KVStoreInterface::View view = store.getView("0");
+
+        REQUIRE( view.data == mock.kvmap["0"].data() );
+        REQUIRE( view.len == sizeof(value) );
+    }
+
+    SECTION( "values not in RAM are loaded once in the cache" ) {
+        mock.views = false;
+
+        KVStoreInterface::View view = store.getView("0");
+        REQUIRE( view.data != nullptr );
+        REQUIRE( view.data != mock.kvmap["0"].data() );
+        REQUIRE( memcmp(view.data, value, sizeof(value)) == 0 );
+
+        mock.resetCounters();
+        REQUIRE( store.getView("0").data == view.data );
+        REQUIRE( mock.reads == 0 );
+    }
+
+    SECTION( "missing keys have an empty view" ) {
+        REQUIRE( store.getView("2").data == nullptr );
+    }
+}
+
+TEST_CASE( "CachedKVStore values can be put from views over the cache", "[cached][view]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock, 4, 64);
+    store.begin();
+
+    uint8_t value[20];
+    for(size_t i=0; i<sizeof(value); i++) {
+        value[i] = i;
+    }
+    REQUIRE( store.putBytes("src", value, sizeof(value)) == sizeof(value) );
+
+    SECTION( "a value is put again with the same length" ) {
+        KVStoreInterface::View view = store.getView("src");
+        REQUIRE( store.putBytes("src", view.data, view.len) == sizeof(value) );
+        REQUIRE( memcmp(store.getView("src").data, value, sizeof(value)) == 0 );
+    }
+
+    SECTION( "a value is put again with a different length" ) {
+        KVStoreInterface::View view = store.getView("src");
+        REQUIRE( store.putBytes("src", view.data + 2, 10) == 10 );
+        REQUIRE( memcmp(store.getView("src").data, value + 2, 10) == 0 );
+    }
+
+    SECTION( "a value is copied to a key that evicts it" ) {
+        KVStoreInterface::View view = store.getView("src");
+        REQUIRE( store.putBytes("dst", view.data, 2) == 2 );
+        REQUIRE( store.putBytes("big", view.data, view.len) == sizeof(value) );
+
+        // src is evicted to make room for the value copied from it
+        view = store.getView("src");
+        REQUIRE( store.putInt("another_long_key", 0) == 4 );
+        REQUIRE( store.putBytes("dst2", view.data, view.len) == sizeof(value) );
+        REQUIRE( memcmp(store.getView("dst2").data, value, sizeof(value)) == 0 );
+    }
+}
+
+TEST_CASE( "CachedKVStore streams reach the wrapped store", "[cached][stream]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    uint8_t value[] = { 0x55, 0x56, 0x57, 0x58 };
+    uint8_t chunk[4];
+    mock.views = false;
+
+    SECTION( "a dirty entry is written back before being read in chunks" ) {
+        REQUIRE( store.putBytes("0", value, sizeof(value)) == sizeof(value) );
+        REQUIRE( mock.writes == 0 );
+
+        REQUIRE( store.openRead("0") == sizeof(value) );
+        REQUIRE( mock.writes == 1 );
+        REQUIRE( store.read(chunk, 2, 2) == 2 );
+        REQUIRE( memcmp(chunk, value + 2, 2) == 0 );
+        store.closeRead();
+    }
+
+    SECTION( "a streamed value replaces the cached one" ) {
+        REQUIRE( store.putBytes("0", value, 2) == 2 );
+
+        REQUIRE( store.openWrite("0", sizeof(value)) );
+        REQUIRE( store.write(value, sizeof(value)) == sizeof(value) );
+        REQUIRE( store.finalize() );
+
+        REQUIRE( store.getBytes("0", chunk, sizeof(chunk)) == sizeof(value) );
+        REQUIRE( memcmp(chunk, value, sizeof(value)) == 0 );
+        REQUIRE( store.flush() );
+        REQUIRE( mock.writes == 1 );
+    }
+
+    SECTION( "missing keys cannot be opened for reading" ) {
+        REQUIRE( store.openRead("1") == 0 );
+    }
+}
+
+TEST_CASE( "CachedKVStore flush writes back deferred references too", "[cached][references]" ) {
+    MockKVStore mock;
+    CachedKVStore store(mock);
+    store.begin();
+
+    auto ref = store.getDeferred<uint32_t>("0");
+    ref = 0x55;
+
+    REQUIRE( mock.writes == 0 );
+    REQUIRE( store.flush() );
+    REQUIRE( mock.writes == 1 );
+    REQUIRE( mock.getUInt("0") == 0x55 );
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/decorators/compressed.h>
+#include <kvstore/implementation/ram.h>
+#include "../mock_kvstore.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::string config() {
+    std::string json = "{";
+    for(int i=0; i<20; i++) {
+        json += "\"param" + std::to_string(i) + "\":{\"enabled\":true,\"interval\":1000},";
+    }
+    return json + "}";
+}
+
+TEST_CASE( "CompressedKVStore writes big values compressed and reads them back", "[compressed][roundtrip]" ) {
+    MockKVStore mock;
+    CompressedKVStore store(mock);
+    std::string json = config();
+
+    REQUIRE( store.putBytes("cfg", (const uint8_t*)json.data(), json.size()) == (int)json.size() );
+    REQUIRE( mock.getBytesLength("cfg") < json.size() / 2 );
+    REQUIRE( store.getBytesLength("cfg") == json.size() );
+
+    std::vector<uint8_t> res(json.size());
+    REQUIRE( store.getBytes("cfg", res.data(), res.size()) == (int)json.size() );
+    REQUIRE( memcmp(res.data(), json.data(), json.size()) == 0 );
+
+    SECTION( "a short buffer receives the beginning of the value" ) {
+        uint8_t head[10];
+
+        REQUIRE( store.getBytes("cfg", head, sizeof(head)) == (int)json.size() );
+        REQUIRE( memcmp(head, json.data(), sizeof(head)) == 0 );
+    }
+
+    SECTION( "strings are compressed as well" ) {
+        REQUIRE( store.putString("str", json.c_str()) == json.size() );
+        REQUIRE( mock.getBytesLength("str") < json.size() / 2 );
+
+        std::vector<char> str(json.size() + 1);
+        REQUIRE( store.getString("str", str.data(), str.size()) == json.size() );
+        REQUIRE( json == str.data() );
+    }
+
+    SECTION( "streams go through the codec" ) {
+        REQUIRE( store.openRead("cfg") == json.size() );
+
+        std::vector<uint8_t> chunk(json.size());
+        REQUIRE( store.read(chunk.data(), chunk.size(), 0) == (int)json.size() );
+        REQUIRE( memcmp(chunk.data(), json.data(), json.size()) == 0 );
+        store.closeRead();
+    }
+
+    SECTION( "views are not available for compressed values" ) {
+        REQUIRE( store.getView("cfg").data == nullptr );
+    }
+}
+
+TEST_CASE( "CompressedKVStore stores small and incompressible values as they are", "[compressed][plain]" ) {
+    MockKVStore mock;
+    CompressedKVStore store(mock, 64, 256);
+
+    REQUIRE( store.putBytes("small", (const uint8_t*)"pippo", 5) == 5 );
+    REQUIRE( mock.getBytesLength("small") == 5 );
+    REQUIRE( store.putUInt("int", 0x55555555) == 4 );
+    REQUIRE( store.getUInt("int") == 0x55555555 );
+
+    // values bigger than the work buffer are never compressed
+    std::vector<uint8_t> big(1000, 0x55);
+    REQUIRE( store.putBytes("big", big.data(), big.size()) == (int)big.size() );
+    REQUIRE( mock.getBytesLength("big") == big.size() );
+
+    std::vector<uint8_t> res(big.size());
+    REQUIRE( store.getBytes("big", res.data(), res.size()) == (int)big.size() );
+    REQUIRE( res == big );
+
+    SECTION( "values written without the decorator are still readable" ) {
+        std::string json = config().substr(0, 200);
+        REQUIRE( mock.putBytes("legacy", (const uint8_t*)json.data(), json.size()) == (int)json.size() );
+
+        REQUIRE( store.getBytesLength("legacy") == json.size() );
+        std::vector<uint8_t> legacy(json.size());
+        REQUIRE( store.getBytes("legacy", legacy.data(), legacy.size()) == (int)json.size() );
+        REQUIRE( memcmp(legacy.data(), json.data(), json.size()) == 0 );
+    }
+
+    SECTION( "a plain value that looks like a header is not decoded" ) {
+        // marker, method, type and a size that would match the stored value
+        uint8_t tricky[] = { 0xC5, 0, 9, 2, 0, 0, 0, 'a', 'b' };
+        REQUIRE( store.putBytes("tricky", tricky, sizeof(tricky)) == sizeof(tricky) );
+
+        uint8_t out[sizeof(tricky)];
+        REQUIRE( store.getBytes("tricky", out, sizeof(out)) == sizeof(tricky) );
+        REQUIRE( memcmp(out, tricky, sizeof(tricky)) == 0 );
+        REQUIRE( store.getBytesLength("tricky") == sizeof(tricky) );
+    }
+
+    SECTION( "a plain value that looks like a header is not decoded past the work buffer" ) {
+        std::vector<uint8_t> tricky(256 + 1, 'a');
+        uint32_t len = tricky.size() - 7;
+        tricky[0] = 0xC5;
+        tricky[1] = 0;
+        tricky[2] = 9;
+        memcpy(&tricky[3], &len, sizeof(len));
+        std::vector<uint8_t> out(tricky.size());
+
+        // up to maxSize it is wrapped
+        REQUIRE( store.putBytes("tricky", tricky.data(), tricky.size() - 1) == (int)tricky.size() - 1 );
+        REQUIRE( store.getBytes("tricky", out.data(), out.size()) == (int)tricky.size() - 1 );
+        REQUIRE( memcmp(out.data(), tricky.data(), tricky.size() - 1) == 0 );
+
+        // one byte more it cannot be, it would be decoded as the header says
+        REQUIRE( store.putBytes("tricky", tricky.data(), tricky.size()) < 0 );
+        REQUIRE( store.getBytesLength("tricky") == tricky.size() - 1 );
+
+        // without a valid header it is stored as it is
+        tricky[2] = 0x55;
+        REQUIRE( store.putBytes("tricky", tricky.data(), tricky.size()) == (int)tricky.size() );
+        REQUIRE( mock.getBytesLength("tricky") == tricky.size() );
+        REQUIRE( store.getBytes("tricky", out.data(), out.size()) == (int)tricky.size() );
+        REQUIRE( out == tricky );
+    }
+}
+
+TEST_CASE( "CompressedKVStore keeps the type of the values on typed stores", "[compressed][type]" ) {
+    RamKVStore ram;
+    REQUIRE( ram.begin() );
+    CompressedKVStore store(ram);
+    std::string json = config();
+
+    REQUIRE( store.putString("str", json.c_str()) == json.size() );
+    REQUIRE( store.getString("str", nullptr, 0) == json.size() );
+
+    std::vector<char> str(json.size() + 1);
+    REQUIRE( store.getString("str", str.data(), str.size()) == json.size() );
+    REQUIRE( json == str.data() );
+
+    SECTION( "a compressed string is not read as a blob" ) {
+        std::vector<uint8_t> blob(json.size());
+
+        REQUIRE( store.tryGet("str", blob) == KVStoreInterface::ST_TYPE_MISMATCH );
+    }
+
+    SECTION( "plain strings written before are read through the wrapped store" ) {
+        REQUIRE( ram.putString("old", "pluto") == 5 );
+
+        char old[6];
+        REQUIRE( store.getString("old", old, sizeof(old)) == 5 );
+        REQUIRE( strcmp(old, "pluto") == 0 );
+    }
+
+    REQUIRE( ram.end() );
+}
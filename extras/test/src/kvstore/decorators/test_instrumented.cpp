@@ -0,0 +1,146 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/decorators/instrumented.h>
+#include "../mock_kvstore.h"
+#include <chrono>
+#include <thread>
+
+// store whose lookups take a known time, in order to check the latency histograms
+class SlowKVStore: public MockKVStore {
+public:
+    bool exists(const key_t& key) const override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return MockKVStore::exists(key);
+    }
+};
+
+TEST_CASE( "InstrumentedKVStore counts calls, bytes and misses", "[instrumented][counters]" ) {
+    MockKVStore mock;
+    InstrumentedKVStore store(mock);
+
+    REQUIRE( store.begin() );
+    REQUIRE( store.putUInt("0", 0x55555555) == 4 );
+    REQUIRE( store.putBytes("1", (const uint8_t*)"pippo", 5) == 5 );
+    REQUIRE( store.getUInt("0") == 0x55555555 );
+    REQUIRE( store.getUInt("2", 0x56) == 0x56 );
+    REQUIRE( store.exists("1") );
+    REQUIRE( !store.exists("2") );
+    REQUIRE( store.getBytesLength("1") == 5 );
+    REQUIRE( store.remove("1") == 1 );
+    REQUIRE( store.remove("1") == 0 );
+    REQUIRE( store.clear() );
+
+    KVStoreStats stats = store.snapshot();
+
+    REQUIRE( stats.ops[KVStoreStats::OP_BEGIN].calls == 1 );
+    REQUIRE( stats.ops[KVStoreStats::OP_PUT].calls == 2 );
+    REQUIRE( stats.ops[KVStoreStats::OP_PUT].bytes == 9 );
+    REQUIRE( stats.ops[KVStoreStats::OP_PUT].misses == 0 );
+    REQUIRE( stats.ops[KVStoreStats::OP_GET].calls == 2 );
+    REQUIRE( stats.ops[KVStoreStats::OP_GET].bytes == 4 );
+    REQUIRE( stats.ops[KVStoreStats::OP_GET].misses == 1 );
+    REQUIRE( stats.ops[KVStoreStats::OP_EXISTS].calls == 2 );
+    REQUIRE( stats.ops[KVStoreStats::OP_EXISTS].misses == 1 );
+    REQUIRE( stats.ops[KVStoreStats::OP_GET_BYTES_LENGTH].calls == 1 );
+    REQUIRE( stats.ops[KVStoreStats::OP_REMOVE].calls == 2 );
+    REQUIRE( stats.ops[KVStoreStats::OP_REMOVE].misses == 1 );
+    REQUIRE( stats.ops[KVStoreStats::OP_CLEAR].calls == 1 );
+
+    // every call falls in exactly one bucket of the histogram
+    for(uint8_t i=0; i<KVStoreStats::OP_COUNT; i++) {
+        uint32_t count = 0;
+
+        for(uint8_t b=0; b<KVStoreStats::BUCKETS; b++) {
+            count += stats.ops[i].buckets[b];
+        }
+        REQUIRE( count == stats.ops[i].calls );
+    }
+
+    SECTION( "reset sets all the counters to zero" ) {
+        store.reset();
+        stats = store.snapshot();
+
+        for(uint8_t i=0; i<KVStoreStats::OP_COUNT; i++) {
+            REQUIRE( stats.ops[i].calls == 0 );
+            REQUIRE( stats.ops[i].totalUs == 0 );
+        }
+    }
+}
+
+TEST_CASE( "InstrumentedKVStore records the latency in log2 buckets", "[instrumented][latency]" ) {
+    SlowKVStore slow;
+    InstrumentedKVStore store(slow);
+
+    for(int i=0; i<4; i++) {
+        store.exists("0");
+    }
+
+    const KVStoreStats::op_t& op = store.snapshot().ops[KVStoreStats::OP_EXISTS];
+
+    REQUIRE( op.calls == 4 );
+    REQUIRE( op.maxUs >= 2000 );
+    REQUIRE( op.totalUs >= 8000 );
+
+    // 2ms fall in the bucket [2048, 4096) us or above, when the sleep overshoots
+    uint32_t fast = 0;
+    for(uint8_t b=0; b<12; b++) {
+        fast += op.buckets[b];
+    }
+    REQUIRE( fast == 0 );
+    REQUIRE( op.percentile(50) >= 2048 );
+    REQUIRE( op.percentile(50) <= op.percentile(99) );
+}
+
+TEST_CASE( "KVStoreStats are serialized in a compact form", "[instrumented][serialize]" ) {
+    MockKVStore mock;
+    InstrumentedKVStore store(mock);
+    uint8_t buffer[KVStoreStats::MAX_SERIALIZED_SIZE];
+
+    SECTION( "an empty snapshot takes a byte for the version and one for every operation" ) {
+        REQUIRE( store.snapshot().serialize(buffer, sizeof(buffer)) == 1 + KVStoreStats::OP_COUNT );
+    }
+
+    for(int i=0; i<1000; i++) {
+        store.putUInt("0", i);
+        store.getUInt("0");
+    }
+    store.exists("1");
+
+    KVStoreStats stats = store.snapshot();
+    size_t len = stats.serialize(buffer, sizeof(buffer));
+
+    REQUIRE( len > 1 + KVStoreStats::OP_COUNT );
+    REQUIRE( len < 64 );
+
+    SECTION( "a serialized snapshot is read back unchanged" ) {
+        KVStoreStats read;
+
+        REQUIRE( read.deserialize(buffer, len) );
+        REQUIRE( memcmp(&read, &stats, sizeof(stats)) == 0 );
+    }
+
+    SECTION( "truncated or corrupted buffers are rejected" ) {
+        KVStoreStats read;
+
+        REQUIRE( !read.deserialize(buffer, len - 1) );
+        REQUIRE( read.ops[KVStoreStats::OP_PUT].calls == 0 );
+
+        buffer[0] = KVStoreStats::VERSION + 1;
+        REQUIRE( !read.deserialize(buffer, len) );
+    }
+
+    SECTION( "a buffer too small is not written" ) {
+        REQUIRE( stats.serialize(buffer, len - 1) == 0 );
+        REQUIRE( stats.serialize(buffer, 0) == 0 );
+    }
+}
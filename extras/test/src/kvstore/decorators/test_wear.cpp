@@ -0,0 +1,130 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/decorators/wear.h>
+#include <kvstore/implementation/tdb.h>
+#include <kvstore/utility/blockdevice.h>
+#include "../mock_kvstore.h"
+#include <cstdio>
+#include <cstring>
+
+TEST_CASE( "WearKVStore finds the most rewritten key with bounded memory", "[wear][top]" ) {
+    MockKVStore mock;
+    WearKVStore store(mock);
+    uint8_t value[16] = {};
+    char key[16];
+
+    // many more keys than the sketch and the list can hold
+    for(int i=0; i<500; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        REQUIRE( store.putBytes(key, value, sizeof(value)) == sizeof(value) );
+
+        if(i % 2 == 0) {
+            REQUIRE( store.putUInt("cfg/counter", i) == 4 );
+        }
+    }
+
+    WearStats stats = store.wearStats();
+
+    REQUIRE( stats.writes == 750 );
+    REQUIRE( stats.bytes == 500 * 16 + 250 * 4 );
+    REQUIRE( stats.topCount == WEAR_TOP_KEYS );
+    REQUIRE( strcmp(stats.topKeys[0].name, "cfg/counter") == 0 );
+    REQUIRE( stats.topKeys[0].writes == 250 );
+    REQUIRE( stats.topKeys[0].bytes >= 250 * 4 );
+
+    for(size_t i=1; i<stats.topCount; i++) {
+        REQUIRE( stats.topKeys[i - 1].bytes >= stats.topKeys[i].bytes );
+    }
+
+    // the sketch never underestimates
+    REQUIRE( store.estimate("cfg/counter") >= 250 * 4 );
+    for(int i=0; i<500; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        REQUIRE( store.estimate(key) >= 16 );
+    }
+
+    SECTION( "reset clears the recorded writes" ) {
+        store.reset();
+        stats = store.wearStats();
+
+        REQUIRE( stats.writes == 0 );
+        REQUIRE( stats.topCount == 0 );
+        REQUIRE( store.estimate("cfg/counter") == 0 );
+    }
+}
+
+TEST_CASE( "WearKVStore accounts the bytes written per namespace", "[wear][namespace]" ) {
+    MockKVStore mock;
+    WearKVStore store(mock);
+
+    store.putUInt("net/ip", 1);
+    store.putUInt("net/mask", 2);
+    store.putString("app/name", "pippo");
+    store.putUInt("boot", 3);
+    store.remove("boot");
+
+    WearStats stats = store.wearStats();
+
+    REQUIRE( stats.removes == 1 );
+    REQUIRE( stats.namespaceCount == 3 );
+    REQUIRE( strcmp(stats.namespaces[0].name, "net") == 0 );
+    REQUIRE( stats.namespaces[0].writes == 2 );
+    REQUIRE( stats.namespaces[0].bytes == 8 );
+    REQUIRE( strcmp(stats.namespaces[1].name, "app") == 0 );
+    REQUIRE( stats.namespaces[1].bytes == 5 );
+    REQUIRE( strcmp(stats.namespaces[2].name, "") == 0 );
+
+    SECTION( "namespaces that do not fit the table are counted together" ) {
+        char key[16];
+
+        for(size_t i=0; i<WEAR_NAMESPACES; i++) {
+            snprintf(key, sizeof(key), "ns%zu/v", i);
+            store.putUInt(key, i);
+        }
+
+        stats = store.wearStats();
+        REQUIRE( stats.namespaceCount == WEAR_NAMESPACES );
+        REQUIRE( stats.otherBytes == 3 * 4 );
+    }
+
+    SECTION( "the mock does not expose physical counters" ) {
+        REQUIRE( !stats.physicalAvailable );
+        REQUIRE( stats.writeAmplification() == 0 );
+    }
+}
+
+TEST_CASE( "WearKVStore reports the physical wear of TDBKVStore", "[wear][physical]" ) {
+    RamBlockDevice bd(16 * 1024, 16, 4096);
+    TDBKVStore tdb(bd);
+    REQUIRE( tdb.begin() );
+
+    WearKVStore store(tdb);
+    bd.resetStats();
+
+    // every rewrite appends a record, the areas are garbage collected when they fill up
+    for(uint32_t i=0; i<2000; i++) {
+        REQUIRE( store.putUInt("counter", i) == 4 );
+    }
+
+    WearStats stats = store.wearStats();
+    const RamBlockDevice::stats_t& device = bd.getStats();
+
+    REQUIRE( stats.physicalAvailable );
+    REQUIRE( stats.physical.gcCount > 0 );
+    REQUIRE( stats.physical.programBytes == device.bytesProgrammed );
+    REQUIRE( stats.physical.eraseCount == device.bytesErased / 4096 );
+
+    // every 4 bytes value costs at least a 16 bytes header and the key
+    REQUIRE( stats.writeAmplification() > 4 );
+    REQUIRE( strcmp(stats.topKeys[0].name, "counter") == 0 );
+}
@@ -0,0 +1,256 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#if defined(__linux__)
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/implementation/file.h>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+static std::string tempPath() {
+    char path[] = "/tmp/kvstore_test_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    unlink(path);
+
+    return path;
+}
+
+TEST_CASE( "FileKVStore keeps the values when it is opened again", "[file][persistence]" ) {
+    std::string path = tempPath();
+
+    {
+        FileKVStore store(path.c_str());
+        REQUIRE( store.begin() );
+
+        REQUIRE( store.putUInt("0", 0x55555555) == 4 );
+        REQUIRE( store.putString("1", "pippo") == 5 );
+        REQUIRE( store.putUInt("2", 1) == 4 );
+        REQUIRE( store.putUInt("2", 2) == 4 );
+        REQUIRE( store.remove("0") == 1 );
+        REQUIRE( store.remove("0") == 0 );
+
+        REQUIRE( store.deadSize() > 0 );
+        REQUIRE( store.end() );
+    }
+
+    FileKVStore store(path.c_str());
+    REQUIRE( store.begin() );
+
+    REQUIRE_FALSE( store.exists("0") );
+    REQUIRE( store.getUInt("2") == 2 );
+
+    char res[6];
+    REQUIRE( store.getString("1", res, sizeof(res)) == 5 );
+    REQUIRE( strcmp(res, "pippo") == 0 );
+
+    KVStoreInterface::View view = store.getView("1");
+    REQUIRE( view.len == 5 );
+    REQUIRE( memcmp(view.data, "pippo", 5) == 0 );
+
+    uint16_t s;
+    REQUIRE( store.tryGet("2", s) == KVStoreInterface::ST_TYPE_MISMATCH );
+    REQUIRE( store.tryGet("3", s) == KVStoreInterface::ST_NOT_FOUND );
+
+    SECTION( "a record that was not completely written is dropped" ) {
+        size_t size = store.fileSize();
+        REQUIRE( store.putUInt("3", 3) == 4 );
+        REQUIRE( store.end() );
+
+        REQUIRE( truncate(path.c_str(), size + 5) == 0 );
+
+        REQUIRE( store.begin() );
+        REQUIRE_FALSE( store.exists("3") );
+        REQUIRE( store.fileSize() == size );
+        REQUIRE( store.getUInt("2") == 2 );
+
+        // the log can be appended after the dropped record
+        REQUIRE( store.putUInt("3", 4) == 4 );
+        REQUIRE( store.end() );
+        REQUIRE( store.begin() );
+        REQUIRE( store.getUInt("3") == 4 );
+    }
+
+    SECTION( "clear removes all the keys from the log" ) {
+        REQUIRE( store.clear() );
+        REQUIRE( store.end() );
+        REQUIRE( store.begin() );
+        REQUIRE_FALSE( store.exists("1") );
+    }
+
+    store.end();
+    unlink(path.c_str());
+}
+
+TEST_CASE( "FileKVStore compaction drops overwritten and removed records", "[file][compaction]" ) {
+    std::string path = tempPath();
+    FileKVStore store(path.c_str(), DEFAULT_COMPACTION_RATIO, false);
+    REQUIRE( store.begin() );
+
+    uint8_t value[256];
+    char key[16];
+
+    for(int round=0; round<10; round++) {
+        for(int i=0; i<100; i++) {
+            memset(value, round, sizeof(value));
+            snprintf(key, sizeof(key), "key%d", i);
+            REQUIRE( store.putBytes(key, value, sizeof(value)) == sizeof(value) );
+        }
+    }
+
+    SECTION( "compaction runs in the background and replaces the log" ) {
+        // the log is replaced by the first modification after the end of the compaction
+        size_t size = store.fileSize();
+        bool shrunk = false;
+
+        for(int i=0; i<10000 && !shrunk; i++) {
+            memset(value, 9, sizeof(value));
+            snprintf(key, sizeof(key), "key%d", i % 100);
+            REQUIRE( store.putBytes(key, value, sizeof(value)) == sizeof(value) );
+
+            shrunk = store.fileSize() < size;
+            size = store.fileSize();
+        }
+
+        REQUIRE( shrunk );
+    }
+
+    SECTION( "values can be put from a view while a compaction is pending" ) {
+        // the log is replaced while the value is read from it
+        size_t size = store.fileSize();
+        bool shrunk = false;
+
+        for(int i=0; i<10000 && !shrunk; i++) {
+            snprintf(key, sizeof(key), "key%d", i % 100);
+            KVStoreInterface::View view = store.getView(key);
+
+            REQUIRE( view.len == sizeof(value) );
+            REQUIRE( store.putBytes(key, view.data, view.len) == sizeof(value) );
+            REQUIRE( store.getView(key).data[0] == 9 );
+
+            shrunk = store.fileSize() < size;
+            size = store.fileSize();
+        }
+
+        REQUIRE( shrunk );
+    }
+
+    SECTION( "compact copies only the live records" ) {
+        KVStoreInterface::PhysicalWear before, after;
+        REQUIRE( store.physicalWear(before) );
+
+        REQUIRE( store.compact() );
+        REQUIRE( store.physicalWear(after) );
+        // a compaction running in the background is completed before a new one is forced
+        REQUIRE( after.gcCount > before.gcCount );
+        REQUIRE( after.programBytes >= before.programBytes + store.fileSize() );
+
+        REQUIRE( store.deadSize() == 0 );
+        REQUIRE( store.fileSize() < 100 * (sizeof(value) + 32) );
+        REQUIRE( store.remove("key0") == 1 );
+    }
+
+    for(int i=1; i<100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        REQUIRE( store.getBytes(key, value, sizeof(value)) == sizeof(value) );
+        REQUIRE( value[0] == 9 );
+    }
+
+    REQUIRE( store.end() );
+    REQUIRE( store.begin() );
+
+    snprintf(key, sizeof(key), "key%d", 99);
+    REQUIRE( store.getView(key).data[255] == 9 );
+
+    store.end();
+    unlink(path.c_str());
+}
+
+TEST_CASE( "FileKVStore transactions are written only when committed", "[file][transaction]" ) {
+    std::string path = tempPath();
+    FileKVStore store(path.c_str());
+    REQUIRE( store.begin() );
+
+    REQUIRE( store.putUInt("0", 0) == 4 );
+    REQUIRE( store.beginTransaction() );
+    REQUIRE( store.putUInt("0", 1) == 4 );
+    REQUIRE( store.putUInt("1", 1) == 4 );
+    REQUIRE( store.getUInt("0") == 1 );
+
+    SECTION( "committed modifications are kept" ) {
+        REQUIRE( store.commit() );
+        REQUIRE( store.end() );
+        REQUIRE( store.begin() );
+        REQUIRE( store.getUInt("0") == 1 );
+        REQUIRE( store.getUInt("1") == 1 );
+    }
+
+    SECTION( "committed values keep their type" ) {
+        REQUIRE( store.putString("2", "pippo") == 5 );
+        REQUIRE( store.getInt("1", -1) == -1 );
+        REQUIRE( store.commit() );
+
+        std::string types;
+        REQUIRE( store.forEach([&](const KVStoreInterface::KeyInfo& info) {
+            types += std::string(info.key) + ":" + std::to_string(info.type) + " ";
+            return true;
+        }) == 3 );
+        REQUIRE( types.find("1:5 ") != std::string::npos );
+        REQUIRE( types.find("2:8 ") != std::string::npos );
+        REQUIRE( store.getInt("1", -1) == -1 );
+    }
+
+    SECTION( "modifications rolled back are dropped" ) {
+        REQUIRE( store.rollback() );
+        REQUIRE( store.getUInt("0") == 0 );
+        REQUIRE_FALSE( store.exists("1") );
+    }
+
+    store.end();
+    unlink(path.c_str());
+}
+
+// store whose writes of a key fail once the transaction is being committed
+class FailingFileKVStore: public FileKVStore {
+public:
+    FailingFileKVStore(const char* path): FileKVStore(path) {}
+
+    bool failing = false;
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override {
+        return failing && strcmp(key, "1") == 0 ? -1 : FileKVStore::_put(key, value, len, t);
+    }
+};
+
+TEST_CASE( "FileKVStore commit reports a failed write", "[file][transaction][failure]" ) {
+    std::string path = tempPath();
+    FailingFileKVStore store(path.c_str());
+    uint8_t v[] = { 0x55, 0x55 };
+    REQUIRE( store.begin() );
+
+    REQUIRE( store.beginTransaction() );
+    REQUIRE( store.putBytes("0", v, sizeof(v)) == sizeof(v) );
+    REQUIRE( store.putBytes("1", v, sizeof(v)) == sizeof(v) );
+    REQUIRE( store.remove("missing") == 1 );
+
+    store.failing = true;
+    REQUIRE_FALSE( store.commit() );
+
+    // the operations preceding the failed one stay applied
+    REQUIRE( store.exists("0") );
+    REQUIRE_FALSE( store.exists("1") );
+
+    store.end();
+    unlink(path.c_str());
+}
+
+#endif // defined(__linux__)
@@ -0,0 +1,220 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/implementation/ram.h>
+#include <cstdio>
+#include <string>
+
+TEST_CASE( "RamKVStore can store values of different types, get them and remove them", "[ram][putgetremove]" ) {
+    RamKVStore store;
+    REQUIRE( store.begin() );
+
+    REQUIRE( store.putUInt("0", 0x55555555) == 4 );
+    REQUIRE( store.putString("1", "pippo") == 5 );
+    REQUIRE( store.putDouble("2", 1.5) == sizeof(double) );
+    REQUIRE( store.size() == 3 );
+
+    REQUIRE( store.getUInt("0") == 0x55555555 );
+    REQUIRE( store.getDouble("2") == 1.5 );
+
+    char res[6];
+    REQUIRE( store.getString("1", res, sizeof(res)) == 5 );
+    REQUIRE( strcmp(res, "pippo") == 0 );
+
+    SECTION( "missing keys are reported without exceptions" ) {
+        uint8_t buf[4];
+
+        REQUIRE_FALSE( store.exists("3") );
+        REQUIRE( store.getBytes("3", buf, sizeof(buf)) == 0 );
+        REQUIRE( store.getBytesLength("3") == 0 );
+        REQUIRE( store.getView("3").data == nullptr );
+        REQUIRE( store.remove("3") == 0 );
+        REQUIRE( store.getUInt("3", 0x56) == 0x56 );
+    }
+
+    SECTION( "values are overwritten with values of any size" ) {
+        uint8_t big[300];
+        memset(big, 0x55, sizeof(big));
+
+        REQUIRE( store.putBytes("0", big, sizeof(big)) == sizeof(big) );
+        REQUIRE( store.getBytesLength("0") == sizeof(big) );
+        REQUIRE( store.getView("0").data[299] == 0x55 );
+
+        REQUIRE( store.putUChar("0", 0x56) == 1 );
+        REQUIRE( store.getUChar("0") == 0x56 );
+        REQUIRE( store.size() == 3 );
+
+        // values bigger than a quarter of a chunk are freed by clear
+        REQUIRE( store.putBytes("4", big, sizeof(big)) == sizeof(big) );
+        uint8_t huge[5000] = {};
+        REQUIRE( store.putBytes("5", huge, sizeof(huge)) == sizeof(huge) );
+        REQUIRE( store.clear() );
+    }
+
+    SECTION( "a value can be replaced with a part of its view" ) {
+        uint8_t value[40];
+        for(size_t i=0; i<sizeof(value); i++) {
+            value[i] = i;
+        }
+        REQUIRE( store.putBytes("a", value, sizeof(value)) == sizeof(value) );
+
+        KVStoreInterface::View view = store.getView("a");
+        REQUIRE( store.putBytes("a", view.data + 4, 10) == 10 );
+
+        view = store.getView("a");
+        REQUIRE( view.len == 10 );
+        REQUIRE( memcmp(view.data, value + 4, 10) == 0 );
+    }
+
+    SECTION( "tryGet tells apart a missing key and a different type" ) {
+        uint32_t u = 0;
+        float f = 0;
+        uint16_t s = 0;
+
+        REQUIRE( store.tryGet("0", u) == KVStoreInterface::ST_FOUND );
+        REQUIRE( store.tryGet("0", f) == KVStoreInterface::ST_TYPE_MISMATCH );
+        REQUIRE( store.tryGet("0", s) == KVStoreInterface::ST_TYPE_MISMATCH );
+        REQUIRE( store.tryGet("3", u) == KVStoreInterface::ST_NOT_FOUND );
+    }
+
+    SECTION( "values can be read without copies" ) {
+        KVStoreInterface::View view = store.getView("1");
+
+        REQUIRE( view.len == 5 );
+        REQUIRE( memcmp(view.data, "pippo", 5) == 0 );
+    }
+
+    SECTION( "removed keys are not found anymore" ) {
+        REQUIRE( store.remove("1") == 1 );
+        REQUIRE_FALSE( store.exists("1") );
+        REQUIRE( store.size() == 2 );
+    }
+
+    SECTION( "clear and end drop all the keys" ) {
+        REQUIRE( store.clear() );
+        REQUIRE( store.size() == 0 );
+        REQUIRE_FALSE( store.exists("0") );
+
+        REQUIRE( store.putUInt("0", 1) == 4 );
+        REQUIRE( store.end() );
+        REQUIRE_FALSE( store.exists("0") );
+        REQUIRE( store.memoryUsage() == 0 );
+    }
+}
+
+TEST_CASE( "RamKVStore index holds many keys", "[ram][index]" ) {
+    RamKVStore store;
+    store.begin();
+
+    const uint32_t n = 5000;
+    char key[16];
+
+    for(uint32_t i=0; i<n; i++) {
+        snprintf(key, sizeof(key), "key%u", (unsigned)i);
+        REQUIRE( store.putUInt(key, i) == 4 );
+    }
+    REQUIRE( store.size() == n );
+
+    for(uint32_t i=0; i<n; i++) {
+        snprintf(key, sizeof(key), "key%u", (unsigned)i);
+        REQUIRE( store.getUInt(key, n) == i );
+    }
+
+    SECTION( "removed keys leave room for new ones without growing the memory" ) {
+        for(uint32_t i=0; i<n; i+=2) {
+            snprintf(key, sizeof(key), "key%u", (unsigned)i);
+            REQUIRE( store.remove(key) == 1 );
+        }
+        REQUIRE( store.size() == n / 2 );
+
+        size_t memory = store.memoryUsage();
+
+        for(int round=0; round<4; round++) {
+            for(uint32_t i=0; i<n; i+=2) {
+                snprintf(key, sizeof(key), "new%u", (unsigned)i);
+                REQUIRE( store.putUInt(key, i) == 4 );
+            }
+            for(uint32_t i=0; i<n; i+=2) {
+                snprintf(key, sizeof(key), "new%u", (unsigned)i);
+                REQUIRE( store.remove(key) == 1 );
+            }
+        }
+
+        REQUIRE( store.memoryUsage() <= memory );
+
+        for(uint32_t i=1; i<n; i+=2) {
+            snprintf(key, sizeof(key), "key%u", (unsigned)i);
+            REQUIRE( store.getUInt(key, n) == i );
+        }
+    }
+
+    SECTION( "a reserved index is not rebuilt" ) {
+        RamKVStore reserved;
+        REQUIRE( reserved.reserve(n) );
+
+        size_t memory = reserved.memoryUsage();
+        REQUIRE( reserved.putUInt("0", 0) == 4 );
+        REQUIRE( reserved.memoryUsage() - memory <= DEFAULT_ARENA_CHUNK_SIZE + 16 );
+    }
+}
+
+TEST_CASE( "RamKVStore keys can be iterated and removed by prefix", "[ram][prefix]" ) {
+    RamKVStore store;
+    store.begin();
+
+    REQUIRE( store.putUInt("wifi/ssid", 1) == 4 );
+    REQUIRE( store.putString("wifi/pass", "pippo") == 5 );
+    REQUIRE( store.putUInt("mqtt/port", 1883) == 4 );
+
+    size_t total = 0;
+    REQUIRE( store.forEach([&](const KVStoreInterface::KeyInfo& info) {
+        total += info.size;
+        return true;
+    }, true) == 3 );
+    REQUIRE( total == 13 );
+
+    std::string keys;
+    REQUIRE( store.scanPrefix("wifi/", [&](const KVStoreInterface::KeyInfo& info) {
+        keys += info.key;
+        return info.type == KVStoreInterface::PT_STR || info.type == KVStoreInterface::PT_U32;
+    }) == 2 );
+    REQUIRE( keys.find("wifi/ssid") != std::string::npos );
+    REQUIRE( keys.find("wifi/pass") != std::string::npos );
+
+    REQUIRE( store.removePrefix("wifi/") == 2 );
+    REQUIRE( store.size() == 1 );
+    REQUIRE( store.exists("mqtt/port") );
+}
+
+TEST_CASE( "RamKVStore skips the puts of unchanged values when asked", "[ram][ifchanged]" ) {
+    RamKVStore store;
+    REQUIRE( store.begin() );
+    store.setPutIfChanged(true);
+
+    REQUIRE( store.putBytes("0", (const uint8_t*)"pippo", 5) == 5 );
+    const uint8_t* data = store.getView("0").data;
+
+    // a skipped put leaves the value where it is, a write would move it to a new block
+    REQUIRE( store.putBytes("0", (const uint8_t*)"pippo", 5) == 5 );
+    REQUIRE( store.getView("0").data == data );
+
+    SECTION( "a value with the same bytes and a different type is written" ) {
+        REQUIRE( store.putUInt("1", 1) == 4 );
+        REQUIRE( store.putInt("1", 1) == 4 );
+        REQUIRE( store.getInt("1", 0) == 1 );
+
+        int32_t value;
+        REQUIRE( store.tryGet("1", value) == KVStoreInterface::ST_FOUND );
+    }
+
+    REQUIRE( store.end() );
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/implementation/tdb.h>
+#include <cstdio>
+
+TEST_CASE( "TDBKVStore keeps the values on the block device", "[tdb][persistence]" ) {
+    RamBlockDevice bd(64 * 1024, 16);
+    TDBKVStore store(bd);
+    REQUIRE( store.begin() );
+
+    REQUIRE( store.putUInt("0", 0x55555555) == 4 );
+    REQUIRE( store.putString("1", "pippo") == 5 );
+    REQUIRE( store.putUInt("2", 1) == 4 );
+    REQUIRE( store.putUInt("2", 2) == 4 );
+    REQUIRE( store.remove("0") == 1 );
+    REQUIRE( store.remove("0") == 0 );
+
+    // records are padded to the program size of the device
+    REQUIRE( bd.getStats().bytesProgrammed % 16 == 0 );
+    REQUIRE( store.getStats().recordBytes > store.getStats().userBytes );
+
+    REQUIRE( store.end() );
+    REQUIRE( store.begin() );
+    REQUIRE( store.getStats().scanRecords == 5 );
+
+    REQUIRE_FALSE( store.exists("0") );
+    REQUIRE( store.getUInt("2") == 2 );
+
+    char res[6];
+    REQUIRE( store.getString("1", res, sizeof(res)) == 5 );
+    REQUIRE( strcmp(res, "pippo") == 0 );
+
+    SECTION( "tryGet tells apart a missing key and a different type" ) {
+        uint16_t s;
+        float f;
+
+        REQUIRE( store.tryGet("2", s) == KVStoreInterface::ST_TYPE_MISMATCH );
+        REQUIRE( store.tryGet("2", f) == KVStoreInterface::ST_TYPE_MISMATCH );
+        REQUIRE( store.tryGet("3", s) == KVStoreInterface::ST_NOT_FOUND );
+    }
+
+    SECTION( "keys can be iterated and removed by prefix" ) {
+        REQUIRE( store.putUInt("10", 10) == 4 );
+
+        size_t total = 0;
+        REQUIRE( store.forEach([&](const KVStoreInterface::KeyInfo& info) {
+            total += info.size;
+            return true;
+        }, true) == 3 );
+        REQUIRE( total == 13 );
+
+        REQUIRE( store.removePrefix("1") == 2 );
+        REQUIRE( store.exists("2") );
+        REQUIRE_FALSE( store.exists("10") );
+    }
+
+    SECTION( "clear removes the records from both areas" ) {
+        REQUIRE( store.clear() );
+        REQUIRE_FALSE( store.exists("2") );
+
+        REQUIRE( store.end() );
+        REQUIRE( store.begin() );
+        REQUIRE_FALSE( store.exists("2") );
+        REQUIRE( store.putUInt("2", 3) == 4 );
+    }
+
+    store.end();
+}
+
+TEST_CASE( "TDBKVStore garbage collection moves the live records to the other area", "[tdb][gc]" ) {
+    RamBlockDevice bd(16 * 1024, 1, 4096);
+    TDBKVStore store(bd);
+    REQUIRE( store.begin() );
+
+    char key[16];
+    for(uint32_t i=0; i<20; i++) {
+        snprintf(key, sizeof(key), "key%u", (unsigned)i);
+        REQUIRE( store.putUInt(key, i) == 4 );
+    }
+
+    for(uint32_t i=0; i<2000; i++) {
+        REQUIRE( store.putUInt("counter", i) == 4 );
+    }
+
+    REQUIRE( store.getStats().gcCount > 0 );
+    REQUIRE( store.getUInt("counter") == 1999 );
+
+    // the areas are erased in turn
+    REQUIRE( bd.getMaxEraseCount() - bd.getEraseCount(0) <= 1 );
+    REQUIRE( bd.getMaxEraseCount() - bd.getEraseCount(3) <= 1 );
+
+    SECTION( "the live records survive a new begin" ) {
+        REQUIRE( store.end() );
+        REQUIRE( store.begin() );
+
+        REQUIRE( store.getUInt("counter") == 1999 );
+        for(uint32_t i=0; i<20; i++) {
+            snprintf(key, sizeof(key), "key%u", (unsigned)i);
+            REQUIRE( store.getUInt(key, 100) == i );
+        }
+    }
+
+    SECTION( "a value bigger than an area is rejected" ) {
+        uint8_t big[8192] = {};
+        REQUIRE( store.putBytes("big", big, sizeof(big)) < 0 );
+        REQUIRE_FALSE( store.exists("big") );
+    }
+
+    store.end();
+}
+
+TEST_CASE( "TDBKVStore drops a record that was not completely written", "[tdb][recovery]" ) {
+    RamBlockDevice bd(16 * 1024, 1, 4096);
+    TDBKVStore store(bd);
+    REQUIRE( store.begin() );
+
+    REQUIRE( store.putUInt("0", 1) == 4 );
+    REQUIRE( store.putUInt("1", 2) == 4 );
+
+    // the beginning of a record, with a valid magic but without the rest of it
+    size_t offset = 8192 - store.getFreeSpace();
+    uint8_t partial[] = { 0x52, 0x42, 0x44, 0x54, 0x01, 0x00, 0x00, 0x00, 0x04 };
+    REQUIRE( bd.program(partial, offset, sizeof(partial)) == BD_ERROR_OK );
+
+    REQUIRE( store.end() );
+    REQUIRE( store.begin() );
+
+    // the area after the partial record cannot be programmed, thus the records are moved
+    REQUIRE( store.getStats().gcCount == 1 );
+    REQUIRE( store.getUInt("0") == 1 );
+    REQUIRE( store.getUInt("1") == 2 );
+    REQUIRE( store.putUInt("2", 3) == 4 );
+
+    REQUIRE( store.end() );
+    REQUIRE( store.begin() );
+    REQUIRE( store.getUInt("2") == 3 );
+
+    store.end();
+}
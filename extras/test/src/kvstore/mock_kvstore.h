@@ -0,0 +1,101 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <kvstore/kvstore.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+
+/*
+ * Host KVStore that keeps values in a std::map and counts the accesses it receives,
+ * it is used to check how decorators and utilities access the underlying store
+ */
+class MockKVStore: public KVStoreInterface {
+public:
+    bool begin() override { return true; }
+    bool end() override   { return true; }
+    bool clear() override { kvmap.clear(); return true; }
+
+    res_t remove(const key_t& key) override {
+        removes++;
+        return kvmap.erase(key.c_str()) == 1 ? 1 : 0;
+    }
+
+    bool exists(const key_t& key) const override {
+        reads++;
+        return kvmap.find(key.c_str()) != kvmap.end();
+    }
+
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override {
+        writes++;
+        kvmap[key.c_str()] = std::vector<uint8_t>(b, b+s);
+        return s;
+    }
+
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override {
+        reads++;
+        auto it = kvmap.find(key.c_str());
+        if(it == kvmap.end()) {
+            return 0;
+        }
+
+        std::memcpy(b, it->second.data(), s <= it->second.size() ? s : it->second.size());
+        return it->second.size();
+    }
+
+    size_t getBytesLength(const key_t& key) const override {
+        reads++;
+        auto it = kvmap.find(key.c_str());
+        return it != kvmap.end() ? it->second.size() : 0;
+    }
+
+    View getView(const key_t& key) const override {
+        auto it = kvmap.find(key.c_str());
+        if(!views || it == kvmap.end()) {
+            return { nullptr, 0 };
+        }
+
+        reads++;
+        return { it->second.data(), it->second.size() };
+    }
+
+    size_t putMany(Entry entries[], size_t count) override {
+        batches++;
+        return KVStoreInterface::putMany(entries, count);
+    }
+
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override {
+        res_t count = 0;
+
+        for(auto& el: kvmap) {
+            count++;
+
+            if(!callback({ el.first.c_str(), PT_BLOB, sizes ? el.second.size() : 0 }, arg)) {
+                break;
+            }
+        }
+
+        return count;
+    }
+
+    void resetCounters() { reads = 0; writes = 0; removes = 0; batches = 0; }
+
+    // when false the mock behaves like a store that does not keep its values in RAM
+    bool views = true;
+
+    mutable size_t reads = 0;
+    size_t writes = 0;
+    size_t removes = 0;
+    size_t batches = 0;
+
+    std::map<std::string, std::vector<uint8_t>> kvmap;
+};
@@ -10,10 +10,14 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_template_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 
 #include <kvstore/kvstore.h>
+#include <array>
 #include <map>
+#include <string>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <stdexcept>
 
@@ -28,20 +32,27 @@ public:
     typename KVStoreInterface::res_t putBytes(const Key& key, const uint8_t b[], size_t s) override;
     typename KVStoreInterface::res_t getBytes(const Key& key, uint8_t b[], size_t s) const override;
     size_t getBytesLength(const Key& key) const override;
+    View getView(const Key& key) const override;
+
+protected:
+    typename KVStoreInterface::res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
 
 private:
-    std::map<Key, std::pair<uint8_t*, size_t>> kvmap;
+    std::map<std::string, std::pair<uint8_t*, size_t>> kvmap;
 };
 
 bool KVStore::clear() {
+    for(auto& el: kvmap) {
+        delete [] el.second.first;
+    }
     kvmap.clear();
 
     return true;
 }
 
 typename KVStoreInterface::res_t KVStore::remove(const Key& key) {
-    auto el = kvmap.at(key);
-    kvmap.erase(key);
+    auto el = kvmap.at(key.c_str());
+    kvmap.erase(key.c_str());
 
     delete [] el.first;
 
@@ -50,7 +61,7 @@ typename KVStoreInterface::res_t KVStore::remove(const Key& key) {
 
 bool KVStore::exists(const Key& key) const {
     try {
-        kvmap.at(key);
+        kvmap.at(key.c_str());
         return true;
     } catch(const std::out_of_range&) {
         return false;
@@ -66,13 +77,13 @@ typename KVStoreInterface::res_t KVStore::putBytes(const Key& key, const uint8_t
     std::memset(buf, 0, s);
     std::memcpy(buf, b, s);
 
-    kvmap[key] = {buf, s};
+    kvmap[key.c_str()] = {buf, s};
 
     return s;
 }
 
 typename KVStoreInterface::res_t KVStore::getBytes(const Key& key, uint8_t b[], size_t s) const {
-    auto el = kvmap.at(key);
+    auto el = kvmap.at(key.c_str());
 
     std::memcpy(b, el.first, s <= el.second? s : el.second);
 
@@ -80,9 +91,33 @@ typename KVStoreInterface::res_t KVStore::getBytes(const Key& key, uint8_t b[],
 }
 
 size_t KVStore::getBytesLength(const Key& key) const {
-    auto el = kvmap.at(key);
+    auto el = kvmap.find(key.c_str());
 
-    return el.second;
+    return el != kvmap.end() ? el->second.second : 0;
+}
+
+typename KVStoreInterface::View KVStore::getView(const Key& key) const {
+    auto el = kvmap.find(key.c_str());
+
+    if(el == kvmap.end()) {
+        return { nullptr, 0 };
+    }
+
+    return { el->second.first, el->second.second };
+}
+
+typename KVStoreInterface::res_t KVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    typename KVStoreInterface::res_t count = 0;
+
+    for(auto& el: kvmap) {
+        count++;
+
+        if(!callback({ el.first.c_str(), PT_BLOB, sizes ? el.second.second : 0 }, arg)) {
+            break;
+        }
+    }
+
+    return count;
 }
 
 TEST_CASE( "KVStore can store values of different types, get them and remove them", "[kvstore][putgetremove]" ) {
@@ -197,3 +232,541 @@ TEST_CASE( "KVStore references are a useful tool to indirectly access kvstore",
     REQUIRE( store.remove("2") == 1 );
     REQUIRE( store.remove("3") == 1 );
 }
+
+TEST_CASE( "KVStore deferred references write back their value only once", "[kvstore][references][deferred]" ) {
+    KVStore store;
+    store.begin();
+
+    REQUIRE( store.put("0", (uint32_t) 0x55) == 4);
+
+    SECTION( "assignments are written back when the last reference is destroyed" ) {
+        {
+            auto ref = store.getDeferred<uint32_t>("0");
+            REQUIRE( ref == 0x55 );
+
+            for(int i=0; i<10; i++) {
+                ref = ref + 1;
+            }
+
+            REQUIRE( ref.isDirty() );
+            REQUIRE( store.getUInt("0") == 0x55 );
+        }
+
+        REQUIRE( store.getUInt("0") == 0x5F );
+    }
+
+    SECTION( "references to the same key share their value" ) {
+        auto ref1 = store.getDeferred<uint32_t>("0");
+
+        {
+            auto ref2 = store.operator[]<uint32_t>("0");
+            ref2 = 0x56;
+
+            REQUIRE( ref1 == 0x56 );
+        }
+
+        // the value is still referenced, thus it is not written back yet
+        REQUIRE( store.getUInt("0") == 0x55 );
+
+        REQUIRE( store.flush() );
+        REQUIRE_FALSE( ref1.isDirty() );
+        REQUIRE( store.getUInt("0") == 0x56 );
+    }
+
+    SECTION( "missing keys get the default value and are stored only if assigned" ) {
+        {
+            auto ref = store.getDeferred<uint16_t>("1", 0x5555);
+            REQUIRE( ref == 0x5555 );
+            REQUIRE_FALSE( ref.exists() );
+        }
+        REQUIRE_FALSE( store.exists("1") );
+
+        {
+            auto ref = store.getDeferred<uint16_t>("1", 0x5555);
+            ref = 0x5656;
+        }
+        REQUIRE( store.getUShort("1") == 0x5656 );
+        REQUIRE( store.remove("1") == 1 );
+    }
+
+    SECTION( "loading a reference discards its modifications" ) {
+        auto ref = store.getDeferred<uint32_t>("0");
+        ref = 0x56;
+        ref.load();
+
+        REQUIRE( ref == 0x55 );
+        REQUIRE_FALSE( ref.isDirty() );
+    }
+
+    REQUIRE( store.remove("0") == 1 );
+}
+
+TEST_CASE( "KVStore batch operations put and get multiple entries in a single call", "[kvstore][batch]" ) {
+    KVStore store;
+    store.begin();
+
+    uint8_t  v0 = 0x55;
+    uint16_t v1 = 0x5555;
+    uint32_t v2 = 0x55555555;
+
+    KVStoreInterface::Entry puts[] = {
+        { "0", (uint8_t*)&v0, sizeof(v0), KVStoreInterface::PT_U8,  0 },
+        { "1", (uint8_t*)&v1, sizeof(v1), KVStoreInterface::PT_U16, 0 },
+        { "2", (uint8_t*)&v2, sizeof(v2), KVStoreInterface::PT_U32, 0 },
+    };
+
+    REQUIRE( store.putMany(puts, 3) == 3 );
+    REQUIRE( puts[0].res == sizeof(v0) );
+    REQUIRE( puts[1].res == sizeof(v1) );
+    REQUIRE( puts[2].res == sizeof(v2) );
+
+    SECTION( "values inserted in a batch can be retrieved one by one" ) {
+        REQUIRE( store.getUChar("0") == v0 );
+        REQUIRE( store.getUShort("1") == v1 );
+        REQUIRE( store.getUInt("2") == v2 );
+    }
+
+    SECTION( "values inserted in a batch can be retrieved in a batch" ) {
+        uint8_t  r0 = 0;
+        uint16_t r1 = 0;
+        uint32_t r2 = 0;
+        uint32_t r3 = 0;
+
+        KVStoreInterface::Entry gets[] = {
+            { "0", (uint8_t*)&r0, sizeof(r0), KVStoreInterface::PT_U8,  0 },
+            { "1", (uint8_t*)&r1, sizeof(r1), KVStoreInterface::PT_U16, 0 },
+            { "2", (uint8_t*)&r2, sizeof(r2), KVStoreInterface::PT_U32, 0 },
+            { "3", (uint8_t*)&r3, sizeof(r3), KVStoreInterface::PT_U32, 0 },
+        };
+
+        REQUIRE( store.getMany(gets, 4) == 3 );
+        REQUIRE( r0 == v0 );
+        REQUIRE( r1 == v1 );
+        REQUIRE( r2 == v2 );
+        REQUIRE( gets[3].res == 0 );
+    }
+
+    REQUIRE( store.remove("0") == 1 );
+    REQUIRE( store.remove("1") == 1 );
+    REQUIRE( store.remove("2") == 1 );
+}
+
+TEST_CASE( "KVStore tryGet tells apart the reasons of a failed read", "[kvstore][tryget]" ) {
+    KVStore store;
+    store.begin();
+
+    REQUIRE( store.put("0", (uint32_t) 0x55555555) == 4 );
+
+    SECTION( "an existing value is found" ) {
+        uint32_t value = 0;
+
+        REQUIRE( store.tryGet("0", value) == KVStoreInterface::ST_FOUND );
+        REQUIRE( value == 0x55555555 );
+    }
+
+    SECTION( "a missing key is reported and the value is left untouched" ) {
+        uint32_t value = 0x56;
+
+        REQUIRE( store.tryGet("1", value) == KVStoreInterface::ST_NOT_FOUND );
+        REQUIRE( value == 0x56 );
+    }
+
+    SECTION( "a value with a different size is a type mismatch" ) {
+        uint16_t value = 0x56;
+
+        REQUIRE( store.tryGet("0", value) == KVStoreInterface::ST_TYPE_MISMATCH );
+        REQUIRE( value == 0x56 );
+    }
+
+    SECTION( "typed getters return the default value when the read fails" ) {
+        REQUIRE( store.getUInt("1", 0x56) == 0x56 );
+        REQUIRE( store.getUShort("0", 0x56) == 0x56 );
+    }
+
+    REQUIRE( store.remove("0") == 1 );
+}
+
+TEST_CASE( "KVStore structs and arrays are stored as a single blob", "[kvstore][composite]" ) {
+    KVStore store;
+    store.begin();
+
+    struct calibration_t {
+        float matrix[3][3];
+        int16_t offset;
+        uint8_t channel;
+    };
+
+    SECTION( "a matrix is written with a single key and read back" ) {
+        float matrix[3][3] = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+        float res[3][3] = {};
+
+        REQUIRE( store.put("m", matrix) == sizeof(matrix) );
+        REQUIRE( store.getBytesLength("m") > sizeof(matrix) ); // value and its descriptor
+
+        REQUIRE( store.tryGet("m", res) == KVStoreInterface::ST_FOUND );
+        REQUIRE( memcmp(res, matrix, sizeof(matrix)) == 0 );
+    }
+
+    SECTION( "a struct is written with a single key and read back" ) {
+        calibration_t cal = { { { 1.5f, 0, 0 }, { 0, 1.5f, 0 }, { 0, 0, 1.5f } }, -12, 3 };
+        calibration_t res = {};
+
+        REQUIRE( store.put("cal", cal) == sizeof(cal) );
+        REQUIRE( store.tryGet("cal", res) == KVStoreInterface::ST_FOUND );
+        REQUIRE( res.matrix[1][1] == 1.5f );
+        REQUIRE( res.offset == -12 );
+        REQUIRE( res.channel == 3 );
+
+        REQUIRE( store.get("cal", calibration_t{}).getValue().offset == -12 );
+    }
+
+    SECTION( "std::array is stored like the corresponding C array" ) {
+        std::array<uint16_t, 4> values = {{ 1, 2, 3, 4 }};
+        uint16_t res[4] = {};
+
+        REQUIRE( store.put("a", values) == sizeof(values) );
+        REQUIRE( store.tryGet("a", res) == KVStoreInterface::ST_FOUND );
+        REQUIRE( res[3] == 4 );
+    }
+
+    SECTION( "a value with a different layout is a type mismatch" ) {
+        float matrix[3][3] = {};
+        int32_t ints[9] = {};
+        float vector[4] = {};
+        uint8_t raw[sizeof(matrix)] = {};
+
+        REQUIRE( store.put("m", matrix) == sizeof(matrix) );
+        REQUIRE( store.tryGet("m", ints) == KVStoreInterface::ST_TYPE_MISMATCH );
+        REQUIRE( store.tryGet("m", vector) == KVStoreInterface::ST_TYPE_MISMATCH );
+
+        REQUIRE( store.putBytes("raw", raw, sizeof(raw)) == sizeof(raw) );
+        REQUIRE( store.tryGet("raw", matrix) == KVStoreInterface::ST_TYPE_MISMATCH );
+    }
+
+    SECTION( "strings are not stored as arrays" ) {
+        REQUIRE( store.put("s", "pippo") == 5 );
+        REQUIRE( store.getBytesLength("s") == 5 );
+    }
+
+    store.clear();
+}
+
+TEST_CASE( "KVStore keys can be iterated without knowing them in advance", "[kvstore][foreach]" ) {
+    KVStore store;
+    store.begin();
+
+    REQUIRE( store.put("0", (uint8_t) 0x55) == 1 );
+    REQUIRE( store.put("1", (uint16_t) 0x5555) == 2 );
+    REQUIRE( store.put("2", (uint32_t) 0x55555555) == 4 );
+
+    SECTION( "every key is visited with its size" ) {
+        size_t total = 0;
+
+        REQUIRE( store.forEach([&total](const KVStoreInterface::KeyInfo& info) {
+            total += info.size;
+            return true;
+        }, true) == 3 );
+        REQUIRE( total == 7 );
+    }
+
+    SECTION( "the iteration stops when the callback returns false" ) {
+        REQUIRE( store.forEach([](const KVStoreInterface::KeyInfo& info) {
+            return strcmp(info.key, "1") != 0;
+        }) == 2 );
+    }
+
+    SECTION( "a plain function can be used as callback" ) {
+        size_t count = 0;
+
+        KVStoreInterface::KeyCallback callback = [](const KVStoreInterface::KeyInfo&, void* arg) {
+            (*(size_t*)arg)++;
+            return true;
+        };
+
+        REQUIRE( store.forEach(callback, &count) == 3 );
+        REQUIRE( count == 3 );
+    }
+
+    REQUIRE( store.remove("0") == 1 );
+    REQUIRE( store.remove("1") == 1 );
+    REQUIRE( store.remove("2") == 1 );
+}
+
+TEST_CASE( "KVStore keys sharing a prefix can be scanned and removed together", "[kvstore][prefix]" ) {
+    KVStore store;
+    store.begin();
+
+    REQUIRE( store.put("sensor/1/offset", (uint16_t) 0x5555) == 2 );
+    REQUIRE( store.put("sensor/1/gain", (uint32_t) 0x55555555) == 4 );
+    REQUIRE( store.put("sensor/2/offset", (uint16_t) 0x5555) == 2 );
+    REQUIRE( store.put("sensor", (uint8_t) 0x55) == 1 );
+
+    SECTION( "only the keys starting with the prefix are visited" ) {
+        size_t total = 0;
+
+        REQUIRE( store.scanPrefix("sensor/1/", [&total](const KVStoreInterface::KeyInfo& info) {
+            total += info.size;
+            return strncmp(info.key, "sensor/1/", 9) == 0;
+        }, true) == 2 );
+        REQUIRE( total == 6 );
+
+        REQUIRE( store.scanPrefix("none/", [](const KVStoreInterface::KeyInfo&) { return true; }) == 0 );
+    }
+
+    SECTION( "only the keys starting with the prefix are removed" ) {
+        REQUIRE( store.removePrefix("sensor/1/") == 2 );
+
+        REQUIRE_FALSE( store.exists("sensor/1/offset") );
+        REQUIRE_FALSE( store.exists("sensor/1/gain") );
+        REQUIRE( store.exists("sensor/2/offset") );
+        REQUIRE( store.exists("sensor") );
+
+        REQUIRE( store.removePrefix("sensor/1/") == 0 );
+    }
+
+    SECTION( "keys that do not fit in a single pass are removed anyway" ) {
+        char key[64];
+
+        for(int i=0; i<64; i++) {
+            snprintf(key, sizeof(key), "sensor/3/a-rather-long-name-%02d", i);
+            REQUIRE( store.put(key, (uint8_t) i) == 1 );
+        }
+
+        REQUIRE( store.removePrefix("sensor/3/") == 64 );
+        REQUIRE( store.scanPrefix("sensor/", [](const KVStoreInterface::KeyInfo&) { return true; }) == 3 );
+    }
+
+    store.clear();
+}
+
+TEST_CASE( "KVStore values kept in RAM can be accessed without copies", "[kvstore][view]" ) {
+    KVStore store;
+    store.begin();
+
+    uint8_t value[] = { 0x55, 0x56, 0x57, 0x58 };
+    REQUIRE( store.putBytes("0", value, sizeof(value)) == sizeof(value) );
+
+    KVStoreInterface::View view = store.getView("0");
+    REQUIRE( view.data != nullptr );
+    REQUIRE( view.len == sizeof(value) );
+    REQUIRE( memcmp(view.data, value, sizeof(value)) == 0 );
+
+    view = store.getView("1");
+    REQUIRE( view.data == nullptr );
+    REQUIRE( view.len == 0 );
+
+    REQUIRE( store.remove("0") == 1 );
+}
+
+TEST_CASE( "KVStore reading a blob with a view does not pay for a copy", "[kvstore][view][.benchmark]" ) {
+    KVStore store;
+    store.begin();
+
+    static uint8_t blob[4096];
+    for(size_t i=0; i<sizeof(blob); i++) {
+        blob[i] = i;
+    }
+    REQUIRE( store.putBytes("blob", blob, sizeof(blob)) == sizeof(blob) );
+
+    BENCHMARK( "getBytes of a 4KiB blob" ) {
+        static uint8_t buf[sizeof(blob)];
+        store.getBytes("blob", buf, sizeof(buf));
+        return buf[sizeof(buf) - 1];
+    };
+
+    BENCHMARK( "getView of a 4KiB blob" ) {
+        KVStoreInterface::View view = store.getView("blob");
+        return view.data[view.len - 1];
+    };
+
+    store.clear();
+}
+
+TEST_CASE( "KVStore values can be written and read in chunks", "[kvstore][stream]" ) {
+    KVStore store;
+    store.begin();
+
+    uint8_t value[100];
+    for(size_t i=0; i<sizeof(value); i++) {
+        value[i] = i;
+    }
+
+    REQUIRE( store.openWrite("blob", sizeof(value)) );
+    for(size_t i=0; i<sizeof(value); i+=30) {
+        size_t len = sizeof(value) - i < 30 ? sizeof(value) - i : 30;
+        REQUIRE( store.write(value + i, len) == (int)len );
+    }
+
+    SECTION( "the value is stored only when finalized" ) {
+        REQUIRE_FALSE( store.exists("blob") );
+        REQUIRE( store.finalize() );
+
+        uint8_t chunk[30];
+        REQUIRE( store.openRead("blob") == sizeof(value) );
+        REQUIRE( store.read(chunk, sizeof(chunk), 0) == sizeof(chunk) );
+        REQUIRE( memcmp(chunk, value, sizeof(chunk)) == 0 );
+        REQUIRE( store.read(chunk, sizeof(chunk), 90) == 10 );
+        REQUIRE( memcmp(chunk, value + 90, 10) == 0 );
+        REQUIRE( store.read(chunk, sizeof(chunk), 101) < 0 );
+        store.closeRead();
+
+        REQUIRE( store.read(chunk, sizeof(chunk), 0) < 0 );
+    }
+
+    SECTION( "writing more than the declared size fails" ) {
+        REQUIRE( store.write(value, 1) < 0 );
+    }
+
+    SECTION( "an incomplete value is not stored" ) {
+        REQUIRE( store.openWrite("blob", sizeof(value) + 1) );
+        REQUIRE( store.write(value, sizeof(value)) == sizeof(value) );
+        REQUIRE_FALSE( store.finalize() );
+        REQUIRE_FALSE( store.exists("blob") );
+    }
+
+    store.clear();
+}
+
+TEST_CASE( "KVStore strings can be read in a caller provided buffer", "[kvstore][string]" ) {
+    KVStore store;
+    store.begin();
+
+    char value[] = "pippo";
+    REQUIRE( store.putString("0", value) == strlen(value) );
+
+    SECTION( "a string that fits the buffer is read completely" ) {
+        char res[6];
+
+        REQUIRE( store.getString("0", res, sizeof(res)) == strlen(value) );
+        REQUIRE( strcmp(res, value) == 0 );
+    }
+
+    SECTION( "a string that does not fit is truncated and the needed length is returned" ) {
+        char res[4];
+
+        REQUIRE( store.getString("0", res, sizeof(res)) == strlen(value) );
+        REQUIRE( strcmp(res, "pip") == 0 );
+    }
+
+    SECTION( "the length can be asked without a buffer" ) {
+        REQUIRE( store.getString("0", nullptr, 0) == strlen(value) );
+    }
+
+    store.clear();
+}
+
+// counts the writes that reach the store, in order to check which ones are skipped
+class CountingKVStore: public KVStore {
+public:
+    typename KVStoreInterface::res_t putBytes(const Key& key, const uint8_t b[], size_t s) override {
+        writes++;
+        return KVStore::putBytes(key, b, s);
+    }
+
+    size_t writes = 0;
+};
+
+TEST_CASE( "KVStore putIfChanged skips the writes of values already stored", "[kvstore][ifchanged]" ) {
+    CountingKVStore store;
+    store.begin();
+
+    struct { uint16_t a; float b; } s = { 1, 2.5f };
+
+    REQUIRE( store.putIfChanged("0", (uint32_t)0x55555555) == 4 );
+    REQUIRE( store.putIfChanged("1", "pippo") == 5 );
+    REQUIRE( store.putIfChanged("2", s) == sizeof(s) );
+    REQUIRE( store.writes == 3 );
+
+    SECTION( "equal values are not written again" ) {
+        REQUIRE( store.putIfChanged("0", (uint32_t)0x55555555) == 4 );
+        REQUIRE( store.putIfChanged("1", "pippo") == 5 );
+        REQUIRE( store.putIfChanged("2", s) == sizeof(s) );
+        REQUIRE( store.putBytesIfChanged("1", (const uint8_t*)"pippo", 5) == 5 );
+        REQUIRE( store.writes == 3 );
+    }
+
+    SECTION( "different values and lengths are written" ) {
+        s.b = 3.5f;
+
+        REQUIRE( store.putIfChanged("0", (uint32_t)0x55555556) == 4 );
+        REQUIRE( store.putIfChanged("1", "pippa") == 5 );
+        REQUIRE( store.putIfChanged("1", "pippo pluto") == 11 );
+        REQUIRE( store.putIfChanged("2", s) == sizeof(s) );
+        REQUIRE( store.writes == 7 );
+
+        REQUIRE( store.getUInt("0") == 0x55555556 );
+        char res[12];
+        REQUIRE( store.getString("1", res, sizeof(res)) == 11 );
+        REQUIRE( strcmp(res, "pippo pluto") == 0 );
+    }
+
+    SECTION( "values longer than the compare buffer are compared as well" ) {
+        uint8_t big[300];
+        memset(big, 0xAA, sizeof(big));
+
+        REQUIRE( store.putBytesIfChanged("3", big, sizeof(big)) == sizeof(big) );
+        REQUIRE( store.putBytesIfChanged("3", big, sizeof(big)) == sizeof(big) );
+        REQUIRE( store.writes == 4 );
+
+        big[299] = 0;
+        REQUIRE( store.putBytesIfChanged("3", big, sizeof(big)) == sizeof(big) );
+        REQUIRE( store.writes == 5 );
+    }
+
+    SECTION( "the mode of the store applies to every put" ) {
+        store.setPutIfChanged(true);
+        REQUIRE( store.getPutIfChanged() );
+
+        REQUIRE( store.putUInt("0", 0x55555555) == 4 );
+        REQUIRE( store.putString("1", "pippo") == 5 );
+        REQUIRE( store.put("2", s) == sizeof(s) );
+        REQUIRE( store.writes == 3 );
+
+        REQUIRE( store.putUInt("0", 1) == 4 );
+        REQUIRE( store.writes == 4 );
+
+        store.setPutIfChanged(false);
+        REQUIRE( store.putUInt("0", 1) == 4 );
+        REQUIRE( store.writes == 5 );
+    }
+
+    store.clear();
+}
+
+// stores strings with their terminator and counts it in their length, as NVS does
+class TerminatedKVStore: public CountingKVStore {
+protected:
+    typename KVStoreInterface::res_t _put(const Key& key, const uint8_t value[], size_t len, Type t) override {
+        if(t != PT_STR) {
+            return CountingKVStore::_put(key, value, len, t);
+        }
+
+        std::string terminated((const char*)value, len);
+        return putBytes(key, (const uint8_t*)terminated.c_str(), len + 1) > 0 ? len : 0;
+    }
+};
+
+TEST_CASE( "KVStore putIfChanged compares strings stored with their terminator", "[kvstore][ifchanged]" ) {
+    TerminatedKVStore store;
+    store.begin();
+
+    REQUIRE( store.putIfChanged("0", "pippo") == 5 );
+    REQUIRE( store.getBytesLength("0") == 6 );
+    REQUIRE( store.writes == 1 );
+
+    REQUIRE( store.putIfChanged("0", "pippo") == 5 );
+    REQUIRE( store.writes == 1 );
+
+    SECTION( "a string shorter by one character is written" ) {
+        REQUIRE( store.putIfChanged("0", "pipp") == 4 );
+        REQUIRE( store.writes == 2 );
+    }
+
+    SECTION( "a string that is a prefix of an unterminated stored value is written" ) {
+        REQUIRE( store.putBytes("1", (const uint8_t*)"pippo", 5) == 5 );
+        REQUIRE( store.putIfChanged("1", "pipp") == 4 );
+        REQUIRE( store.writes == 3 );
+    }
+
+    store.clear();
+}
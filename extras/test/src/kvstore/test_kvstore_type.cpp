@@ -11,6 +11,7 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include <kvstore/kvstore.h>
+#include <cstring>
 
 TEST_CASE( "Testing KVStore getType utility function", "[kvstore][utility]" ) {
 
@@ -36,3 +37,32 @@ TEST_CASE( "Testing KVStore getType utility function", "[kvstore][utility]" ) {
     REQUIRE(KVStoreInterface::getType(buf)                  == KVStoreInterface::PT_BLOB);
     // REQUIRE(KVStoreInterface::getType()                     == KVStoreInterface::PT_INVALID);
 }
+
+TEST_CASE( "Testing KVStore keys carry their length and hash", "[kvstore][utility][key]" ) {
+    constexpr KVStoreInterface::Key key("sensor/offset");
+
+    // length and hash of constexpr keys are available at compile time
+    static_assert(key.length() == 13, "the key length is computed at compile time");
+    static_assert(key.hash() == KVStoreInterface::Key::hash("sensor/offset", 13), "the key hash is computed at compile time");
+
+    // FNV-1a reference values
+    REQUIRE(KVStoreInterface::Key("").hash()                == 0x811c9dc5);
+    REQUIRE(KVStoreInterface::Key("a").hash()               == 0xe40c292c);
+    REQUIRE(KVStoreInterface::Key("foobar").hash()          == 0xbf9cf968);
+
+    const char* cstr = "sensor/offset";
+    KVStoreInterface::Key fromPointer = cstr;
+    REQUIRE(fromPointer.length()                            == key.length());
+    REQUIRE(fromPointer.hash()                              == key.hash());
+    REQUIRE(strcmp(fromPointer, key)                        == 0);
+
+    // arrays are measured up to the terminator, not up to their size
+    char buf[32] = "sensor/offset";
+    KVStoreInterface::Key fromArray = buf;
+    REQUIRE(fromArray.length()                              == key.length());
+    REQUIRE(fromArray.hash()                                == key.hash());
+
+    KVStoreInterface::Key empty = nullptr;
+    REQUIRE(empty.length()                                  == 0);
+    REQUIRE(empty.c_str()                                   == nullptr);
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <kvstore/utility/pipeline.h>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+
+/*
+ * Scripted coprocessor: every time the bytes written match the next command of the script
+ * its reply is made available to read. Replies can be held back to simulate a slow coprocessor,
+ * and writes can be limited to simulate a full output buffer
+ */
+class FakeModemTransport: public KVModemTransport {
+public:
+    void script(const std::string& command, const std::string& reply) {
+        commands.push_back(std::make_pair(command, reply));
+    }
+
+    size_t available() override { return rx.size() - rxPos; }
+
+    int read() override {
+        return rxPos < rx.size() ? (uint8_t)rx[rxPos++] : -1;
+    }
+
+    size_t write(const uint8_t data[], size_t len) override {
+        size_t n = len < writeLimit ? len : writeLimit;
+        pending.append((const char*)data, n);
+        written.append((const char*)data, n);
+
+        while(!commands.empty() && pending.compare(0, commands.front().first.size(), commands.front().first) == 0) {
+            pending.erase(0, commands.front().first.size());
+            held.append(commands.front().second);
+            commands.pop_front();
+            received++;
+        }
+
+        if(!hold) {
+            release();
+        }
+
+        return n;
+    }
+
+    // make the replies held so far available
+    void release() {
+        rx.append(held);
+        held.clear();
+    }
+
+    // the whole script has been received
+    bool done() const { return commands.empty() && pending.empty(); }
+
+    bool hold = false;
+    size_t writeLimit = SIZE_MAX;   // bytes accepted by a single write
+    size_t received = 0;            // commands of the script received
+    std::string written;
+
+private:
+    std::deque<std::pair<std::string, std::string>> commands;
+    std::string pending;
+    std::string held;
+    std::string rx;
+    size_t rxPos = 0;
+};
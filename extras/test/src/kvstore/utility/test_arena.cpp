@@ -0,0 +1,80 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/arena.h>
+#include <cstring>
+
+TEST_CASE( "Arena carves blocks out of chunks and reuses them", "[arena]" ) {
+    Arena arena(1024);
+
+    uint8_t* a = arena.allocate(10);
+    uint8_t* b = arena.allocate(20);
+
+    REQUIRE( a != nullptr );
+    REQUIRE( b != nullptr );
+    REQUIRE( arena.capacity(10) == 16 );
+    REQUIRE( arena.capacity(20) == 32 );
+    REQUIRE( b - a == 16 );
+
+    size_t reserved = arena.reserved();
+    REQUIRE( reserved > 1024 );
+
+    memset(a, 0x55, arena.capacity(10));
+    memset(b, 0x56, arena.capacity(20));
+
+    SECTION( "a released block is given to the next allocation of the same class" ) {
+        arena.release(a, 10);
+        REQUIRE( arena.allocate(16) == a );
+        REQUIRE( arena.allocate(16) != a );
+        REQUIRE( arena.reserved() == reserved );
+    }
+
+    SECTION( "blocks bigger than a quarter of a chunk are taken from the heap" ) {
+        uint8_t* big = arena.allocate(300);
+
+        // big blocks are preceded by a header that links them
+        REQUIRE( arena.capacity(300) == 300 );
+        REQUIRE( arena.reserved() == reserved + 300 + 16 );
+
+        arena.release(big, 300);
+        REQUIRE( arena.reserved() == reserved );
+    }
+
+    SECTION( "reset frees also the big blocks that were not released" ) {
+        uint8_t* big[3];
+        for(int i=0; i<3; i++) {
+            big[i] = arena.allocate(300 + i);
+            memset(big[i], 0x55, 300 + i);
+        }
+
+        arena.release(big[1], 301);
+        arena.reset();
+        REQUIRE( arena.reserved() == 0 );
+    }
+
+    SECTION( "a full chunk is replaced and its free space is reused" ) {
+        for(int i=0; i<5; i++) {
+            REQUIRE( arena.allocate(256) != nullptr );
+        }
+        REQUIRE( arena.reserved() == 2 * reserved );
+
+        // the space left in the first chunk is split in smaller blocks
+        uint8_t* c = arena.allocate(64);
+        REQUIRE( c > a );
+        REQUIRE( c < a + 1024 );
+    }
+
+    SECTION( "reset gives back all the memory" ) {
+        arena.reset();
+        REQUIRE( arena.reserved() == 0 );
+    }
+}
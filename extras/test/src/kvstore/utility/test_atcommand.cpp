@@ -0,0 +1,136 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/atcommand.h>
+#include <kvstore/utility/pipeline.h>
+#include "fake_modem.h"
+#include <climits>
+#include <string>
+
+TEST_CASE( "ATCommand builds command lines in the buffer of the caller", "[atcommand][builder]" ) {
+    char cmd[40];
+
+    SECTION( "arguments are separated by commas" ) {
+        REQUIRE( ATCommand(cmd, sizeof(cmd), "AT+PREFBEGIN=").arg("arduino").arg(true).arg("").end() == 25 );
+        REQUIRE( std::string(cmd) == "AT+PREFBEGIN=arduino,1,\r\n" );
+
+        REQUIRE( ATCommand(cmd, sizeof(cmd), "AT+PREFPUT=").arg("k").arg(KVStoreInterface::PT_BLOB).arg(4096).end() > 0 );
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,9,4096\r\n" );
+
+        REQUIRE( ATCommand(cmd, sizeof(cmd), "AT+PREFLEN=").arg(INT64_MIN).end() > 0 );
+        REQUIRE( std::string(cmd) == "AT+PREFLEN=-9223372036854775808\r\n" );
+    }
+
+    SECTION( "a command that does not fit is refused" ) {
+        REQUIRE( ATCommand(cmd, 32, "AT+PREFREMOVE=").arg("a_rather_long_key").end() == 0 );
+        REQUIRE( ATCommand(cmd, 31, "AT+PREFREMOVE=").arg("key").arg("").arg(123456789).end() == 30 );
+        REQUIRE( ATCommand(cmd, 30, "AT+PREFREMOVE=").arg("key").arg("").arg(123456789).end() == 0 );
+        REQUIRE( ATCommand(nullptr, 0, "AT").end() == 0 );
+    }
+}
+
+TEST_CASE( "Scalar commands are written as the coprocessor parses them", "[atcommand][format]" ) {
+    char cmd[64];
+
+    SECTION( "every integer type keeps its sign and range" ) {
+        int8_t i8 = -128;
+        uint8_t u8 = 255;
+        int16_t i16 = -32768;
+        uint16_t u16 = 65535;
+        int32_t i32 = INT32_MIN;
+        uint32_t u32 = UINT32_MAX;
+
+        REQUIRE( atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_I8, (uint8_t*)&i8) > 0 );
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,0,-128\r\n" );
+        atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_U8, &u8);
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,1,255\r\n" );
+        atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_I16, (uint8_t*)&i16);
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,2,-32768\r\n" );
+        atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_U16, (uint8_t*)&u16);
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,3,65535\r\n" );
+        atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_I32, (uint8_t*)&i32);
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,4,-2147483648\r\n" );
+
+        size_t len = atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_U32, (uint8_t*)&u32);
+        REQUIRE( std::string(cmd) == "AT+PREFPUT=k,5,4294967295\r\n" );
+        REQUIRE( len == strlen(cmd) );
+    }
+
+    SECTION( "commands without value" ) {
+        REQUIRE( atScalarCommand(cmd, sizeof(cmd), "AT+PREFGET=", "key", KVStoreInterface::PT_U16) > 0 );
+        REQUIRE( std::string(cmd) == "AT+PREFGET=key,3\r\n" );
+    }
+
+    SECTION( "commands that do not fit and values that are not text scalars are refused" ) {
+        uint32_t v = 1234567;
+        uint64_t big = 1;
+
+        REQUIRE( atScalarCommand(cmd, 26, "AT+PREFPUT=", "key", KVStoreInterface::PT_U32, (uint8_t*)&v) == 0 );
+        REQUIRE( atScalarCommand(cmd, 27, "AT+PREFPUT=", "key", KVStoreInterface::PT_U32, (uint8_t*)&v) == 26 );
+        REQUIRE( atScalarCommand(cmd, sizeof(cmd), "AT+PREFPUT=", "k", KVStoreInterface::PT_U64, (uint8_t*)&big) == 0 );
+    }
+}
+
+TEST_CASE( "Scalar values are checked against the range of their type", "[atcommand][value]" ) {
+    uint8_t value[4] = { 0xAA, 0xAA, 0xAA, 0xAA };
+
+    SECTION( "only the size of the type is written" ) {
+        REQUIRE( atScalarValue(-1, KVStoreInterface::PT_I8, value, sizeof(value)) == 1 );
+        REQUIRE( value[0] == 0xFF );
+        REQUIRE( value[1] == 0xAA );
+
+        REQUIRE( atScalarValue(0x1234, KVStoreInterface::PT_U16, value, sizeof(value)) == 2 );
+        REQUIRE( value[2] == 0xAA );
+
+        uint32_t u32;
+        REQUIRE( atScalarValue(UINT32_MAX, KVStoreInterface::PT_U32, (uint8_t*)&u32, sizeof(u32)) == 4 );
+        REQUIRE( u32 == UINT32_MAX );
+    }
+
+    SECTION( "out of range numbers and short buffers are refused" ) {
+        REQUIRE( atScalarValue(128, KVStoreInterface::PT_I8, value, sizeof(value)) == 0 );
+        REQUIRE( atScalarValue(-1, KVStoreInterface::PT_U32, value, sizeof(value)) == 0 );
+        REQUIRE( atScalarValue(1, KVStoreInterface::PT_I32, value, 2) == 0 );
+        REQUIRE( atScalarValue(1, KVStoreInterface::PT_FLOAT, value, sizeof(value)) == 0 );
+        REQUIRE( value[0] == 0xAA );
+    }
+}
+
+TEST_CASE( "Scalar replies keep the full range of the type through the pipeline", "[atcommand][pipeline]" ) {
+    FakeModemTransport modem;
+    ATPipeline pipeline(&modem);
+    char cmd[AT_COMMAND_SIZE];
+    int64_t number;
+
+    atScalarCommand(cmd, sizeof(cmd), "AT+PREFGET=", "k", KVStoreInterface::PT_U32);
+    modem.script(cmd, "+PREFGET: 4294967295\r\nOK\r\n");
+    modem.script(cmd, "+PREFGET: -5\r\nOK\r\n");
+    modem.script(cmd, "ERROR\r\n");
+
+    auto big = pipeline.submit("+PREFGET:", cmd);
+    auto negative = pipeline.submit("+PREFGET:", cmd);
+    auto error = pipeline.submit("+PREFGET:", cmd);
+
+    pipeline.wait(big);
+    REQUIRE( pipeline.number(big, &number) );
+    REQUIRE( number == UINT32_MAX );
+
+    REQUIRE( pipeline.wait(negative) == -5 );
+    REQUIRE( pipeline.number(negative, &number) );
+    REQUIRE( number == -5 );
+
+    REQUIRE( pipeline.wait(error) == -1 );
+    REQUIRE_FALSE( pipeline.number(error, &number) );
+
+    // the failure has been reported by wait
+    REQUIRE( pipeline.flush() );
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/blockdevice.h>
+
+TEST_CASE( "RamBlockDevice behaves like a NOR flash", "[blockdevice]" ) {
+    RamBlockDevice bd(8192, 4, 4096);
+    REQUIRE( bd.init() == BD_ERROR_OK );
+
+    uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t res[8];
+
+    REQUIRE( bd.read(res, 0, sizeof(res)) == BD_ERROR_OK );
+    REQUIRE( res[0] == 0xFF );
+
+    REQUIRE( bd.program(data, 0, sizeof(data)) == BD_ERROR_OK );
+    REQUIRE( bd.read(res, 0, sizeof(res)) == BD_ERROR_OK );
+    REQUIRE( memcmp(res, data, sizeof(data)) == 0 );
+
+    SECTION( "programming requires aligned and erased bytes" ) {
+        REQUIRE( bd.program(data, 2, 4) == BD_ERROR_NOT_ALIGNED );
+        REQUIRE( bd.program(data, 4, 4) == BD_ERROR_NOT_ERASED );
+        REQUIRE( bd.program(data, 8188, 8) == BD_ERROR_OUT_OF_BOUNDS );
+    }
+
+    SECTION( "erases are counted for every block" ) {
+        REQUIRE( bd.erase(0, 2048) == BD_ERROR_NOT_ALIGNED );
+        REQUIRE( bd.erase(0, 4096) == BD_ERROR_OK );
+        REQUIRE( bd.program(data, 4, 4) == BD_ERROR_OK );
+
+        REQUIRE( bd.getEraseCount(0) == 1 );
+        REQUIRE( bd.getEraseCount(1) == 0 );
+        REQUIRE( bd.getStats().bytesProgrammed == 12 );
+        REQUIRE( bd.getStats().bytesErased == 4096 );
+    }
+}
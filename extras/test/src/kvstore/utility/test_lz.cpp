@@ -0,0 +1,113 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/lz.h>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> roundTrip(const std::vector<uint8_t>& data, size_t* compressed) {
+    std::vector<uint8_t> packed(data.size() + data.size() / 8 + 16);
+    uint16_t table[LZ_HASH_SIZE];
+
+    *compressed = lzCompress(data.data(), data.size(), packed.data(), packed.size(), table);
+    REQUIRE( *compressed > 0 );
+
+    std::vector<uint8_t> res(data.size());
+    REQUIRE( lzDecompress(packed.data(), *compressed, res.data(), res.size()) == (int32_t)data.size() );
+
+    return res;
+}
+
+TEST_CASE( "LZ codec restores the original data", "[lz][roundtrip]" ) {
+    size_t compressed;
+
+    SECTION( "repetitive text shrinks" ) {
+        std::string json;
+        for(int i=0; i<40; i++) {
+            json += "{\"sensor\":\"temperature\",\"unit\":\"celsius\",\"id\":" + std::to_string(i) + "},";
+        }
+
+        std::vector<uint8_t> data(json.begin(), json.end());
+        REQUIRE( roundTrip(data, &compressed) == data );
+        REQUIRE( compressed < data.size() / 4 );
+    }
+
+    SECTION( "long runs use the extended lengths" ) {
+        std::vector<uint8_t> data(5000, 0x55);
+        REQUIRE( roundTrip(data, &compressed) == data );
+        REQUIRE( compressed < 64 );
+    }
+
+    SECTION( "random data is restored even if it does not shrink" ) {
+        std::mt19937 rng(1);
+        std::vector<uint8_t> data(1000);
+        for(auto& b: data) {
+            b = rng();
+        }
+
+        REQUIRE( roundTrip(data, &compressed) == data );
+        REQUIRE( compressed > data.size() );
+    }
+
+    SECTION( "inputs shorter than a match are stored as literals" ) {
+        std::vector<uint8_t> data = { 1, 2, 3 };
+        REQUIRE( roundTrip(data, &compressed) == data );
+        REQUIRE( compressed == 4 );
+    }
+}
+
+TEST_CASE( "LZ codec respects the size of the buffers", "[lz][bounds]" ) {
+    std::vector<uint8_t> data(2000);
+    for(size_t i=0; i<data.size(); i++) {
+        data[i] = "abcabcabd"[i % 9];
+    }
+
+    uint16_t table[LZ_HASH_SIZE];
+    std::vector<uint8_t> packed(data.size());
+    size_t len = lzCompress(data.data(), data.size(), packed.data(), packed.size(), table);
+    REQUIRE( len > 0 );
+
+    SECTION( "compression fails when the result does not fit" ) {
+        REQUIRE( lzCompress(data.data(), data.size(), packed.data(), len - 1, table) == 0 );
+    }
+
+    SECTION( "a short output receives the beginning of the data and the full size is returned" ) {
+        std::vector<uint8_t> res(100);
+
+        REQUIRE( lzDecompress(packed.data(), len, res.data(), res.size()) == (int32_t)data.size() );
+        REQUIRE( memcmp(res.data(), data.data(), res.size()) == 0 );
+    }
+
+    SECTION( "corrupted input is rejected" ) {
+        std::vector<uint8_t> res(data.size());
+
+        // truncated in the middle of a sequence
+        REQUIRE( lzDecompress(packed.data(), 2, res.data(), res.size()) == -1 );
+
+        // a match that points before the beginning of the data
+        const uint8_t bad[] = { 0x10, 'a', 0x10, 0x00, 0x00 };
+        REQUIRE( lzDecompress(bad, sizeof(bad), res.data(), res.size()) == -1 );
+
+        // random input never reads or writes out of bounds
+        std::mt19937 rng(2);
+        for(int i=0; i<1000; i++) {
+            std::vector<uint8_t> noise(1 + rng() % 64);
+            for(auto& b: noise) {
+                b = rng();
+            }
+            int32_t res2 = lzDecompress(noise.data(), noise.size(), res.data(), 16);
+            REQUIRE( res2 >= -1 );
+        }
+    }
+}
@@ -0,0 +1,220 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/pipeline.h>
+#include "fake_modem.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void record(ATPipeline::handle_t handle, int result, void* arg) {
+    static_cast<std::vector<std::pair<ATPipeline::handle_t, int>>*>(arg)->push_back(std::make_pair(handle, result));
+}
+
+TEST_CASE( "ATPipeline sends commands back to back and matches the replies in order", "[pipeline][order]" ) {
+    FakeModemTransport modem;
+    ATPipeline pipeline(&modem);
+    std::vector<std::pair<ATPipeline::handle_t, int>> completed;
+
+    const uint8_t value[] = { 'a', 'b', 'c' };
+    uint8_t out[8] = {};
+
+    modem.script("AT+PREFPUT=k1,9,3\r\nabc", "+PREFPUT: 3\r\nOK\r\n");
+    modem.script("AT+PREFGET=k1,9\r\n", "+PREFGET: 3|abc\r\nOK\r\n");
+    modem.script("AT+PREFREMOVE=k1\r\n", "+PREFREMOVE: 1\r\nOK\r\n");
+
+    auto put = pipeline.submit("+PREFPUT:", "AT+PREFPUT=k1,9,3\r\n", value, sizeof(value),
+        nullptr, 0, record, &completed);
+    auto get = pipeline.submit("+PREFGET:", "AT+PREFGET=k1,9\r\n", nullptr, 0, out, sizeof(out), record, &completed);
+    auto rm = pipeline.submit("+PREFREMOVE:", "AT+PREFREMOVE=k1\r\n", nullptr, 0, nullptr, 0, record, &completed);
+
+    REQUIRE( put != 0 );
+    REQUIRE( get != 0 );
+    REQUIRE( rm != 0 );
+    REQUIRE( pipeline.state(put) == ATPipeline::OP_QUEUED );
+    REQUIRE( modem.written.empty() );
+
+    REQUIRE( pipeline.flush() );
+    REQUIRE( modem.done() );
+
+    REQUIRE( pipeline.state(put) == ATPipeline::OP_DONE );
+    REQUIRE( pipeline.result(put) == 3 );
+    REQUIRE( pipeline.result(get) == 3 );
+    REQUIRE( memcmp(out, "abc", 3) == 0 );
+    REQUIRE( pipeline.result(rm) == 1 );
+
+    REQUIRE( completed.size() == 3 );
+    REQUIRE( completed[0] == std::make_pair(put, 3) );
+    REQUIRE( completed[1] == std::make_pair(get, 3) );
+    REQUIRE( completed[2] == std::make_pair(rm, 1) );
+}
+
+TEST_CASE( "ATPipeline keeps a bounded number of commands in flight", "[pipeline][inflight]" ) {
+    FakeModemTransport modem;
+    ATPipeline pipeline(&modem, 3);
+    ATPipeline::handle_t handles[AT_PIPELINE_DEPTH];
+    modem.hold = true;
+
+    for(size_t i=0; i<AT_PIPELINE_DEPTH; i++) {
+        std::string cmd = "AT+PREFLEN=k" + std::to_string(i) + "\r\n";
+        modem.script(cmd, "+PREFLEN: " + std::to_string(i * 10) + "\r\nOK\r\n");
+        handles[i] = pipeline.submit("+PREFLEN:", cmd.c_str());
+        REQUIRE( handles[i] != 0 );
+    }
+
+    // the queue is full
+    REQUIRE( pipeline.submit("+PREFLEN:", "AT+PREFLEN=x\r\n") == 0 );
+
+    // nothing is replied, only the first commands are written
+    REQUIRE( pipeline.poll() );
+    REQUIRE( modem.received == 3 );
+    REQUIRE( pipeline.state(handles[2]) == ATPipeline::OP_SENT );
+    REQUIRE( pipeline.state(handles[3]) == ATPipeline::OP_QUEUED );
+
+    // the replies free the window for the following commands
+    modem.release();
+    REQUIRE( pipeline.poll() );
+    REQUIRE( modem.received == 6 );
+    REQUIRE( pipeline.pending() == 5 );
+    REQUIRE( pipeline.result(handles[2]) == 20 );
+
+    modem.hold = false;
+    modem.release();
+    REQUIRE( pipeline.flush() );
+    REQUIRE( modem.done() );
+
+    for(size_t i=0; i<AT_PIPELINE_DEPTH; i++) {
+        REQUIRE( pipeline.result(handles[i]) == (int)i * 10 );
+    }
+}
+
+TEST_CASE( "ATPipeline parses the replies of the coprocessor", "[pipeline][parse]" ) {
+    FakeModemTransport modem;
+    ATPipeline pipeline(&modem);
+
+    SECTION( "sized data can contain line terminators and a short buffer drops the rest" ) {
+        uint8_t out[4];
+        modem.script("AT+PREFGET=k,9\r\n", "+PREFGET: 8|\r\nOK\r\n12\r\nOK\r\n");
+
+        auto h = pipeline.submit("+PREFGET:", "AT+PREFGET=k,9\r\n", nullptr, 0, out, sizeof(out));
+        REQUIRE( pipeline.flush() );
+        REQUIRE( pipeline.result(h) == 8 );
+        REQUIRE( memcmp(out, "\r\nOK", 4) == 0 );
+    }
+
+    SECTION( "an empty output buffer still reads the reply using its size" ) {
+        uint8_t unused;
+        modem.script("AT+PREFGET=k,8\r\n", "+PREFGET: 5|OK\r\n1\r\nOK\r\n");
+
+        auto h = pipeline.submit("+PREFGET:", "AT+PREFGET=k,8\r\n", nullptr, 0, &unused, 0);
+        REQUIRE( pipeline.flush() );
+        REQUIRE( pipeline.result(h) == 5 );
+    }
+
+    SECTION( "an error fails only its operation" ) {
+        modem.script("AT+PREFTYPE=a\r\n", "ERROR\r\n");
+        modem.script("AT+PREFTYPE=b\r\n", "+PREFTYPE: 9\r\nOK\r\n");
+
+        auto a = pipeline.submit("+PREFTYPE:", "AT+PREFTYPE=a\r\n");
+        auto b = pipeline.submit("+PREFTYPE:", "AT+PREFTYPE=b\r\n");
+
+        REQUIRE_FALSE( pipeline.flush() );
+        REQUIRE( pipeline.state(a) == ATPipeline::OP_ERROR );
+        REQUIRE( pipeline.result(a) == -1 );
+        REQUIRE( pipeline.state(b) == ATPipeline::OP_DONE );
+        REQUIRE( pipeline.result(b) == 9 );
+
+        // the failures are reported once
+        REQUIRE( pipeline.flush() );
+
+        // waiting for an operation whose failure was already reported does not affect the next flush
+        REQUIRE( pipeline.wait(a) == -1 );
+        REQUIRE( pipeline.wait(a) == -1 );
+        REQUIRE( pipeline.flush() );
+
+        modem.script("AT+PREFTYPE=c\r\n", "ERROR\r\n");
+        pipeline.submit("+PREFTYPE:", "AT+PREFTYPE=c\r\n");
+        REQUIRE_FALSE( pipeline.flush() );
+    }
+
+    SECTION( "echoed commands and unsolicited lines are ignored" ) {
+        modem.script("AT+PREFLEN=k\r\n", "AT+PREFLEN=k\r\n+WIFI: 1\r\n\r\n+PREFLEN: 42\r\nOK\r\n");
+
+        auto h = pipeline.submit("+PREFLEN:", "AT+PREFLEN=k\r\n");
+        REQUIRE( pipeline.flush() );
+        REQUIRE( pipeline.result(h) == 42 );
+    }
+
+    SECTION( "commands are completed also when the transport accepts few bytes at a time" ) {
+        const uint8_t value[20] = {};
+        modem.writeLimit = 3;
+        modem.script(std::string("AT+PREFPUT=k,9,20\r\n") + std::string(20, '\0'), "+PREFPUT: 20\r\nOK\r\n");
+        modem.script("AT+PREFLEN=k\r\n", "+PREFLEN: 20\r\nOK\r\n");
+
+        auto put = pipeline.submit("+PREFPUT:", "AT+PREFPUT=k,9,20\r\n", value, sizeof(value));
+        auto len = pipeline.submit("+PREFLEN:", "AT+PREFLEN=k\r\n");
+
+        REQUIRE( pipeline.flush() );
+        REQUIRE( modem.done() );
+        REQUIRE( pipeline.result(put) == 20 );
+        REQUIRE( pipeline.result(len) == 20 );
+    }
+
+    SECTION( "commands that do not fit are refused" ) {
+        std::string cmd = "AT+PREFLEN=" + std::string(AT_COMMAND_SIZE, 'k') + "\r\n";
+
+        REQUIRE( pipeline.submit("+PREFLEN:", cmd.c_str()) == 0 );
+        REQUIRE( pipeline.submit("+PREFLEN:", "") == 0 );
+        REQUIRE( pipeline.state(0) == ATPipeline::OP_INVALID );
+    }
+}
+
+static void chain(ATPipeline::handle_t, int result, void* arg) {
+    ATPipeline* pipeline = static_cast<ATPipeline*>(arg);
+
+    if(result > 0) {
+        pipeline->submit("+PREFREMOVE:", "AT+PREFREMOVE=k\r\n");
+    }
+}
+
+TEST_CASE( "ATPipeline callbacks can submit operations", "[pipeline][callback]" ) {
+    FakeModemTransport modem;
+    ATPipeline pipeline(&modem);
+
+    modem.script("AT+PREFLEN=k\r\n", "+PREFLEN: 5\r\nOK\r\n");
+    modem.script("AT+PREFREMOVE=k\r\n", "+PREFREMOVE: 1\r\nOK\r\n");
+
+    pipeline.submit("+PREFLEN:", "AT+PREFLEN=k\r\n", nullptr, 0, nullptr, 0, chain, &pipeline);
+
+    REQUIRE( pipeline.flush() );
+    REQUIRE( modem.done() );
+}
+
+TEST_CASE( "ATPipeline fails the operations when the coprocessor does not reply", "[pipeline][timeout]" ) {
+    FakeModemTransport modem;
+    ATPipeline pipeline(&modem);
+    pipeline.setTimeout(5);
+
+    modem.script("AT+PREFCLEAR\r\n", "");
+    auto h = pipeline.submit("+PREFCLEAR:", "AT+PREFCLEAR\r\n");
+
+    REQUIRE( pipeline.poll() );
+    REQUIRE( pipeline.state(h) == ATPipeline::OP_SENT );
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    REQUIRE_FALSE( pipeline.poll() );
+    REQUIRE( pipeline.state(h) == ATPipeline::OP_ERROR );
+    REQUIRE_FALSE( pipeline.flush() );
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/schema.h>
+#include "../mock_kvstore.h"
+
+namespace {
+    KVSCHEMA_FIELD(Gain, float, "gain", 1.5f);
+    KVSCHEMA_FIELD(Channel, uint8_t, "channel", 3);
+    KVSCHEMA_FIELD(Counter, uint32_t, "counter", 0);
+    KVSCHEMA_FIELD(Enabled, bool, "enabled", true);
+
+    typedef KVSchema<Gain, Channel, Counter> Settings;
+    typedef KVSchema<Channel, Enabled, Counter> SettingsV2;
+}
+
+TEST_CASE( "KVSchema stores all the fields as a single record", "[schema]" ) {
+    MockKVStore mock;
+    Settings settings(mock, "settings");
+
+    static_assert(Settings::size() == 6 + 3 * 6 + sizeof(float) + sizeof(uint8_t) + sizeof(uint32_t), "packed record");
+    static_assert(Settings::hash() != SettingsV2::hash(), "the layout hash depends on the fields");
+
+    SECTION( "fields have their default value before being loaded" ) {
+        REQUIRE( settings.get<Gain>() == 1.5f );
+        REQUIRE( settings.get<Channel>() == 3 );
+        REQUIRE( settings.get<Counter>() == 0 );
+        REQUIRE_FALSE( settings.isDirty() );
+    }
+
+    SECTION( "the record is written with a single put and read back" ) {
+        settings.set<Gain>(2.25f);
+        settings.set<Counter>(0xdeadbeef);
+        REQUIRE( settings.isDirty() );
+
+        mock.resetCounters();
+        REQUIRE( settings.save() );
+        REQUIRE( mock.writes == 1 );
+        REQUIRE( mock.kvmap.size() == 1 );
+        REQUIRE( mock.kvmap["settings"].size() == Settings::size() );
+
+        // nothing is written when no field was modified
+        REQUIRE( settings.save() );
+        REQUIRE( mock.writes == 1 );
+
+        Settings loaded(mock, "settings");
+        REQUIRE( loaded.load() );
+        REQUIRE_FALSE( loaded.isDirty() );
+        REQUIRE( loaded.get<Gain>() == 2.25f );
+        REQUIRE( loaded.get<Channel>() == 3 );
+        REQUIRE( loaded.get<Counter>() == 0xdeadbeef );
+    }
+
+    SECTION( "a record with a different layout is migrated" ) {
+        settings.set<Channel>(7);
+        settings.set<Counter>(42);
+        settings.set<Gain>(0.5f);
+        REQUIRE( settings.save() );
+
+        SettingsV2 v2(mock, "settings");
+        REQUIRE_FALSE( v2.load() );
+        REQUIRE( v2.isDirty() );
+        REQUIRE( v2.get<Channel>() == 7 );
+        REQUIRE( v2.get<Counter>() == 42 );
+        REQUIRE( v2.get<Enabled>() == true );
+
+        REQUIRE( v2.save() );
+        REQUIRE( mock.kvmap["settings"].size() == SettingsV2::size() );
+
+        SettingsV2 reloaded(mock, "settings");
+        REQUIRE( reloaded.load() );
+        REQUIRE( reloaded.get<Counter>() == 42 );
+    }
+
+    SECTION( "fields stored with a different type get their default value" ) {
+        KVSCHEMA_FIELD(Wide, uint16_t, "channel", 9);
+
+        settings.set<Channel>(5);
+        REQUIRE( settings.save() );
+
+        KVSchema<Wide, Counter> other(mock, "settings");
+        REQUIRE_FALSE( other.load() );
+        REQUIRE( other.get<Wide>() == 9 );
+    }
+
+    SECTION( "a missing record is read from the legacy keys" ) {
+        mock.putFloat("gain", 4.0f);
+        mock.putUInt("counter", 12);
+
+        REQUIRE_FALSE( settings.load() );
+        REQUIRE( settings.get<Gain>() == 4.0f );
+        REQUIRE( settings.get<Channel>() == 3 );
+        REQUIRE( settings.get<Counter>() == 12 );
+
+        REQUIRE( settings.save() );
+        REQUIRE( settings.removeLegacy() == 2 );
+        REQUIRE( mock.kvmap.size() == 1 );
+    }
+
+    SECTION( "a truncated record is ignored" ) {
+        uint8_t junk[] = { 0x01, 0x02, 0x03 };
+        mock.putBytes("settings", junk, sizeof(junk));
+
+        REQUIRE_FALSE( settings.load() );
+        REQUIRE( settings.get<Gain>() == 1.5f );
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <kvstore/utility/transaction.h>
+#include "../mock_kvstore.h"
+
+TEST_CASE( "TransactionBuffer keeps the modifications until they are applied", "[transaction]" ) {
+    MockKVStore mock;
+    TransactionBuffer transaction;
+
+    const uint8_t* value;
+    size_t len;
+    uint8_t v0[] = { 0x55, 0x55 };
+    uint8_t v1[] = { 0x56, 0x56, 0x56 };
+
+    REQUIRE( mock.putBytes("2", v0, sizeof(v0)) == sizeof(v0) );
+    mock.resetCounters();
+
+    REQUIRE( transaction.empty() );
+    REQUIRE( transaction.put("0", v0, sizeof(v0)) );
+    REQUIRE( transaction.put("1", v0, sizeof(v0)) );
+    REQUIRE( transaction.put("0", v1, sizeof(v1)) );
+    REQUIRE( transaction.remove("2") );
+    REQUIRE_FALSE( transaction.empty() );
+
+    SECTION( "buffered values can be read back" ) {
+        REQUIRE( transaction.lookup("0", &value, &len) );
+        REQUIRE( len == sizeof(v1) );
+        REQUIRE( memcmp(value, v1, len) == 0 );
+
+        REQUIRE( transaction.lookup("2", &value, &len) );
+        REQUIRE( value == nullptr );
+
+        REQUIRE_FALSE( transaction.lookup("3", &value, &len) );
+    }
+
+    SECTION( "applying the buffer writes only the last value of every key" ) {
+        REQUIRE( transaction.apply(mock) );
+        REQUIRE( transaction.empty() );
+
+        REQUIRE( mock.writes == 2 );
+        REQUIRE( mock.kvmap["0"] == std::vector<uint8_t>(v1, v1 + sizeof(v1)) );
+        REQUIRE( mock.kvmap["1"] == std::vector<uint8_t>(v0, v0 + sizeof(v0)) );
+        REQUIRE_FALSE( mock.exists("2") );
+    }
+
+    SECTION( "discarding the buffer leaves the store untouched" ) {
+        transaction.discard();
+
+        REQUIRE( transaction.empty() );
+        REQUIRE( transaction.apply(mock) );
+        REQUIRE( mock.writes == 0 );
+        REQUIRE( mock.exists("2") );
+    }
+
+    SECTION( "buffered puts on keys starting with a prefix are turned into removals" ) {
+        REQUIRE( transaction.put("10", v0, sizeof(v0)) );
+
+        REQUIRE( transaction.removePrefix("1") == 2 );
+        REQUIRE( transaction.removePrefix("1") == 0 );
+
+        REQUIRE( transaction.lookup("10", &value, &len) );
+        REQUIRE( value == nullptr );
+
+        REQUIRE( transaction.lookup("0", &value, &len) );
+        REQUIRE( value != nullptr );
+    }
+
+    SECTION( "a clear hides all the keys that are not put again" ) {
+        transaction.clear();
+        REQUIRE( transaction.put("1", v1, sizeof(v1)) );
+
+        REQUIRE( transaction.lookup("2", &value, &len) );
+        REQUIRE( value == nullptr );
+
+        REQUIRE( transaction.apply(mock) );
+        REQUIRE( mock.kvmap.size() == 1 );
+        REQUIRE( mock.kvmap["1"] == std::vector<uint8_t>(v1, v1 + sizeof(v1)) );
+    }
+}
+
+// store that refuses to write a key
+class FailingKVStore: public MockKVStore {
+public:
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override {
+        return strcmp(key, "1") == 0 ? -1 : MockKVStore::putBytes(key, b, s);
+    }
+
+    res_t remove(const key_t& key) override {
+        return strcmp(key, "r") == 0 ? -1 : MockKVStore::remove(key);
+    }
+};
+
+TEST_CASE( "TransactionBuffer stops applying the operations at the first failure", "[transaction][failure]" ) {
+    FailingKVStore store;
+    TransactionBuffer transaction;
+    uint8_t v[] = { 0x55 };
+    size_t applied = 0;
+
+    SECTION( "a failed put drops the following operations" ) {
+        REQUIRE( transaction.put("0", v, sizeof(v)) );
+        REQUIRE( transaction.put("1", v, sizeof(v)) );
+        REQUIRE( transaction.put("2", v, sizeof(v)) );
+
+        REQUIRE_FALSE( transaction.apply(store, &applied) );
+        REQUIRE( applied == 1 );
+        REQUIRE( store.exists("0") );
+        REQUIRE_FALSE( store.exists("2") );
+        REQUIRE( transaction.empty() );
+    }
+
+    SECTION( "a failed remove is reported, a missing key is not" ) {
+        transaction.clear();
+        REQUIRE( transaction.remove("missing") );
+        REQUIRE( transaction.remove("r") );
+        REQUIRE( transaction.put("0", v, sizeof(v)) );
+
+        REQUIRE_FALSE( transaction.apply(store, &applied) );
+        REQUIRE( applied == 2 );
+        REQUIRE_FALSE( store.exists("0") );
+    }
+}
@@ -10,6 +10,7 @@
 
 #pragma once
 #include "kvstore/kvstore.h"
+#include "kvstore/implementation/ram.h"
 
 #if defined(ARDUINO_UNOR4_WIFI)
 #include "kvstore/implementation/UnoR4.h"
@@ -40,6 +41,17 @@ using KVStore = NinaKVStore;
 
 using KVStore = ESP32KVStore;
 
+#elif defined(__linux__)
+
+#include "kvstore/implementation/file.h"
+
+using KVStore = FileKVStore;
+
+#elif !defined(ARDUINO)
+
+// hosts without a persistent backend get a volatile store
+using KVStore = RamKVStore;
+
 #else
 #error "Arduino KVStore is not supported on current platform"
 #endif
@@ -0,0 +1,534 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "cached.h"
+
+CachedKVStore::CachedKVStore(KVStoreInterface& store, size_t maxEntries, size_t maxBytes)
+: KVStoreDecorator(store), maxEntries(maxEntries), maxBytes(maxBytes),
+  entries(new entry_t[maxEntries]), head(nullptr), tail(nullptr), bytes(0),
+  batch(new Entry[maxEntries]) {
+    for(size_t i=0; i<maxEntries; i++) {
+        entries[i].key = nullptr;
+        entries[i].value = nullptr;
+    }
+}
+
+CachedKVStore::~CachedKVStore() {
+    flush();
+    invalidate();
+
+    delete [] entries;
+    delete [] batch;
+}
+
+bool CachedKVStore::end() {
+    bool res = flush();
+
+    return store.end() && res;
+}
+
+bool CachedKVStore::clear() {
+    invalidate();
+
+    return store.clear();
+}
+
+typename KVStoreInterface::res_t CachedKVStore::remove(const key_t& key) {
+    entry_t* e = find(key);
+    bool dirty = e != nullptr && e->dirty;
+
+    if(e != nullptr) {
+        release(e);
+    }
+
+    res_t res = store.remove(key);
+
+    // a dirty entry may have never reached the wrapped store, removing it from the cache is enough
+    return dirty && res <= 0 ? 1 : res;
+}
+
+bool CachedKVStore::exists(const key_t& key) const {
+    return find(key) != nullptr || store.exists(key);
+}
+
+typename KVStoreInterface::res_t CachedKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    if(key == nullptr || b == nullptr || s == 0) {
+        return 0;
+    }
+
+    return update(key, b, s, PT_BLOB, true);
+}
+
+typename KVStoreInterface::res_t CachedKVStore::getBytes(const key_t& key, uint8_t b[], size_t s) const {
+    entry_t* e = find(key);
+
+    if(e != nullptr) {
+        unlink(e);
+        pushFront(e);
+
+        if(e->len > s) {
+            return 0;
+        }
+
+        memcpy(b, e->value, e->len);
+        return e->len;
+    }
+
+    res_t res = store.getBytes(key, b, s);
+
+    if(res > 0 && (size_t)res <= s) {
+        insert(key, b, res, PT_BLOB, false);
+    }
+
+    return res;
+}
+
+size_t CachedKVStore::getBytesLength(const key_t& key) const {
+    entry_t* e = find(key);
+
+    return e != nullptr ? e->len : store.getBytesLength(key);
+}
+
+typename KVStoreInterface::View CachedKVStore::getView(const key_t& key) const {
+    entry_t* e = find(key);
+
+    if(e == nullptr) {
+        View view = store.getView(key);
+
+        // values already in RAM in the wrapped store are not duplicated
+        if(view.data != nullptr) {
+            return view;
+        }
+
+        size_t len = store.getBytesLength(key);
+        if(len == 0 || key.length() + len + 2 > maxBytes) {
+            return { nullptr, 0 };
+        }
+
+        // the value is copied once in the cache, following views will not need any copy
+        uint8_t* value = new uint8_t[len];
+        res_t res = store.getBytes(key, value, len);
+
+        if(res > 0 && (size_t)res == len) {
+            e = insert(key, value, len, PT_BLOB, false);
+        }
+        delete [] value;
+
+        if(e == nullptr) {
+            return { nullptr, 0 };
+        }
+    }
+
+    unlink(e);
+    pushFront(e);
+
+    return { e->value, e->len };
+}
+
+bool CachedKVStore::openWrite(const key_t& key, size_t totalSize) {
+    entry_t* e = find(key);
+
+    // the streamed value replaces the cached one
+    if(e != nullptr) {
+        release(e);
+    }
+
+    return store.openWrite(key, totalSize);
+}
+
+size_t CachedKVStore::openRead(const key_t& key) {
+    entry_t* e = find(key);
+
+    if(e != nullptr && e->dirty && !writeBack(e)) {
+        return 0;
+    }
+
+    return store.openRead(key);
+}
+
+bool CachedKVStore::beginTransaction() {
+    // entries dirtied before the transaction must not be affected by a rollback
+    if(!flush()) {
+        return false;
+    }
+
+    return store.beginTransaction();
+}
+
+bool CachedKVStore::commit() {
+    bool res = flush();
+
+    return store.commit() && res;
+}
+
+bool CachedKVStore::rollback() {
+    // also clean entries may have been loaded from values buffered by the transaction in the wrapped store
+    invalidate();
+
+    return store.rollback();
+}
+
+typename KVStoreInterface::res_t CachedKVStore::removePrefix(const char* prefix) {
+    if(prefix == nullptr) {
+        return 0;
+    }
+
+    size_t len = strlen(prefix);
+    res_t pending = 0;
+
+    // dirty entries that never reached the wrapped store are not counted by it
+    for(entry_t* e = head; e != nullptr; e = e->next) {
+        if(e->dirty && strncmp(e->key, prefix, len) == 0 && !store.exists(e->key)) {
+            pending++;
+        }
+    }
+
+    res_t res = store.removePrefix(prefix);
+
+    if(res < 0) {
+        return res;
+    }
+
+    entry_t* e = head;
+    while(e != nullptr) {
+        entry_t* next = e->next;
+
+        if(strncmp(e->key, prefix, len) == 0) {
+            release(e);
+        }
+        e = next;
+    }
+
+    return res + pending;
+}
+
+bool CachedKVStore::flush() {
+    // deferred references write their values in the cache first
+    bool res = KVStoreInterface::flush();
+    size_t count = 0;
+
+    for(entry_t* e = head; e != nullptr; e = e->next) {
+        if(e->dirty) {
+            batch[count++] = { e->key, e->value, e->len, e->type, 0 };
+        }
+    }
+
+    if(count > 0) {
+        res = store.putMany(batch, count) == count && res;
+
+        // entries that could not be written stay dirty and will be written back at the next flush
+        for(size_t i=0; i<count; i++) {
+            if(batch[i].res > 0) {
+                find(batch[i].key)->dirty = false;
+            }
+        }
+    }
+
+    return store.flush() && res;
+}
+
+void CachedKVStore::invalidate() {
+    while(head != nullptr) {
+        release(head);
+    }
+}
+
+typename KVStoreInterface::res_t CachedKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(key == nullptr) {
+        return 0;
+    }
+
+    return update(key, value, len, t, false);
+}
+
+typename KVStoreInterface::res_t CachedKVStore::_get(const key_t& key, uint8_t value[], size_t len, Type t) {
+    entry_t* e = find(key);
+
+    if(e != nullptr) {
+        unlink(e);
+        pushFront(e);
+
+        size_t n = 0;
+        if(t == PT_STR) {
+            n = e->len < len ? e->len : len-1;
+            value[n] = '\0';
+        } else {
+            n = e->len < len ? e->len : len;
+        }
+        memcpy(value, e->value, n);
+
+        return n;
+    }
+
+    res_t res = KVStoreDecorator::_get(key, value, len, t);
+
+    // cache the value only when we are sure that it has been read completely
+    if(res > 0 && t == PT_STR && strlen((char*)value) + 1 < len) {
+        insert(key, value, strlen((char*)value), t, false);
+    } else if(res > 0 && t != PT_STR && (size_t)res == len) {
+        insert(key, value, len, t, false);
+    }
+
+    return res;
+}
+
+typename KVStoreInterface::Status CachedKVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    entry_t* e = find(key);
+
+    if(e != nullptr) {
+        unlink(e);
+        pushFront(e);
+
+        if(t == PT_STR || t == PT_BLOB) {
+            _get(key, value, len, t);
+            return ST_FOUND;
+        }
+
+        if(e->type == t && e->len == len) {
+            memcpy(value, e->value, len);
+            return ST_FOUND;
+        } else if(e->dirty) {
+            return ST_TYPE_MISMATCH;
+        }
+
+        // a clean entry loaded as bytes does not know the type stored, the wrapped store is asked
+        release(e);
+    }
+
+    Status res = KVStoreDecorator::_tryGet(key, value, len, t);
+
+    if(res == ST_FOUND && t != PT_STR && t != PT_BLOB) {
+        insert(key, value, len, t, false);
+    }
+
+    return res;
+}
+
+typename KVStoreInterface::res_t CachedKVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    struct context_t {
+        const CachedKVStore* cache;
+        KeyCallback callback;
+        void* arg;
+        bool stopped;
+    } ctx = { this, callback, arg, false };
+
+    // dirty entries may hold a size that is different from the one in the wrapped store
+    res_t res = KVStoreDecorator::_forEach([](const KeyInfo& info, void* arg) {
+        context_t* ctx = (context_t*)arg;
+        entry_t* e = ctx->cache->find(info.key);
+
+        KeyInfo i = info;
+        if(e != nullptr && e->dirty) {
+            i.size = e->len;
+        }
+
+        ctx->stopped = !ctx->callback(i, ctx->arg);
+        return !ctx->stopped;
+    }, &ctx, sizes);
+
+    if(res < 0 || ctx.stopped) {
+        return res;
+    }
+
+    // dirty entries that were never written back are not known by the wrapped store
+    for(entry_t* e = head; e != nullptr; e = e->next) {
+        if(e->dirty && !store.exists(e->key)) {
+            res++;
+
+            if(!callback({ e->key, e->type, e->len }, arg)) {
+                break;
+            }
+        }
+    }
+
+    return res;
+}
+
+typename CachedKVStore::entry_t* CachedKVStore::find(const key_t& key) const {
+    if(key == nullptr) {
+        return nullptr;
+    }
+
+    for(entry_t* e = head; e != nullptr; e = e->next) {
+        if(e->key.hash() == key.hash() && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+
+    return nullptr;
+}
+
+typename KVStoreInterface::res_t CachedKVStore::update(const key_t& key, const uint8_t value[], size_t len, Type t, bool bytes) {
+    entry_t* e = find(key);
+
+    if(e != nullptr && e->len == len) {
+        // the value may come from a view over the entry itself
+        memmove(e->value, value, len);
+        e->type = t;
+        e->dirty = true;
+
+        unlink(e);
+        pushFront(e);
+        return len;
+    }
+
+    // the key and the value may come from an entry that is released or evicted below, they are copied first
+    size_t keyLen = key.length();
+    char* keyCopy = new char[keyLen + 1];
+    memcpy(keyCopy, key, keyLen + 1);
+
+    uint8_t* copy = new uint8_t[len + 1];
+    memcpy(copy, value, len);
+    copy[len] = '\0';
+
+    if(e != nullptr) {
+        release(e);
+    }
+
+    if(adopt(keyCopy, copy, len, t, true) != nullptr) {
+        return len;
+    }
+
+    // the value does not fit the cache and is written through
+    res_t res = bytes ? store.putBytes(keyCopy, copy, len) : KVStoreDecorator::_put(keyCopy, copy, len, t);
+
+    delete [] keyCopy;
+    delete [] copy;
+
+    return res;
+}
+
+typename CachedKVStore::entry_t* CachedKVStore::insert(const key_t& key, const uint8_t value[], size_t len, Type t, bool dirty) const {
+    size_t keyLen = key.length();
+
+    if(keyLen + len + 2 > maxBytes || maxEntries == 0) {
+        return nullptr;
+    }
+
+    char* keyCopy = new char[keyLen + 1];
+    memcpy(keyCopy, key, keyLen + 1);
+
+    // values are always null terminated, in order to be able to write back strings as they are
+    uint8_t* copy = new uint8_t[len + 1];
+    memcpy(copy, value, len);
+    copy[len] = '\0';
+
+    entry_t* e = adopt(keyCopy, copy, len, t, dirty);
+
+    if(e == nullptr) {
+        delete [] keyCopy;
+        delete [] copy;
+    }
+
+    return e;
+}
+
+typename CachedKVStore::entry_t* CachedKVStore::adopt(char* key, uint8_t* value, size_t len, Type t, bool dirty) const {
+    size_t size = strlen(key) + len + 2;
+
+    if(size > maxBytes || maxEntries == 0) {
+        return nullptr;
+    }
+
+    entry_t* e = nullptr;
+    for(size_t i=0; i<maxEntries && e == nullptr; i++) {
+        if(entries[i].key == nullptr) {
+            e = &entries[i];
+        }
+    }
+
+    // evict the least recently used entries until both a slot and enough memory are available
+    while(e == nullptr || bytes + size > maxBytes) {
+        entry_t* victim = tail;
+
+        if(!evict(victim)) {
+            return nullptr;
+        }
+
+        if(e == nullptr) {
+            e = victim;
+        }
+    }
+
+    e->key = key;
+    e->value = value;
+    e->len = len;
+    e->type = t;
+    e->dirty = dirty;
+
+    bytes += size;
+    pushFront(e);
+
+    return e;
+}
+
+void CachedKVStore::release(entry_t* e) const {
+    unlink(e);
+
+    bytes -= e->key.length() + e->len + 2;
+
+    delete [] e->key.c_str();
+    delete [] e->value;
+
+    e->key = nullptr;
+    e->value = nullptr;
+}
+
+bool CachedKVStore::evict(entry_t* e) const {
+    if(e->dirty && !writeBack(e)) {
+        return false;
+    }
+
+    release(e);
+
+    return true;
+}
+
+bool CachedKVStore::writeBack(entry_t* e) const {
+    Entry entry = { e->key, e->value, e->len, e->type, 0 };
+
+    if(store.putMany(&entry, 1) != 1) {
+        return false;
+    }
+
+    e->dirty = false;
+
+    return true;
+}
+
+void CachedKVStore::unlink(entry_t* e) const {
+    if(e->prev != nullptr) {
+        e->prev->next = e->next;
+    } else {
+        head = e->next;
+    }
+
+    if(e->next != nullptr) {
+        e->next->prev = e->prev;
+    } else {
+        tail = e->prev;
+    }
+
+    e->prev = nullptr;
+    e->next = nullptr;
+}
+
+void CachedKVStore::pushFront(entry_t* e) const {
+    e->prev = nullptr;
+    e->next = head;
+
+    if(head != nullptr) {
+        head->prev = e;
+    }
+    head = e;
+
+    if(tail == nullptr) {
+        tail = e;
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "decorator.h"
+
+constexpr size_t DEFAULT_CACHE_ENTRIES = 16;
+constexpr size_t DEFAULT_CACHE_BYTES = 512;
+
+/** CachedKVStore class
+ *
+ * Write-back cache that keeps the most recently used keys of the wrapped store in RAM.
+ * The cache is bounded both in the number of entries and in the number of bytes used by keys and values,
+ * when one of the limits is reached the least recently used entry is evicted, writing it back if dirty.
+ * Dirty entries are written back in a single batch when flush() or end() are called.
+ * Values bigger than the memory budget are not cached and are written through to the wrapped store.
+ * Cached values can be accessed without copies with getView, a view is invalidated also by an eviction.
+ */
+class CachedKVStore: public KVStoreDecorator {
+public:
+    CachedKVStore(KVStoreInterface& store, size_t maxEntries=DEFAULT_CACHE_ENTRIES, size_t maxBytes=DEFAULT_CACHE_BYTES);
+    ~CachedKVStore();
+
+    bool end() override;
+    bool clear() override;
+
+    res_t remove(const key_t& key) override;
+    bool exists(const key_t& key) const override;
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
+    size_t getBytesLength(const key_t& key) const override;
+    View getView(const key_t& key) const override;
+
+    // streams bypass the cache, the entry of the key is written back or dropped before they are opened
+    bool openWrite(const key_t& key, size_t totalSize) override;
+    size_t openRead(const key_t& key) override;
+
+    // batches are split by the base implementation into single operations that go through the cache
+    size_t putMany(Entry entries[], size_t count) override  { return KVStoreInterface::putMany(entries, count); }
+    size_t getMany(Entry entries[], size_t count) override  { return KVStoreInterface::getMany(entries, count); }
+
+    bool beginTransaction() override;
+    bool commit() override;
+    bool rollback() override;
+
+    res_t removePrefix(const char* prefix) override;
+
+    /**
+     * @brief write back all the dirty entries to the wrapped store in a single batch
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool flush() override;
+
+    /**
+     * @brief drop all the entries from the cache, dirty entries are lost
+     */
+    void invalidate();
+
+    /**
+     * @brief get the number of bytes currently used by the cached keys and values
+     */
+    inline size_t size() const { return bytes; }
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+    res_t _get(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
+
+    // the keys are filtered from _forEach, in order to include the dirty entries
+    res_t _scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const override {
+        return KVStoreInterface::_scanPrefix(prefix, callback, arg, sizes);
+    }
+
+private:
+    typedef struct entry {
+        key_t key; // copy owned by the entry, its hash is compared before the string
+        uint8_t* value;
+        size_t len;
+        Type type;
+        bool dirty;
+
+        struct entry* prev;
+        struct entry* next;
+    } entry_t;
+
+    entry_t* find(const key_t& key) const;
+    // put a dirty value, writing it through when it does not fit the cache
+    res_t update(const key_t& key, const uint8_t value[], size_t len, Type t, bool bytes);
+
+    // insert a copy of the key and the value, nullptr if they do not fit
+    entry_t* insert(const key_t& key, const uint8_t value[], size_t len, Type t, bool dirty) const;
+
+    // insert the key and the value, the entry takes their ownership only if it is returned
+    entry_t* adopt(char* key, uint8_t* value, size_t len, Type t, bool dirty) const;
+    void release(entry_t* e) const;
+    bool evict(entry_t* e) const;
+    bool writeBack(entry_t* e) const;
+
+    void unlink(entry_t* e) const;
+    void pushFront(entry_t* e) const;
+
+    const size_t maxEntries;
+    const size_t maxBytes;
+
+    // the cache is populated also by const getters, thus its state is mutable
+    mutable entry_t* entries;
+    mutable entry_t* head; // most recently used
+    mutable entry_t* tail; // least recently used
+    mutable size_t bytes;
+
+    Entry* batch;
+};
@@ -0,0 +1,210 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "compressed.h"
+
+constexpr uint8_t CompressedKVStore::HEADER_MAGIC;
+constexpr size_t CompressedKVStore::HEADER_SIZE;
+
+CompressedKVStore::CompressedKVStore(KVStoreInterface& store, size_t threshold, size_t maxSize)
+: KVStoreDecorator(store), threshold(threshold),
+  maxSize(maxSize < LZ_MAX_INPUT_SIZE ? maxSize : LZ_MAX_INPUT_SIZE),
+  work(new uint8_t[HEADER_SIZE + this->maxSize]), table(new uint16_t[LZ_HASH_SIZE]) { }
+
+CompressedKVStore::~CompressedKVStore() {
+    delete [] work;
+    delete [] table;
+}
+
+typename KVStoreInterface::res_t CompressedKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    // the mode is checked here, since the wrapped store is written through _put
+    if(skipPut(key, b, s, PT_BLOB)) {
+        return s;
+    }
+
+    return encode(key, b, s, PT_BLOB);
+}
+
+typename KVStoreInterface::res_t CompressedKVStore::getBytes(const key_t& key, uint8_t b[], size_t s) const {
+    header_t header;
+    size_t stored;
+
+    if(load(key, &header, &stored)) {
+        return decode(header, stored, b, s);
+    }
+
+    if(stored == 0) {
+        return KVStoreDecorator::getBytes(key, b, s);
+    }
+
+    // a plain value has already been read in the work buffer
+    memcpy(b, work, s < stored ? s : stored);
+
+    return stored;
+}
+
+size_t CompressedKVStore::getBytesLength(const key_t& key) const {
+    header_t header;
+    size_t stored;
+
+    if(load(key, &header, &stored)) {
+        return header.len;
+    }
+
+    return stored > 0 ? stored : KVStoreDecorator::getBytesLength(key);
+}
+
+typename KVStoreInterface::View CompressedKVStore::getView(const key_t& key) const {
+    View view = KVStoreDecorator::getView(key);
+    header_t header;
+
+    if(view.data != nullptr && parse(view.data, view.len, &header)) {
+        return { nullptr, 0 };
+    }
+
+    return view;
+}
+
+typename KVStoreInterface::res_t CompressedKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(t != PT_BLOB && t != PT_STR) {
+        return KVStoreDecorator::_put(key, value, len, t);
+    }
+
+    return encode(key, value, len, t);
+}
+
+typename KVStoreInterface::res_t CompressedKVStore::_get(const key_t& key, uint8_t value[], size_t len, Type t) {
+    header_t header;
+    size_t stored;
+
+    if((t != PT_BLOB && t != PT_STR) || !load(key, &header, &stored)) {
+        return KVStoreDecorator::_get(key, value, len, t);
+    }
+
+    if(header.type != t || len == 0) {
+        return -1;
+    }
+
+    // strings are terminated, as the wrapped store does
+    if(t == PT_STR) {
+        res_t res = decode(header, stored, value, len - 1);
+        value[res > 0 && (size_t)res < len ? res : len - 1] = '\0';
+
+        return res;
+    }
+
+    return decode(header, stored, value, len);
+}
+
+typename KVStoreInterface::Status CompressedKVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    header_t header;
+    size_t stored;
+
+    if((t != PT_BLOB && t != PT_STR) || !load(key, &header, &stored)) {
+        return KVStoreDecorator::_tryGet(key, value, len, t);
+    }
+
+    if(header.type != t) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    return _get(key, value, len, t) > 0 ? ST_FOUND : ST_ERROR;
+}
+
+typename KVStoreInterface::res_t CompressedKVStore::encode(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(value == nullptr || len == 0) {
+        return KVStoreDecorator::_put(key, value, len, t);
+    }
+
+    size_t stored = 0;
+    Method method = METHOD_LZ;
+
+    // the compressed value is kept only when it saves at least one byte, including the header
+    if(len >= threshold && len <= maxSize && len > HEADER_SIZE + 1) {
+        stored = lzCompress(value, len, work + HEADER_SIZE, len - HEADER_SIZE - 1, table);
+    }
+
+    // a plain value that starts as a header is wrapped in one, in order not to be decoded when it is read
+    if(stored == 0 && value[0] == HEADER_MAGIC && len <= maxSize) {
+        memcpy(work + HEADER_SIZE, value, len);
+        stored = len;
+        method = METHOD_STORED;
+    }
+
+    // a bigger one cannot be wrapped: it is refused if it would be decoded as the wrapped value it looks like
+    header_t header;
+    if(stored == 0 && len <= HEADER_SIZE + maxSize && parse(value, len, &header)) {
+        return -1;
+    }
+
+    if(stored == 0) {
+        return KVStoreDecorator::_put(key, value, len, t);
+    }
+
+    uint32_t original = len;
+    work[0] = HEADER_MAGIC;
+    work[1] = method;
+    work[2] = t;
+    memcpy(work + 3, &original, sizeof(original));
+
+    res_t res = KVStoreDecorator::_put(key, work, HEADER_SIZE + stored, PT_BLOB);
+
+    return res > 0 ? (res_t)len : res;
+}
+
+bool CompressedKVStore::load(const key_t& key, header_t* header, size_t* stored) const {
+    size_t len = KVStoreDecorator::getBytesLength(key);
+    *stored = 0;
+
+    if(len == 0 || len > HEADER_SIZE + maxSize || KVStoreDecorator::getBytes(key, work, len) != (res_t)len) {
+        return false;
+    }
+
+    *stored = len;
+
+    return parse(work, len, header);
+}
+
+bool CompressedKVStore::parse(const uint8_t data[], size_t stored, header_t* header) const {
+    if(stored < HEADER_SIZE || data[0] != HEADER_MAGIC) {
+        return false;
+    }
+
+    uint32_t original;
+    memcpy(&original, data + 3, sizeof(original));
+
+    header->method = (Method)data[1];
+    header->type = (Type)data[2];
+    header->len = original;
+
+    if(header->type != PT_BLOB && header->type != PT_STR) {
+        return false;
+    }
+
+    // a stored value has exactly the size written in the header, a compressed one is smaller
+    switch(header->method) {
+    case METHOD_STORED:
+        return header->len == stored - HEADER_SIZE && header->len <= maxSize;
+    case METHOD_LZ:
+        return header->len > stored - HEADER_SIZE && header->len <= maxSize;
+    default:
+        return false;
+    }
+}
+
+typename KVStoreInterface::res_t CompressedKVStore::decode(const header_t& header, size_t stored, uint8_t value[], size_t len) const {
+    if(header.method == METHOD_STORED) {
+        memcpy(value, work + HEADER_SIZE, len < header.len ? len : header.len);
+        return header.len;
+    }
+
+    int32_t res = lzDecompress(work + HEADER_SIZE, stored - HEADER_SIZE, value, len);
+
+    return res == (int32_t)header.len ? (res_t)res : -1;
+}
@@ -0,0 +1,92 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "decorator.h"
+#include "../utility/lz.h"
+
+constexpr size_t DEFAULT_COMPRESSION_THRESHOLD = 64;
+constexpr size_t DEFAULT_COMPRESSION_MAX_SIZE = 4096;
+
+/** CompressedKVStore class
+ *
+ * Decorator that compresses the blobs and the strings at least as big as a threshold with the LZ codec,
+ * in order to write fewer bytes to the flash. A compressed value is prefixed by a header with a marker,
+ * its type and its original size, and it is stored as a blob. Values without the header are read as they are,
+ * thus the values written before the decorator was introduced are still readable. Values that do not shrink
+ * are stored as they are. A plain value that starts as a header is wrapped in one, a value too big to be
+ * wrapped whose beginning would be decoded as a valid header of its own size is refused.
+ *
+ * All the memory is allocated once by the constructor: a work buffer of maxSize bytes plus the header and
+ * the hash table of the compressor. Values bigger than maxSize are never compressed.
+ * Reading a compressed value needs to read it from the wrapped store first, getBytesLength included.
+ * Views of compressed values are not available and the sizes reported by forEach are the stored ones.
+ * The work buffer is shared, the decorator cannot be used from multiple threads.
+ */
+class CompressedKVStore: public KVStoreDecorator {
+public:
+    CompressedKVStore(KVStoreInterface& store, size_t threshold=DEFAULT_COMPRESSION_THRESHOLD,
+        size_t maxSize=DEFAULT_COMPRESSION_MAX_SIZE);
+    ~CompressedKVStore();
+
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
+    size_t getBytesLength(const key_t& key) const override;
+    View getView(const key_t& key) const override;
+
+    // streams and batches are handled by the base implementation, that goes through the codec
+    bool openWrite(const key_t& key, size_t totalSize) override         { return KVStoreInterface::openWrite(key, totalSize); }
+    res_t write(const uint8_t chunk[], size_t len) override             { return KVStoreInterface::write(chunk, len); }
+    bool finalize() override                                            { return KVStoreInterface::finalize(); }
+    size_t openRead(const key_t& key) override                          { return KVStoreInterface::openRead(key); }
+    res_t read(uint8_t chunk[], size_t len, size_t offset) override     { return KVStoreInterface::read(chunk, len, offset); }
+    void closeRead() override                                           { KVStoreInterface::closeRead(); }
+
+    size_t putMany(Entry entries[], size_t count) override  { return KVStoreInterface::putMany(entries, count); }
+    size_t getMany(Entry entries[], size_t count) override  { return KVStoreInterface::getMany(entries, count); }
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+    res_t _get(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+
+private:
+    static constexpr uint8_t HEADER_MAGIC = 0xC5;
+    static constexpr size_t HEADER_SIZE = 7; // magic, method, type, original size
+
+    enum Method: uint8_t {
+        METHOD_STORED = 0,  // a value that would be mistaken for a compressed one is stored with a header
+        METHOD_LZ = 1,
+    };
+
+    typedef struct {
+        Method method;
+        Type type;
+        size_t len;     // original size
+    } header_t;
+
+    // write the value in the store, compressed when it is worth it
+    res_t encode(const key_t& key, const uint8_t value[], size_t len, Type t);
+
+    // read the stored value in the work buffer, stored is 0 when it does not fit the buffer.
+    // Returns true if the value has a header
+    bool load(const key_t& key, header_t* header, size_t* stored) const;
+
+    bool parse(const uint8_t data[], size_t stored, header_t* header) const;
+
+    // decode the value in the work buffer to the caller buffer, returns the original size or -1 if it is corrupted
+    res_t decode(const header_t& header, size_t stored, uint8_t value[], size_t len) const;
+
+    const size_t threshold;
+    const size_t maxSize;
+
+    uint8_t* work;
+    uint16_t* table;
+};
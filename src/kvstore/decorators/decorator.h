@@ -0,0 +1,93 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "../kvstore.h"
+
+/** KVStoreDecorator class
+ *
+ * Base class for the KV stores that wrap another KVStoreInterface and add some behaviour on top of it.
+ * Every method is forwarded to the wrapped store, a decorator is required to override only
+ * the methods it wants to change
+ */
+class KVStoreDecorator: public KVStoreInterface {
+public:
+    KVStoreDecorator(KVStoreInterface& store): store(store) {}
+
+    bool begin() override                                                   { return store.begin(); }
+    bool end() override                                                     { return store.end(); }
+    bool clear() override                                                   { return store.clear(); }
+
+    res_t remove(const key_t& key) override                                 { return store.remove(key); }
+    bool exists(const key_t& key) const override                            { return store.exists(key); }
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override  { return store.putBytes(key, b, s); }
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override  { return store.getBytes(key, b, s); }
+    size_t getBytesLength(const key_t& key) const override                  { return store.getBytesLength(key); }
+    View getView(const key_t& key) const override                           { return store.getView(key); }
+
+    bool openWrite(const key_t& key, size_t totalSize) override             { return store.openWrite(key, totalSize); }
+    res_t write(const uint8_t chunk[], size_t len) override                 { return store.write(chunk, len); }
+    bool finalize() override                                                { return store.finalize(); }
+    size_t openRead(const key_t& key) override                              { return store.openRead(key); }
+    res_t read(uint8_t chunk[], size_t len, size_t offset) override         { return store.read(chunk, len, offset); }
+    void closeRead() override                                               { store.closeRead(); }
+
+    size_t putMany(Entry entries[], size_t count) override                  { return store.putMany(entries, count); }
+    size_t getMany(Entry entries[], size_t count) override                  { return store.getMany(entries, count); }
+
+    bool beginTransaction() override                                        { return store.beginTransaction(); }
+    bool commit() override                                                  { return store.commit(); }
+    bool rollback() override                                                { return store.rollback(); }
+
+    res_t removePrefix(const char* prefix) override                         { return store.removePrefix(prefix); }
+    bool physicalWear(PhysicalWear& wear) const override                    { return store.physicalWear(wear); }
+
+    void setPutIfChanged(bool enable) override {
+        KVStoreInterface::setPutIfChanged(enable);
+        store.setPutIfChanged(enable);
+    }
+
+    // the values of the deferred references to the decorator are written back before flushing the wrapped store
+    bool flush() override {
+        bool res = KVStoreInterface::flush();
+
+        return store.flush() && res;
+    }
+
+    /**
+     * @brief get the store wrapped by this decorator
+     *
+     * @returns the wrapped store
+     */
+    inline KVStoreInterface& getStore() const { return store; }
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override {
+        return store._put(key, value, len, t);
+    }
+
+    res_t _get(const key_t& key, uint8_t value[], size_t len, Type t) override {
+        return store._get(key, value, len, t);
+    }
+
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override {
+        return store._tryGet(key, value, len, t);
+    }
+
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override {
+        return store._forEach(callback, arg, sizes);
+    }
+
+    res_t _scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const override {
+        return store._scanPrefix(prefix, callback, arg, sizes);
+    }
+
+    KVStoreInterface& store;
+};
@@ -0,0 +1,273 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "instrumented.h"
+
+#ifndef ARDUINO
+#include <chrono>
+#endif // ARDUINO
+
+constexpr uint8_t KVStoreStats::BUCKETS;
+constexpr uint8_t KVStoreStats::VERSION;
+constexpr size_t KVStoreStats::MAX_SERIALIZED_SIZE;
+
+void KVStoreStats::reset() {
+    memset(ops, 0, sizeof(ops));
+}
+
+const char* KVStoreStats::name(Operation op) {
+    static const char* const names[OP_COUNT] = {
+        "begin", "put", "get", "exists", "remove", "getBytesLength", "clear"
+    };
+
+    return op < OP_COUNT ? names[op] : "unknown";
+}
+
+uint32_t KVStoreStats::op_t::percentile(uint8_t percent) const {
+    if(calls == 0) {
+        return 0;
+    }
+
+    uint64_t target = ((uint64_t)calls * percent + 99) / 100;
+    uint64_t count = 0;
+
+    for(uint8_t i=0; i<BUCKETS - 1; i++) {
+        count += buckets[i];
+
+        if(count >= target) {
+            return (uint32_t)1 << i;
+        }
+    }
+
+    return maxUs;
+}
+
+static size_t putVarint(uint8_t buffer[], size_t len, size_t offset, uint64_t value) {
+    do {
+        if(offset >= len) {
+            return len + 1;
+        }
+
+        buffer[offset++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+        value >>= 7;
+    } while(value != 0);
+
+    return offset;
+}
+
+static size_t getVarint(const uint8_t buffer[], size_t len, size_t offset, uint64_t& value) {
+    value = 0;
+
+    for(uint8_t shift=0; shift<64; shift+=7) {
+        if(offset >= len) {
+            return len + 1;
+        }
+
+        uint8_t b = buffer[offset++];
+        value |= (uint64_t)(b & 0x7F) << shift;
+
+        if((b & 0x80) == 0) {
+            return offset;
+        }
+    }
+
+    return len + 1;
+}
+
+size_t KVStoreStats::serialize(uint8_t buffer[], size_t len) const {
+    if(buffer == nullptr || len == 0) {
+        return 0;
+    }
+
+    size_t offset = 0;
+    buffer[offset++] = VERSION;
+
+    for(uint8_t i=0; i<OP_COUNT && offset <= len; i++) {
+        const op_t& op = ops[i];
+
+        offset = putVarint(buffer, len, offset, op.calls);
+        if(op.calls == 0) {
+            continue;
+        }
+
+        uint32_t mask = 0;
+        for(uint8_t b=0; b<BUCKETS; b++) {
+            mask |= op.buckets[b] != 0 ? (uint32_t)1 << b : 0;
+        }
+
+        offset = putVarint(buffer, len, offset, op.misses);
+        offset = putVarint(buffer, len, offset, op.bytes);
+        offset = putVarint(buffer, len, offset, op.totalUs);
+        offset = putVarint(buffer, len, offset, op.maxUs);
+        offset = putVarint(buffer, len, offset, mask);
+
+        for(uint8_t b=0; b<BUCKETS; b++) {
+            if(op.buckets[b] != 0) {
+                offset = putVarint(buffer, len, offset, op.buckets[b]);
+            }
+        }
+    }
+
+    return offset <= len ? offset : 0;
+}
+
+bool KVStoreStats::deserialize(const uint8_t buffer[], size_t len) {
+    reset();
+
+    if(buffer == nullptr || len == 0 || buffer[0] != VERSION) {
+        return false;
+    }
+
+    size_t offset = 1;
+    uint64_t value;
+
+    for(uint8_t i=0; i<OP_COUNT && offset <= len; i++) {
+        op_t& op = ops[i];
+
+        offset = getVarint(buffer, len, offset, value);
+        op.calls = value;
+        if(op.calls == 0) {
+            continue;
+        }
+
+        uint64_t mask;
+        offset = getVarint(buffer, len, offset, value);
+        op.misses = value;
+        offset = getVarint(buffer, len, offset, op.bytes);
+        offset = getVarint(buffer, len, offset, op.totalUs);
+        offset = getVarint(buffer, len, offset, value);
+        op.maxUs = value;
+        offset = getVarint(buffer, len, offset, mask);
+
+        for(uint8_t b=0; b<BUCKETS; b++) {
+            if((mask >> b) & 1) {
+                offset = getVarint(buffer, len, offset, value);
+                op.buckets[b] = value;
+            }
+        }
+    }
+
+    if(offset != len) {
+        reset();
+        return false;
+    }
+
+    return true;
+}
+
+#if KVSTORE_INSTRUMENTATION
+
+bool InstrumentedKVStore::begin() {
+    uint32_t start = now();
+    bool res = KVStoreDecorator::begin();
+    record(KVStoreStats::OP_BEGIN, start, 0, !res);
+
+    return res;
+}
+
+bool InstrumentedKVStore::clear() {
+    uint32_t start = now();
+    bool res = KVStoreDecorator::clear();
+    record(KVStoreStats::OP_CLEAR, start, 0, !res);
+
+    return res;
+}
+
+typename KVStoreInterface::res_t InstrumentedKVStore::remove(const key_t& key) {
+    uint32_t start = now();
+    res_t res = KVStoreDecorator::remove(key);
+    record(KVStoreStats::OP_REMOVE, start, 0, res <= 0);
+
+    return res;
+}
+
+bool InstrumentedKVStore::exists(const key_t& key) const {
+    uint32_t start = now();
+    bool res = KVStoreDecorator::exists(key);
+    record(KVStoreStats::OP_EXISTS, start, 0, !res);
+
+    return res;
+}
+
+typename KVStoreInterface::res_t InstrumentedKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    uint32_t start = now();
+    res_t res = KVStoreDecorator::putBytes(key, b, s);
+    record(KVStoreStats::OP_PUT, start, res > 0 ? res : 0, res <= 0);
+
+    return res;
+}
+
+typename KVStoreInterface::res_t InstrumentedKVStore::getBytes(const key_t& key, uint8_t b[], size_t s) const {
+    uint32_t start = now();
+    res_t res = KVStoreDecorator::getBytes(key, b, s);
+    record(KVStoreStats::OP_GET, start, res > 0 ? res : 0, res <= 0);
+
+    return res;
+}
+
+size_t InstrumentedKVStore::getBytesLength(const key_t& key) const {
+    uint32_t start = now();
+    size_t res = KVStoreDecorator::getBytesLength(key);
+    record(KVStoreStats::OP_GET_BYTES_LENGTH, start, 0, res == 0);
+
+    return res;
+}
+
+typename KVStoreInterface::res_t InstrumentedKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    uint32_t start = now();
+    res_t res = KVStoreDecorator::_put(key, value, len, t);
+    record(KVStoreStats::OP_PUT, start, res > 0 ? res : 0, res <= 0);
+
+    return res;
+}
+
+typename KVStoreInterface::res_t InstrumentedKVStore::_get(const key_t& key, uint8_t value[], size_t len, Type t) {
+    uint32_t start = now();
+    res_t res = KVStoreDecorator::_get(key, value, len, t);
+    record(KVStoreStats::OP_GET, start, res > 0 ? res : 0, res <= 0);
+
+    return res;
+}
+
+typename KVStoreInterface::Status InstrumentedKVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    uint32_t start = now();
+    Status res = KVStoreDecorator::_tryGet(key, value, len, t);
+    record(KVStoreStats::OP_GET, start, res == ST_FOUND ? len : 0, res != ST_FOUND);
+
+    return res;
+}
+
+uint32_t InstrumentedKVStore::now() {
+#ifdef ARDUINO
+    return micros();
+#else
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif // ARDUINO
+}
+
+void InstrumentedKVStore::record(KVStoreStats::Operation op, uint32_t start, size_t bytes, bool miss) const {
+    // the difference is correct also when the microseconds counter wraps around
+    uint32_t elapsed = now() - start;
+    KVStoreStats::op_t& s = stats.ops[op];
+
+    uint8_t bucket = 0;
+    while(bucket < KVStoreStats::BUCKETS - 1 && (elapsed >> bucket) != 0) {
+        bucket++;
+    }
+
+    s.calls++;
+    s.misses += miss ? 1 : 0;
+    s.bytes += bytes;
+    s.totalUs += elapsed;
+    s.maxUs = elapsed > s.maxUs ? elapsed : s.maxUs;
+    s.buckets[bucket]++;
+}
+
+#endif // KVSTORE_INSTRUMENTATION
@@ -0,0 +1,138 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "decorator.h"
+
+/*
+ * define KVSTORE_INSTRUMENTATION to 0 to compile the instrumentation out, InstrumentedKVStore then
+ * only forwards the calls to the wrapped store and its snapshots are always empty
+ */
+#ifndef KVSTORE_INSTRUMENTATION
+#define KVSTORE_INSTRUMENTATION 1
+#endif // KVSTORE_INSTRUMENTATION
+
+/** KVStoreStats struct
+ *
+ * Snapshot of the counters recorded by InstrumentedKVStore for every operation.
+ * Latencies are kept in log2 buckets of microseconds: bucket 0 counts the calls faster than 1us,
+ * bucket i the calls in [2^(i-1), 2^i) us and the last bucket all the slower ones
+ */
+struct KVStoreStats {
+    enum Operation: uint8_t {
+        OP_BEGIN, OP_PUT, OP_GET, OP_EXISTS, OP_REMOVE, OP_GET_BYTES_LENGTH, OP_CLEAR,
+        OP_COUNT
+    };
+
+    static constexpr uint8_t BUCKETS = 24;
+    static constexpr uint8_t VERSION = 1;
+
+    struct op_t {
+        uint32_t calls;
+        uint32_t misses;            // key not found or call failed
+        uint64_t bytes;             // bytes written by put, read by get
+        uint64_t totalUs;
+        uint32_t maxUs;
+        uint32_t buckets[BUCKETS];
+
+        /**
+         * @brief upper bound of the latency within which the given percentage of the calls completed
+         *
+         * @param[in] percent   percentage of the calls, 50 for the median
+         *
+         * @returns the upper bound in microseconds of the bucket containing the percentile, 0 without calls
+         */
+        uint32_t percentile(uint8_t percent) const;
+    };
+
+    op_t ops[OP_COUNT];
+
+    void reset();
+
+    /**
+     * @brief name of an operation, as reported by the logs
+     */
+    static const char* name(Operation op);
+
+    /**
+     * @brief serialize the snapshot in a compact binary form: a version byte followed, for every operation,
+     *        by the number of calls and, when there are calls, by misses, bytes, total and max latency,
+     *        a bitmask of the non empty buckets and their counters. All the numbers are varints
+     *
+     * @param[out] buffer   the buffer where the snapshot is written
+     * @param[in]  len      the size of the buffer, MAX_SERIALIZED_SIZE is always enough
+     *
+     * @returns the number of bytes written, 0 if the buffer is too small
+     */
+    size_t serialize(uint8_t buffer[], size_t len) const;
+
+    /**
+     * @brief read a snapshot written by serialize
+     *
+     * @returns true if the buffer contains a valid snapshot, false otherwise
+     */
+    bool deserialize(const uint8_t buffer[], size_t len);
+
+    // a varint takes up to 5 bytes for 32 bit and 10 bytes for 64 bit numbers
+    static constexpr size_t MAX_SERIALIZED_SIZE = 1 + OP_COUNT * (4 * 5 + 2 * 10 + BUCKETS * 5);
+};
+
+/** InstrumentedKVStore class
+ *
+ * Decorator that records, for every call to the wrapped store, call counts, bytes read and written,
+ * misses and a latency histogram of begin, put, get, exists, remove, getBytesLength and clear.
+ * Typed puts and gets are recorded as put and get, the other methods are forwarded without being recorded.
+ * The counters are kept in the object and are never allocated, they are not protected against
+ * concurrent calls from multiple threads.
+ *
+ * InstrumentedKVStore instrumented(store);
+ * ...
+ * KVStoreStats stats = instrumented.snapshot();
+ * size_t len = stats.serialize(buffer, sizeof(buffer));
+ */
+class InstrumentedKVStore: public KVStoreDecorator {
+public:
+    InstrumentedKVStore(KVStoreInterface& store): KVStoreDecorator(store) { reset(); }
+
+#if KVSTORE_INSTRUMENTATION
+    bool begin() override;
+    bool clear() override;
+
+    res_t remove(const key_t& key) override;
+    bool exists(const key_t& key) const override;
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
+    size_t getBytesLength(const key_t& key) const override;
+
+    /**
+     * @brief get a copy of the counters recorded since the construction or the last reset
+     */
+    inline KVStoreStats snapshot() const { return stats; }
+
+    /**
+     * @brief set all the counters to zero
+     */
+    inline void reset() { stats.reset(); }
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+    res_t _get(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+
+private:
+    static uint32_t now();
+    void record(KVStoreStats::Operation op, uint32_t start, size_t bytes, bool miss) const;
+
+    mutable KVStoreStats stats;
+#else
+    inline KVStoreStats snapshot() const { KVStoreStats stats; stats.reset(); return stats; }
+    inline void reset() {}
+#endif // KVSTORE_INSTRUMENTATION
+};
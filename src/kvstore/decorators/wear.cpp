@@ -0,0 +1,212 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "wear.h"
+
+float WearStats::writeAmplification() const {
+    if(!physicalAvailable || physical.programBytes == 0 || bytes == 0) {
+        return 0;
+    }
+
+    return (float)physical.programBytes / bytes;
+}
+
+WearKVStore::WearKVStore(KVStoreInterface& store, char separator)
+: KVStoreDecorator(store), separator(separator) {
+    reset();
+}
+
+typename KVStoreInterface::res_t WearKVStore::remove(const key_t& key) {
+    removes++;
+
+    return KVStoreDecorator::remove(key);
+}
+
+typename KVStoreInterface::res_t WearKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    record(key, s);
+
+    return KVStoreDecorator::putBytes(key, b, s);
+}
+
+bool WearKVStore::openWrite(const key_t& key, size_t totalSize) {
+    record(key, totalSize);
+
+    return KVStoreDecorator::openWrite(key, totalSize);
+}
+
+size_t WearKVStore::putMany(Entry entries[], size_t count) {
+    for(size_t i=0; i<count; i++) {
+        record(entries[i].key, entries[i].len);
+    }
+
+    return KVStoreDecorator::putMany(entries, count);
+}
+
+typename KVStoreInterface::res_t WearKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    record(key, len);
+
+    return KVStoreDecorator::_put(key, value, len, t);
+}
+
+WearStats WearKVStore::wearStats() const {
+    WearStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    stats.writes = writes;
+    stats.removes = removes;
+    stats.bytes = bytes;
+
+    stats.physicalAvailable = store.physicalWear(stats.physical);
+
+    // counters that restarted, e.g. because the store was opened again, are reported from their new start
+    if(stats.physicalAvailable) {
+        PhysicalWear& p = stats.physical;
+
+        p.eraseCount -= p.eraseCount >= baseline.eraseCount ? baseline.eraseCount : 0;
+        p.programBytes -= p.programBytes >= baseline.programBytes ? baseline.programBytes : 0;
+        p.gcCount -= p.gcCount >= baseline.gcCount ? baseline.gcCount : 0;
+    }
+
+    for(size_t i=0; i<topCount; i++) {
+        size_t j = i;
+
+        while(j > 0 && stats.topKeys[j - 1].bytes < top[i].entry.bytes) {
+            stats.topKeys[j] = stats.topKeys[j - 1];
+            j--;
+        }
+        stats.topKeys[j] = top[i].entry;
+    }
+    stats.topCount = topCount;
+
+    memcpy(stats.namespaces, namespaces, sizeof(namespaces));
+    stats.namespaceCount = namespaceCount;
+    stats.otherBytes = otherBytes;
+
+    return stats;
+}
+
+uint32_t WearKVStore::estimate(const key_t& key) const {
+    if(key == nullptr) {
+        return 0;
+    }
+
+    uint32_t res = UINT32_MAX;
+
+    for(size_t i=0; i<WEAR_SKETCH_DEPTH; i++) {
+        uint32_t c = sketch[i][row(key.hash(), i)];
+        res = c < res ? c : res;
+    }
+
+    return res;
+}
+
+void WearKVStore::reset() {
+    memset(sketch, 0, sizeof(sketch));
+    memset(top, 0, sizeof(top));
+    memset(namespaces, 0, sizeof(namespaces));
+
+    topCount = 0;
+    namespaceCount = 0;
+    otherBytes = 0;
+    writes = 0;
+    removes = 0;
+    bytes = 0;
+
+    store.physicalWear(baseline);
+}
+
+void WearKVStore::record(const key_t& key, size_t len) {
+    if(key == nullptr) {
+        return;
+    }
+
+    writes++;
+    bytes += len;
+    recordNamespace(key, len);
+
+    // conservative update: only the counters below the new estimate are raised, which keeps
+    // the overestimation caused by the collisions lower than incrementing all of them
+    uint32_t add = len < UINT32_MAX ? len : UINT32_MAX;
+    uint32_t est = estimate(key);
+    uint32_t target = est < UINT32_MAX - add ? est + add : UINT32_MAX;
+
+    for(size_t i=0; i<WEAR_SKETCH_DEPTH; i++) {
+        uint32_t& c = sketch[i][row(key.hash(), i)];
+        c = c < target ? target : c;
+    }
+
+    // the key is updated if it is already in the list, otherwise it replaces the smallest one
+    top_t* slot = nullptr;
+    top_t* smallest = nullptr;
+
+    for(size_t i=0; i<topCount && slot == nullptr; i++) {
+        if(top[i].hash == key.hash() && strncmp(top[i].entry.name, key, WEAR_NAME_SIZE - 1) == 0) {
+            slot = &top[i];
+        } else if(smallest == nullptr || top[i].entry.bytes < smallest->entry.bytes) {
+            smallest = &top[i];
+        }
+    }
+
+    if(slot == nullptr) {
+        if(topCount < WEAR_TOP_KEYS) {
+            slot = &top[topCount++];
+        } else if(smallest->entry.bytes < target) {
+            slot = smallest;
+        } else {
+            return;
+        }
+
+        strncpy(slot->entry.name, key, WEAR_NAME_SIZE - 1);
+        slot->entry.name[WEAR_NAME_SIZE - 1] = '\0';
+        slot->entry.writes = 0;
+        slot->hash = key.hash();
+    }
+
+    slot->entry.writes++;
+    slot->entry.bytes = target;
+}
+
+void WearKVStore::recordNamespace(const key_t& key, size_t len) {
+    const char* end = strchr(key, separator);
+    size_t nameLen = end != nullptr ? end - key.c_str() : 0;
+
+    nameLen = nameLen < WEAR_NAME_SIZE - 1 ? nameLen : WEAR_NAME_SIZE - 1;
+
+    for(size_t i=0; i<namespaceCount; i++) {
+        if(strncmp(namespaces[i].name, key, nameLen) == 0 && namespaces[i].name[nameLen] == '\0') {
+            namespaces[i].writes++;
+            namespaces[i].bytes += len;
+            return;
+        }
+    }
+
+    if(namespaceCount == WEAR_NAMESPACES) {
+        otherBytes += len;
+        return;
+    }
+
+    WearStats::entry_t& entry = namespaces[namespaceCount++];
+
+    memcpy(entry.name, key, nameLen);
+    entry.name[nameLen] = '\0';
+    entry.writes = 1;
+    entry.bytes = len;
+}
+
+// every row of the sketch uses an independent hash, derived from the hash of the key
+uint32_t WearKVStore::row(uint32_t hash, size_t i) {
+    hash += (uint32_t)i * 0x9E3779B9u;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    return hash % WEAR_SKETCH_WIDTH;
+}
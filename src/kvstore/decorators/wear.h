@@ -0,0 +1,124 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "decorator.h"
+
+constexpr size_t WEAR_SKETCH_WIDTH = 64;
+constexpr size_t WEAR_SKETCH_DEPTH = 4;
+constexpr size_t WEAR_TOP_KEYS = 8;
+constexpr size_t WEAR_NAMESPACES = 8;
+constexpr size_t WEAR_NAME_SIZE = 16; // longer keys and namespaces are truncated in the reports
+constexpr char DEFAULT_NAMESPACE_SEPARATOR = '/';
+
+/** WearStats struct
+ *
+ * Logical writes recorded by WearKVStore together with the physical counters of the wrapped store
+ */
+struct WearStats {
+    typedef struct {
+        char name[WEAR_NAME_SIZE];
+        uint32_t writes;
+        uint64_t bytes;
+    } entry_t;
+
+    uint32_t writes;                            // put calls
+    uint32_t removes;                           // remove calls
+    uint64_t bytes;                             // bytes of the values written by put
+
+    bool physicalAvailable;                     // the wrapped store exposes physical counters
+    KVStoreInterface::PhysicalWear physical;    // erases and programs since the tracking started
+
+    // keys that wrote the most bytes, sorted by bytes. Bytes are an upper bound estimated by the sketch,
+    // writes are counted from when the key entered the list
+    entry_t topKeys[WEAR_TOP_KEYS];
+    size_t topCount;
+
+    // bytes written per namespace, the part of the key before the separator
+    entry_t namespaces[WEAR_NAMESPACES];
+    size_t namespaceCount;
+    uint64_t otherBytes;                        // bytes of the namespaces that did not fit in the table
+
+    /**
+     * @brief bytes programmed on the medium for every byte of value written
+     *
+     * @returns the write amplification, 0 if the physical counters are not available or nothing was written
+     */
+    float writeAmplification() const;
+};
+
+/** WearKVStore class
+ *
+ * Decorator that accounts the bytes written for every key and namespace, in order to find the keys
+ * that are rewritten too often and wear the flash out, with a bounded amount of RAM.
+ * Bytes per key are counted in a count-min sketch with conservative update, the keys with the highest
+ * estimate are kept in a fixed size top-K list. All the memory is part of the object, nothing is allocated.
+ * Writes are recorded when they are issued, also when they are part of a transaction that is rolled back;
+ * streams are recorded when they are opened, with their total size.
+ *
+ * WearKVStore wear(store);
+ * ...
+ * WearStats stats = wear.wearStats();
+ * Serial.println(stats.topKeys[0].name);
+ */
+class WearKVStore: public KVStoreDecorator {
+public:
+    WearKVStore(KVStoreInterface& store, char separator=DEFAULT_NAMESPACE_SEPARATOR);
+
+    res_t remove(const key_t& key) override;
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    bool openWrite(const key_t& key, size_t totalSize) override;
+    size_t putMany(Entry entries[], size_t count) override;
+
+    /**
+     * @brief get the writes recorded since the construction or the last reset, together with
+     *        the physical counters of the wrapped store over the same period
+     */
+    WearStats wearStats() const;
+
+    /**
+     * @brief estimate of the bytes written to a key, it is never lower than the real value
+     */
+    uint32_t estimate(const key_t& key) const;
+
+    /**
+     * @brief clear the recorded writes and restart the physical counters from their current value
+     */
+    void reset();
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+
+private:
+    typedef struct {
+        WearStats::entry_t entry;
+        uint32_t hash;
+    } top_t;
+
+    void record(const key_t& key, size_t len);
+    void recordNamespace(const key_t& key, size_t len);
+    static uint32_t row(uint32_t hash, size_t i);
+
+    const char separator;
+
+    uint32_t sketch[WEAR_SKETCH_DEPTH][WEAR_SKETCH_WIDTH];
+    top_t top[WEAR_TOP_KEYS];
+    size_t topCount;
+
+    WearStats::entry_t namespaces[WEAR_NAMESPACES];
+    size_t namespaceCount;
+    uint64_t otherBytes;
+
+    uint32_t writes;
+    uint32_t removes;
+    uint64_t bytes;
+
+    PhysicalWear baseline;
+};
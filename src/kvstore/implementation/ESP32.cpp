@@ -12,6 +12,7 @@
 #include "ESP32.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "esp_idf_version.h"
 
 using namespace std;
 
@@ -35,7 +36,11 @@ bool ESP32KVStore::begin(const char* name, bool readOnly, const char* partition_
         log_e("nvs_open failed: %s", nvs_error(err));
         return false;
     }
+    this->name = name;
+    _partition = partition_label != NULL ? partition_label : NVS_DEFAULT_PART_NAME;
     _started = true;
+
+    _buildIndex();
     return true;
 }
 
@@ -47,8 +52,13 @@ bool ESP32KVStore::end() {
     if(!_started){
         return false;
     }
+    if(_transaction){
+        commit();
+    }
     nvs_close(_handle);
     _started = false;
+    _index.clear();
+    _indexed = false;
 
     return true;
 }
@@ -62,7 +72,30 @@ bool ESP32KVStore::clear() {
         log_e("nvs_erase_all fail: %s", nvs_error(err));
         return false;
     }
-    err = nvs_commit(_handle);
+    _index.clear();
+    err = _commit();
+    if(err){
+        log_e("nvs_commit fail: %s", nvs_error(err));
+        return false;
+    }
+    return true;
+}
+
+bool ESP32KVStore::beginTransaction() {
+    if(!_started || _readOnly || _transaction){
+        return false;
+    }
+    _transaction = true;
+    return true;
+}
+
+bool ESP32KVStore::commit() {
+    if(!_started || !_transaction){
+        return false;
+    }
+    _transaction = false;
+
+    esp_err_t err = nvs_commit(_handle);
     if(err){
         log_e("nvs_commit fail: %s", nvs_error(err));
         return false;
@@ -70,35 +103,95 @@ bool ESP32KVStore::clear() {
     return true;
 }
 
+bool ESP32KVStore::rollback() {
+    // nvs applies set and erase operations as they are issued, what was written cannot be discarded
+    _transaction = false;
+    return false;
+}
+
+esp_err_t ESP32KVStore::_commit() {
+    // during a transaction the commit is deferred to the call of commit()
+    return _transaction ? ESP_OK : nvs_commit(_handle);
+}
+
 typename KVStoreInterface::res_t ESP32KVStore::remove(const key_t& key) {
     if(!_started || !key || _readOnly){
         return false;
     }
     esp_err_t err = nvs_erase_key(_handle, key);
     if(err){
-        log_e("nvs_erase_key fail: %s %s", key, nvs_error(err));
+        log_e("nvs_erase_key fail: %s %s", key.c_str(), nvs_error(err));
         return false;
     }
-    err = nvs_commit(_handle);
+    index_t* entry = _lookup(key);
+    if(entry != nullptr){
+        entry->type = PT_INVALID;
+    }
+    err = _commit();
     if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+        log_e("nvs_commit fail: %s %s", key.c_str(), nvs_error(err));
         return false;
     }
     return true;
 }
 
+size_t ESP32KVStore::getString(const key_t& key, char value[], size_t maxLen) {
+    size_t len = maxLen;
+    esp_err_t err = ESP_ERR_NVS_INVALID_LENGTH;
+
+    if(value != nullptr && maxLen > 0){
+        value[0] = '\0';
+    }
+    if(!_started || !key){
+        return 0;
+    }
+    if(value != nullptr && maxLen > 0){
+        err = nvs_get_str(_handle, key, value, &len);
+    }
+    // nvs does not read strings partially, the length is asked only when the buffer is too small
+    if(err == ESP_ERR_NVS_INVALID_LENGTH){
+        err = nvs_get_str(_handle, key, NULL, &len);
+    }
+    if(err){
+        return 0;
+    }
+    return len - 1; // nvs counts the terminator
+}
+
+typename KVStoreInterface::res_t ESP32KVStore::removePrefix(const char* prefix) {
+    if(!_started || _readOnly){
+        return -1;
+    }
+    // nvs has no prefix filter, keys are erased one by one and committed once at the end
+    bool transaction = _transaction;
+    _transaction = true;
+    res_t res = KVStoreInterface::removePrefix(prefix);
+    _transaction = transaction;
+
+    esp_err_t err = _commit();
+    if(err){
+        log_e("nvs_commit fail: %s %s", prefix, nvs_error(err));
+        return -1;
+    }
+    return res;
+}
+
 typename KVStoreInterface::res_t ESP32KVStore::putBytes(const key_t& key, const uint8_t value[], size_t len) {
     if(!_started || !key || !value || !len || _readOnly){
         return 0;
     }
+    if(skipPut(key, value, len, PT_BLOB)){
+        return len;
+    }
     esp_err_t err = nvs_set_blob(_handle, key, value, len);
     if(err){
-        log_e("nvs_set_blob fail: %s %s", key, nvs_error(err));
+        log_e("nvs_set_blob fail: %s %s", key.c_str(), nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
+    _updateIndex(key, PT_BLOB, len);
+    err = _commit();
     if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+        log_e("nvs_commit fail: %s %s", key.c_str(), nvs_error(err));
         return 0;
     }
     return len;
@@ -115,7 +208,7 @@ typename KVStoreInterface::res_t ESP32KVStore::getBytes(const key_t& key, uint8_
     }
     esp_err_t err = nvs_get_blob(_handle, key, buf, &len);
     if(err){
-        log_e("nvs_get_blob fail: %s %s", key, nvs_error(err));
+        log_e("nvs_get_blob fail: %s %s", key.c_str(), nvs_error(err));
         return 0;
     }
     return len;
@@ -125,6 +218,217 @@ size_t ESP32KVStore::getBytesLength(const key_t& key) const {
     if(!_started || !key){
         return 0;
     }
+    if(!_indexed){
+        return _probeLength(key);
+    }
+
+    index_t* entry = _lookup(key);
+    if(entry == nullptr){
+        return 0;
+    }
+
+    // the length of strings and blobs is read once and then kept in the index
+    if(entry->len == 0){
+        esp_err_t err = ESP_OK;
+        size_t len = 0;
+        if(entry->type == PT_STR){
+            err = nvs_get_str(_handle, key, NULL, &len);
+        } else {
+            err = nvs_get_blob(_handle, key, NULL, &len);
+        }
+
+        if(err){
+            log_e("nvs_get len fail: %s %s", key.c_str(), nvs_error(err));
+            return 0;
+        }
+        entry->len = len;
+    }
+
+    return entry->len;
+}
+
+bool ESP32KVStore::exists(const key_t& key) const {
+    return getType(key) != PT_INVALID;
+}
+
+bool ESP32KVStore::physicalWear(PhysicalWear& wear) const {
+    memset(&wear, 0, sizeof(wear));
+    nvs_stats_t stats;
+
+    if(nvs_get_stats(_partition, &stats) != ESP_OK){
+        return false;
+    }
+
+    wear.usedEntries = stats.used_entries;
+    wear.freeEntries = stats.free_entries;
+
+    return true;
+}
+
+ESP32KVStore::Type ESP32KVStore::getType(const key_t& key) const {
+    if(!_started || !key || key.length() >= NVS_KEY_NAME_MAX_SIZE){
+        return PT_INVALID;
+    }
+    if(!_indexed){
+        return _probeType(key);
+    }
+
+    index_t* entry = _lookup(key);
+    return entry != nullptr ? entry->type : PT_INVALID;
+}
+
+typename ESP32KVStore::index_t* ESP32KVStore::_lookup(const key_t& key) const {
+    auto range = _index.equal_range(key.hash());
+
+    for(auto it = range.first; it != range.second; it++){
+        if(strcmp(it->second.key, key) == 0){
+            // removed keys are kept in the index, in order not to reallocate them when put again
+            return it->second.type != PT_INVALID ? &it->second : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+static KVStoreInterface::Type fromNvsType(nvs_type_t type) {
+    switch(type) {
+    case NVS_TYPE_I8:   return KVStoreInterface::PT_I8;
+    case NVS_TYPE_U8:   return KVStoreInterface::PT_U8;
+    case NVS_TYPE_I16:  return KVStoreInterface::PT_I16;
+    case NVS_TYPE_U16:  return KVStoreInterface::PT_U16;
+    case NVS_TYPE_I32:  return KVStoreInterface::PT_I32;
+    case NVS_TYPE_U32:  return KVStoreInterface::PT_U32;
+    case NVS_TYPE_I64:  return KVStoreInterface::PT_I64;
+    case NVS_TYPE_U64:  return KVStoreInterface::PT_U64;
+    case NVS_TYPE_STR:  return KVStoreInterface::PT_STR;
+    case NVS_TYPE_BLOB: return KVStoreInterface::PT_BLOB;
+    default:            return KVStoreInterface::PT_INVALID;
+    }
+}
+
+static size_t typeSize(KVStoreInterface::Type type) {
+    switch(type) {
+    case KVStoreInterface::PT_I8:
+    case KVStoreInterface::PT_U8:   return 1;
+    case KVStoreInterface::PT_I16:
+    case KVStoreInterface::PT_U16:  return 2;
+    case KVStoreInterface::PT_I32:
+    case KVStoreInterface::PT_U32:  return 4;
+    case KVStoreInterface::PT_I64:
+    case KVStoreInterface::PT_U64:  return 8;
+    default:                        return 0;
+    }
+}
+
+bool ESP32KVStore::_iterate(bool (*callback)(const nvs_entry_info_t& info, void* arg), void* arg) const {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(_partition, name, NVS_TYPE_ANY, &it);
+
+    while(err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+
+        if(!callback(info, arg)) {
+            break;
+        }
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+
+    // the iterator reports ESP_ERR_NVS_NOT_FOUND when there are no more entries
+    return err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND;
+#else
+    nvs_iterator_t it = nvs_entry_find(_partition, name, NVS_TYPE_ANY);
+
+    while(it != NULL) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+
+        if(!callback(info, arg)) {
+            break;
+        }
+        it = nvs_entry_next(it);
+    }
+    nvs_release_iterator(it);
+
+    return true;
+#endif // ESP_IDF_VERSION_MAJOR >= 5
+}
+
+void ESP32KVStore::_buildIndex() {
+    _index.clear();
+
+    _indexed = _iterate([](const nvs_entry_info_t& info, void* arg) {
+        ESP32KVStore* store = (ESP32KVStore*)arg;
+        Type t = fromNvsType(info.type);
+
+        // the length of strings and blobs is retrieved on the first request
+        index_t entry = { {0}, t, typeSize(t) };
+        strncpy(entry.key, info.key, sizeof(entry.key) - 1);
+
+        store->_index.emplace(Key(info.key).hash(), entry);
+        return true;
+    }, this);
+
+    if(!_indexed){
+        log_e("nvs index build fail, falling back to type probing");
+        _index.clear();
+    }
+}
+
+typename KVStoreInterface::res_t ESP32KVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    if(!_started){
+        return -1;
+    }
+
+    struct context_t {
+        const ESP32KVStore* store;
+        KeyCallback callback;
+        void* arg;
+        bool sizes;
+        res_t count;
+    } ctx = { this, callback, arg, sizes, 0 };
+
+    bool res = _iterate([](const nvs_entry_info_t& info, void* arg) {
+        context_t* ctx = (context_t*)arg;
+        KeyInfo key = { info.key, fromNvsType(info.type), 0 };
+
+        if(ctx->sizes) {
+            key.size = ctx->store->getBytesLength(info.key);
+        }
+
+        ctx->count++;
+        return ctx->callback(key, ctx->arg);
+    }, &ctx);
+
+    return res ? ctx.count : -1;
+}
+
+void ESP32KVStore::_updateIndex(const key_t& key, Type t, size_t len) {
+    // floats and doubles are stored as unsigned integers of the same size
+    if(t == PT_FLOAT) {
+        t = PT_U32;
+    } else if(t == PT_DOUBLE) {
+        t = PT_U64;
+    } else if(t == PT_STR) {
+        len++; // nvs keeps the string terminator
+    }
+
+    auto range = _index.equal_range(key.hash());
+    for(auto it = range.first; it != range.second; it++){
+        if(strcmp(it->second.key, key) == 0){
+            it->second.type = t;
+            it->second.len = len;
+            return;
+        }
+    }
+
+    index_t entry = { {0}, t, len };
+    strncpy(entry.key, key, sizeof(entry.key) - 1);
+    _index.emplace(key.hash(), entry);
+}
+
+size_t ESP32KVStore::_probeLength(const key_t& key) const {
     esp_err_t err = ESP_OK;
 
     int8_t mt1; uint8_t mt2; int16_t mt3; uint16_t mt4;
@@ -142,21 +446,13 @@ size_t ESP32KVStore::getBytesLength(const key_t& key) const {
     } else if((err = nvs_get_blob(_handle, key, NULL, &len)) == ESP_OK) {}
 
     if(err){
-        log_e("nvs_get_blob len fail: %s %s", key, nvs_error(err));
+        log_e("nvs_get_blob len fail: %s %s", key.c_str(), nvs_error(err));
         return 0;
     }
     return len;
 }
 
-
-bool ESP32KVStore::exists(const key_t& key) const {
-    return getType(key) != PT_INVALID;
-}
-
-ESP32KVStore::Type ESP32KVStore::getType(const key_t& key) const {
-    if(!_started || !key || strlen(key)>15){
-        return PT_INVALID;
-    }
+ESP32KVStore::Type ESP32KVStore::_probeType(const key_t& key) const {
     int8_t mt1; uint8_t mt2; int16_t mt3; uint16_t mt4;
     int32_t mt5; uint32_t mt6; int64_t mt7; uint64_t mt8;
     size_t len = 0;
@@ -173,14 +469,7 @@ ESP32KVStore::Type ESP32KVStore::getType(const key_t& key) const {
     return PT_INVALID;
 }
 
-
-
-typename KVStoreInterface::res_t ESP32KVStore::_put(
-    const key_t& key, const uint8_t value[], size_t len, KVStoreInterface::Type t) {
-    if(!_started || !key || _readOnly){
-        return 0;
-    }
-
+esp_err_t ESP32KVStore::_set(const key_t& key, const uint8_t value[], size_t len, Type t) {
     esp_err_t err;
     switch(t) {
     case PT_I8:
@@ -222,78 +511,133 @@ typename KVStoreInterface::res_t ESP32KVStore::_put(
     case PT_INVALID:
     default:
         log_e("nvs_set fail: invalid type");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if(err){
+        log_e("nvs_set_ fail: %s %s", key.c_str(), nvs_error(err)); // TODO put type
+    }
+
+    return err;
+}
+
+typename KVStoreInterface::res_t ESP32KVStore::_put(
+    const key_t& key, const uint8_t value[], size_t len, KVStoreInterface::Type t) {
+    if(!_started || !key || _readOnly){
         return 0;
     }
 
+    esp_err_t err = _set(key, value, len, t);
     if(err){
-        log_e("nvs_set_ fail: %s %s", key, nvs_error(err)); // TODO put type
         return 0;
     }
+    _updateIndex(key, t, len);
 
-    err = nvs_commit(_handle);
+    err = _commit();
     if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+        log_e("nvs_commit fail: %s %s", key.c_str(), nvs_error(err));
         return 0;
     }
 
     return len;
 }
 
+size_t ESP32KVStore::putMany(Entry entries[], size_t count) {
+    if(!_started || _readOnly){
+        return 0;
+    }
+
+    // all the entries are set first and then committed together with a single nvs_commit
+    size_t res = 0;
+    for(size_t i=0; i<count; i++) {
+        if(!entries[i].key || _set(entries[i].key, entries[i].value, entries[i].len, entries[i].type) != ESP_OK) {
+            entries[i].res = 0;
+            continue;
+        }
+
+        _updateIndex(entries[i].key, entries[i].type, entries[i].len);
+        entries[i].res = entries[i].len;
+        res++;
+    }
+
+    if(res == 0) {
+        return 0;
+    }
+
+    esp_err_t err = _commit();
+    if(err){
+        log_e("nvs_commit fail: %s", nvs_error(err));
+
+        for(size_t i=0; i<count; i++) {
+            entries[i].res = 0;
+        }
+        return 0;
+    }
+
+    return res;
+}
+
 typename KVStoreInterface::res_t ESP32KVStore::_get(const key_t& key, uint8_t value[], size_t len, Type t) {
     if(!_started || !key){
         return 0;
     }
 
-    esp_err_t err;
+    esp_err_t err = _read(key, value, len, t);
+    if(err){
+        log_e("nvs_get_ fail: %s %s", key.c_str(), nvs_error(err)); // TODO put type
+        return 0;
+    }
+
+    return len;
+}
+
+typename KVStoreInterface::Status ESP32KVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    if(!_started || !key){
+        return ST_ERROR;
+    }
+    if(_indexed && _lookup(key) == nullptr){
+        return ST_NOT_FOUND;
+    }
+
+    switch(_read(key, value, len, t)) {
+    case ESP_OK:                    return ST_FOUND;
+    case ESP_ERR_NVS_NOT_FOUND:     return ST_NOT_FOUND;
+    case ESP_ERR_NVS_TYPE_MISMATCH: return ST_TYPE_MISMATCH;
+    default:                        return ST_ERROR;
+    }
+}
+
+esp_err_t ESP32KVStore::_read(const key_t& key, uint8_t value[], size_t& len, Type t) const {
     switch(t) {
     case PT_I8:
-        err = nvs_get_i8(_handle, key, (int8_t*) value);
-        break;
+        return nvs_get_i8(_handle, key, (int8_t*) value);
     case PT_U8:
-        err = nvs_get_u8(_handle, key, (uint8_t*) value);
-        break;
+        return nvs_get_u8(_handle, key, (uint8_t*) value);
     case PT_I16:
-        err = nvs_get_i16(_handle, key, (int16_t*) value);
-        break;
+        return nvs_get_i16(_handle, key, (int16_t*) value);
     case PT_U16:
-        err = nvs_get_u16(_handle, key, (uint16_t*) value);
-        break;
+        return nvs_get_u16(_handle, key, (uint16_t*) value);
     case PT_I32:
-        err = nvs_get_i32(_handle, key, (int32_t*) value);
-        break;
+        return nvs_get_i32(_handle, key, (int32_t*) value);
     case PT_U32:
-        err = nvs_get_u32(_handle, key, (uint32_t*) value);
-        break;
+        return nvs_get_u32(_handle, key, (uint32_t*) value);
     case PT_I64:
-        err = nvs_get_i64(_handle, key, (int64_t*) value);
-        break;
+        return nvs_get_i64(_handle, key, (int64_t*) value);
     case PT_U64:
-        err = nvs_get_u64(_handle, key, (uint64_t*) value);
-        break;
+        return nvs_get_u64(_handle, key, (uint64_t*) value);
     case PT_STR:
-        err = nvs_get_str(_handle, key, (char*)value, &len);
-        break;
+        return nvs_get_str(_handle, key, (char*)value, &len);
     case PT_BLOB:
-        err = nvs_get_blob(_handle, key, value, &len);
-        break;
+        return nvs_get_blob(_handle, key, value, &len);
     case PT_FLOAT:
-        err = nvs_get_u32(_handle, key, (uint32_t*) value);
-        break;
+        return nvs_get_u32(_handle, key, (uint32_t*) value);
     case PT_DOUBLE:
-        err = nvs_get_u64(_handle, key, (uint64_t*) value);
-        break;
+        return nvs_get_u64(_handle, key, (uint64_t*) value);
     case PT_INVALID:
     default:
         log_e("nvs_get fail: invalid type");
-        break;
+        return ESP_ERR_INVALID_ARG;
     }
-
-    if(err){
-        log_e("nvs_get_ fail: %s %s", key, nvs_error(err)); // TODO put type
-        return 0;
-    }
-
-    return len;
 }
 
 #endif // defined(ARDUINO_ARCH_ESP32)
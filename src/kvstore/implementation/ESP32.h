@@ -11,13 +11,16 @@
 
 #include "../kvstore.h"
 #include <Arduino.h>
-#include <string>
+#include <esp_err.h>
+#include <nvs.h>
+#include <unordered_map>
 
 constexpr char DEFAULT_KVSTORE_NAME[] = "arduino";
 
 class ESP32KVStore: public KVStoreInterface {
 public:
-    ESP32KVStore(): name(DEFAULT_KVSTORE_NAME) {}
+    ESP32KVStore(): name(DEFAULT_KVSTORE_NAME), _partition(NVS_DEFAULT_PART_NAME),
+        _started(false), _readOnly(false), _transaction(false), _indexed(false) {}
 
     bool begin() override;
     bool begin(const char* name, bool readOnly=false, const char* partitionLabel=nullptr);
@@ -30,14 +33,54 @@ public:
     typename KVStoreInterface::res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
     size_t getBytesLength(const key_t& key) const override;
 
+    size_t getString(const key_t& key, char value[], size_t maxLen) override;
+
+    size_t putMany(Entry entries[], size_t count) override;
+
+    bool beginTransaction() override;
+    bool commit() override;
+    bool rollback() override;
+
+    res_t removePrefix(const char* prefix) override;
+
     Type getType(const key_t& key) const;
 
+    // NVS does not expose erase and program counters, only the entries of the partition
+    bool physicalWear(PhysicalWear& wear) const override;
+
 protected:
     res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t);
     res_t _get(const key_t& key, uint8_t value[], size_t len, Type t);
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
 private:
+    esp_err_t _set(const key_t& key, const uint8_t value[], size_t len, Type t);
+    esp_err_t _commit();
+    esp_err_t _read(const key_t& key, uint8_t value[], size_t& len, Type t) const;
+
+    bool _iterate(bool (*callback)(const nvs_entry_info_t& info, void* arg), void* arg) const;
+    void _buildIndex();
+    void _updateIndex(const key_t& key, Type t, size_t len);
+    size_t _probeLength(const key_t& key) const;
+    Type _probeType(const key_t& key) const;
+
+    typedef struct {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        Type type;
+        size_t len; // 0 when the length of a string or blob has not been read yet
+    } index_t;
+
+    index_t* _lookup(const key_t& key) const;
+
     const char* name;
+    const char* _partition;
     uint32_t _handle;
     bool _started;
     bool _readOnly;
+    bool _transaction;
+
+    // type and length of every key in the namespace, built in begin() and kept updated on every modification.
+    // Entries are looked up by the hash carried by the key, the key bytes are compared only on a hash match
+    mutable std::unordered_multimap<uint32_t, index_t> _index;
+    bool _indexed;
 };
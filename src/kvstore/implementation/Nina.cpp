@@ -45,6 +45,10 @@ typename KVStoreInterface::res_t NinaKVStore::remove(const key_t& key) {
 }
 
 typename KVStoreInterface::res_t NinaKVStore::putBytes(const key_t& key, const uint8_t value[], size_t len) {
+    if(skipPut(key, value, len, PT_BLOB)) {
+        return len;
+    }
+
     return WiFiDrv::prefPut(key, static_cast<PreferenceType>(PT_BLOB), value, len);
 }
 
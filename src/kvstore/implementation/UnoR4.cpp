@@ -10,17 +10,19 @@
 
 #if defined(ARDUINO_UNOR4_WIFI)
 #include "UnoR4.h"
-
-using namespace std;
+#include "../utility/atcommand.h"
 
 bool Unor4KVStore::begin(const char* name, bool readOnly, const char* partitionLabel) {
+    char cmd[AT_COMMAND_SIZE];
     this->name = name;
-    string res = "";
 
+    // the modem object shares the link with the pipeline, it is used only when no reply is pending
+    while (async.poll()) { }
     modem.begin();
     if (this->name != nullptr && strlen(this->name) > 0) {
-        if (modem.write(string(PROMPT(_PREF_BEGIN)), res, "%s%s,%d,%s\r\n", CMD_WRITE(_PREF_BEGIN), name, readOnly, partitionLabel != NULL ? partitionLabel : "")) {
-            return (atoi(res.c_str()) != 0) ? true : false;
+        ATCommand command(cmd, sizeof(cmd), CMD_WRITE(_PREF_BEGIN));
+        if (command.arg(name).arg(readOnly).arg(partitionLabel != nullptr ? partitionLabel : "").end() > 0) {
+            return async.result(call(PROMPT(_PREF_BEGIN), cmd)) > 0;
         }
     }
     return false;
@@ -31,125 +33,95 @@ bool Unor4KVStore::begin() {
 }
 
 bool Unor4KVStore::end() {
-    string res = "";
-    modem.write(string(PROMPT(_PREF_END)), res, "%s", CMD(_PREF_END));
+    return async.state(call(PROMPT(_PREF_END), CMD(_PREF_END))) == ATPipeline::OP_DONE;
 }
 
 bool Unor4KVStore::clear() {
-    string res = "";
-    if (modem.write(string(PROMPT(_PREF_CLEAR)), res, "%s", CMD(_PREF_CLEAR))) {
-        return (atoi(res.c_str()) != 0) ? true : false;
-    }
-    return false;
+    return async.result(call(PROMPT(_PREF_CLEAR), CMD(_PREF_CLEAR))) > 0;
 }
 
 typename KVStoreInterface::res_t Unor4KVStore::remove(const key_t& key) {
-    string res = "";
-    if (key != nullptr && strlen(key) > 0) {
-        if (modem.write(string(PROMPT(_PREF_REMOVE)), res, "%s%s\r\n", CMD_WRITE(_PREF_REMOVE), key)) {
-            return (atoi(res.c_str()) != 0) ? true : false;
-        }
+    char cmd[AT_COMMAND_SIZE];
+    if (key.length() > 0 && ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_REMOVE)).arg(key.c_str()).end() > 0) {
+        return async.result(call(PROMPT(_PREF_REMOVE), cmd)) > 0 ? 1 : 0;
     }
-    return false;
+    return 0;
 }
 
 typename KVStoreInterface::res_t Unor4KVStore::putBytes(const key_t& key, const uint8_t value[], size_t len) {
-    string res = "";
-    if ( key != nullptr && strlen(key) > 0 && value != nullptr && len > 0) {
-        modem.write_nowait(string(PROMPT(_PREF_PUT)), res, "%s%s,%d,%d\r\n", CMD_WRITE(_PREF_PUT), key, PT_BLOB, len);
-        if(modem.passthrough((uint8_t *)value, len)) {
-            return len;
-        }
+    if (skipPut(key, value, len, PT_BLOB)) {
+        return len;
     }
-    return 0;
+    return passthrough(key, value, len, PT_BLOB);
 }
 
 typename KVStoreInterface::res_t Unor4KVStore::getBytes(const key_t& key, uint8_t buf[], size_t maxLen) const {
-    size_t len = getBytesLength(key);
-    string res = "";
-    if (key != nullptr && strlen(key) > 0 && buf != nullptr && len > 0) {
-        modem.read_using_size();
-        if (modem.write(string(PROMPT(_PREF_GET)), res, "%s%s,%d\r\n", CMD_WRITE(_PREF_GET), key, PT_BLOB)) {
-            if (res.size() >= len && len <= maxLen) {
-                memcpy(buf, (uint8_t*)&res[0], len);
-                return len;
-            }
+    char cmd[AT_COMMAND_SIZE];
+    if (key.length() > 0 && buf != nullptr && maxLen > 0 &&
+            ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_GET)).arg(key.c_str()).arg(PT_BLOB).end() > 0) {
+        // the reply is read using its size straight in the buffer, there is no need to ask for the length
+        // of the value beforehand. A value bigger than the buffer is not returned
+        int res = async.result(call(PROMPT(_PREF_GET), cmd, nullptr, 0, buf, maxLen));
+        if (res > 0 && (size_t)res <= maxLen) {
+            return res;
         }
     }
     return 0;
 }
 
 size_t Unor4KVStore::getBytesLength(const key_t& key) const {
-    string res = "";
-    if (key != nullptr && strlen(key) > 0) {
-        if (modem.write(string(PROMPT(_PREF_LEN)), res, "%s%s\r\n", CMD_WRITE(_PREF_LEN), key)) {
-            return atoi(res.c_str());
-        }
+    char cmd[AT_COMMAND_SIZE];
+    if (key.length() > 0 && ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_LEN)).arg(key.c_str()).end() > 0) {
+        int res = async.result(call(PROMPT(_PREF_LEN), cmd));
+        return res > 0 ? res : 0;
     }
     return 0;
 }
 
 
 bool Unor4KVStore::exists(const key_t& key) const {
-    string res = "";
-    if (key != nullptr && strlen(key) > 0) {
-        if (modem.write(string(PROMPT(_PREF_TYPE)), res, "%s%s\r\n", CMD_WRITE(_PREF_TYPE), key)) {
-            return static_cast<Type>(atoi(res.c_str())) != PT_INVALID;
+    return getType(key) != PT_INVALID;
+}
+
+typename KVStoreInterface::Type Unor4KVStore::getType(const key_t& key) const {
+    char cmd[AT_COMMAND_SIZE];
+    if (key.length() > 0 && ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_TYPE)).arg(key.c_str()).end() > 0) {
+        ATPipeline::handle_t handle = call(PROMPT(_PREF_TYPE), cmd);
+        if (async.state(handle) == ATPipeline::OP_DONE) {
+            return static_cast<Type>(async.result(handle));
         }
     }
-    return false;
+    return PT_INVALID;
 }
 
 typename KVStoreInterface::res_t Unor4KVStore::_put(
     const key_t& key, const uint8_t value[], size_t len, KVStoreInterface::Type t) {
 
-    if (key == nullptr || strlen(key) == 0) {
+    if (key.length() == 0) {
         return 0;
     }
-    string res = "";
-    string format = "%s%s,%d,%hu\r\n";
 
-    switch(t) {
-    case PT_I8:     format = "%s%s,%d,%hd\r\n"; break;
-    case PT_U8:     format = "%s%s,%d,%hu\r\n"; break;
-    case PT_I16:    format = "%s%s,%d,%hd\r\n"; break;
-    case PT_U16:    format = "%s%s,%d,%hu\r\n"; break;
-    case PT_I32:    format = "%s%s,%d,%d\r\n";  break;
-    case PT_U32:    format = "%s%s,%d,%u\r\n";  break;
-    }
-
-    uint32_t tmp = 0;
-    if( t == PT_I8 || t == PT_U8 || t == PT_I16 || t == PT_U16 ||
-        t == PT_I32 || t == PT_U32) {
-        memcpy(&tmp, value, len);
+    // integers up to 32 bits are sent as decimal text, built without printf and heap allocations
+    if (atIsTextScalar(t)) {
+        char cmd[AT_COMMAND_SIZE];
+        if (atScalarCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_PUT), key.c_str(), t, value) == 0) {
+            return 0;
+        }
+        int res = async.result(call(PROMPT(_PREF_PUT), cmd));
+        return res > 0 ? res : 0;
     }
 
     switch(t) {
-    case PT_I8:
-    case PT_U8:
-    case PT_I16:
-    case PT_U16:
-    case PT_I32:
-    case PT_U32:
-        // sprintf doesn't support 64 bits on unor4
-        if (modem.write(string(PROMPT(_PREF_PUT)), res, format.c_str(), CMD_WRITE(_PREF_PUT), key, t, tmp)) {
-            return atoi(res.c_str());
-        }
-        break;
     case PT_I64:
     case PT_U64:
     case PT_FLOAT:
     case PT_DOUBLE:
+        // the representation in memory is sent as a blob
         return putBytes(key, value, len);
     case PT_STR:
-        modem.write_nowait(string(PROMPT(_PREF_PUT)), res, "%s%s,%d,%d\r\n", CMD_WRITE(_PREF_PUT), key, t, len);
-        if(modem.passthrough(value, len)) {
-            return len;
-        }
-        break;
+        return passthrough(key, value, len, PT_STR);
     case PT_BLOB:
         return putBytes(key, value, len);
-        break;
     case PT_INVALID:
     default:
         break;
@@ -160,34 +132,22 @@ typename KVStoreInterface::res_t Unor4KVStore::_put(
 
 typename KVStoreInterface::res_t Unor4KVStore::_get(const key_t& key, uint8_t value[], size_t len, Type t) {
 
-    if (key == nullptr || strlen(key) == 0) {
+    if (key.length() == 0) {
         return 0;
     }
-    string res = "";
-    string format = "%s%s,%d,%u\r\n";
 
-    switch(t) {
-    case PT_I8:     format = "%hd"; break;
-    case PT_U8:     format = "%hu"; break;
-    case PT_I16:    format = "%hd"; break;
-    case PT_U16:    format = "%hu"; break;
-    case PT_I32:    format = "%d";  break;
-    case PT_U32:    format = "%u";  break;
+    // the number in the reply is checked against the range of the type and stored with its exact size
+    if (atIsTextScalar(t)) {
+        char cmd[AT_COMMAND_SIZE];
+        int64_t number;
+        if (atScalarCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_GET), key.c_str(), t) > 0 &&
+                async.number(call(PROMPT(_PREF_GET), cmd), &number)) {
+            return atScalarValue(number, t, value, len);
+        }
+        return 0;
     }
 
     switch(t) {
-    case PT_I8:
-    case PT_U8:
-    case PT_I16:
-    case PT_U16:
-    case PT_I32:
-    case PT_U32:
-        if (modem.write(string(PROMPT(_PREF_GET)), res, "%s%s,%d,%u\r\n", CMD_WRITE(_PREF_GET), key, t)) {
-            sscanf(res.c_str(), format.c_str(), value);
-
-            return len;
-        }
-        break;
     case PT_I64:
     case PT_U64:
     case PT_FLOAT:
@@ -195,10 +155,8 @@ typename KVStoreInterface::res_t Unor4KVStore::_get(const key_t& key, uint8_t va
         return getBytes(key, value, len);
     case PT_STR:
         return getString(key, (char*)value, len);
-        break;
     case PT_BLOB:
         return getBytes(key, value, len);
-        break;
     case PT_INVALID:
     default:
         break;
@@ -206,34 +164,128 @@ typename KVStoreInterface::res_t Unor4KVStore::_get(const key_t& key, uint8_t va
     return 0;
 }
 
+typename KVStoreInterface::Status Unor4KVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    // the coprocessor replies to the get of a missing key with a default value, thus the type of the key
+    // is checked first: this also detects type mismatches without transferring the value
+    Type stored = getType(key);
+
+    if (stored == PT_INVALID) {
+        return ST_NOT_FOUND;
+    }
+
+    // 64 bits and floating point values are stored as blobs
+    Type expected = t;
+    if (t == PT_I64 || t == PT_U64 || t == PT_FLOAT || t == PT_DOUBLE) {
+        expected = PT_BLOB;
+    }
+
+    if (stored != expected) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    return _get(key, value, len, t) > 0 ? ST_FOUND : ST_ERROR;
+}
+
 size_t Unor4KVStore::getString(const key_t& key, char value[], size_t maxLen) {
-    string res;
-    if (key != nullptr && strlen(key) > 0) {
-        modem.read_using_size();
-        if (modem.write(string(PROMPT(_PREF_GET)), res, "%s%s,%d,%s\r\n", CMD_WRITE(_PREF_GET), key, PT_STR, res)) {
-            res.push_back('\0');
-
-            if(res.length() > maxLen-1) {
-                return 0;
-            }
-
-            strcpy(value, res.c_str());
-            return res.length();
+    char cmd[AT_COMMAND_SIZE];
+    if (key.length() > 0 && ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_GET)).arg(key.c_str()).arg(PT_STR).end() > 0) {
+        // the string lands in the buffer and it is truncated to fit, an empty output keeps the reply sized
+        bool fits = value != nullptr && maxLen > 0;
+        int res = async.result(call(PROMPT(_PREF_GET), cmd, nullptr, 0,
+            fits ? (uint8_t*)value : (uint8_t*)response, fits ? maxLen - 1 : 0));
+
+        if (res < 0) {
+            return 0;
         }
+        if (fits) {
+            value[(size_t)res < maxLen ? res : maxLen - 1] = '\0';
+        }
+        return res;
     }
     return 0;
 }
 
 String Unor4KVStore::getString(const key_t& key, const String defaultValue) {
-    string res = defaultValue.c_str();;
-    if (key != nullptr && strlen(key) > 0) {
-        modem.read_using_size();
-        if (modem.write(string(PROMPT(_PREF_GET)), res, "%s%s,%d,%s\r\n", CMD_WRITE(_PREF_GET), key, PT_STR, defaultValue.c_str())) {
+    size_t len = getString(key, response, sizeof(response));
+
+    // the coprocessor replies with an empty string when the key is missing
+    if (len == 0) {
+        return defaultValue;
+    }
+    if (len < sizeof(response)) {
+        return String(response);
+    }
+
+    // only strings bigger than the response buffer need a temporary one
+    char* value = new char[len + 1];
+    String res = getString(key, value, len + 1) == len ? String(value) : defaultValue;
+    delete [] value;
 
-            return String(res.c_str());
+    return res;
+}
+
+typename Unor4KVStore::handle_t Unor4KVStore::putBytesAsync(const key_t& key, const uint8_t b[], size_t s,
+        ATPipeline::Callback callback, void* arg) {
+    char cmd[AT_COMMAND_SIZE];
+
+    if (key.length() == 0 || b == nullptr || s == 0 ||
+            ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_PUT)).arg(key.c_str()).arg(PT_BLOB).arg(s).end() == 0) {
+        return 0;
+    }
+    return async.submit(PROMPT(_PREF_PUT), cmd, b, s, nullptr, 0, callback, arg);
+}
+
+typename Unor4KVStore::handle_t Unor4KVStore::getBytesAsync(const key_t& key, uint8_t b[], size_t s,
+        ATPipeline::Callback callback, void* arg) {
+    char cmd[AT_COMMAND_SIZE];
+
+    // the reply is always read using its size
+    if (key.length() == 0 || b == nullptr || s == 0 ||
+            ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_GET)).arg(key.c_str()).arg(PT_BLOB).end() == 0) {
+        return 0;
+    }
+    return async.submit(PROMPT(_PREF_GET), cmd, nullptr, 0, b, s, callback, arg);
+}
+
+typename Unor4KVStore::handle_t Unor4KVStore::removeAsync(const key_t& key, ATPipeline::Callback callback, void* arg) {
+    char cmd[AT_COMMAND_SIZE];
+
+    if (key.length() == 0 || ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_REMOVE)).arg(key.c_str()).end() == 0) {
+        return 0;
+    }
+    return async.submit(PROMPT(_PREF_REMOVE), cmd, nullptr, 0, nullptr, 0, callback, arg);
+}
+
+typename KVStoreInterface::res_t Unor4KVStore::passthrough(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    char cmd[AT_COMMAND_SIZE];
+
+    // the value is written right after the command line, as raw bytes
+    if (key.length() > 0 && value != nullptr && len > 0 &&
+            ATCommand(cmd, sizeof(cmd), CMD_WRITE(_PREF_PUT)).arg(key.c_str()).arg(t).arg(len).end() > 0) {
+        if (async.state(call(PROMPT(_PREF_PUT), cmd, value, len)) == ATPipeline::OP_DONE) {
+            return len;
         }
     }
-    return String(res.c_str());
+    return 0;
+}
+
+bool Unor4KVStore::flush() {
+    // deferred references are written back through the pipeline as well
+    bool res = KVStoreInterface::flush();
+
+    return async.flush() && res;
+}
+
+ATPipeline::handle_t Unor4KVStore::call(const char* prompt, const char* cmd, const uint8_t payload[], size_t payloadLen,
+        uint8_t out[], size_t outLen) const {
+    // the asynchronous operations, and the ones submitted by their callbacks, are completed first:
+    // when a blocking method returns no reply is pending and the modem object can use the link
+    while (async.poll()) { }
+
+    ATPipeline::handle_t handle = async.submit(prompt, cmd, payload, payloadLen, out, outLen);
+    async.wait(handle);
+
+    return handle;
 }
 
 #endif // defined(ARDUINO_UNOR4_WIFI)
@@ -10,15 +10,45 @@
 #pragma once
 
 #include "../kvstore.h"
+#include "../utility/pipeline.h"
 #include <Arduino.h>
 #include <Modem.h>
-#include <string>
 
 constexpr char DEFAULT_KVSTORE_NAME[] = "arduino";
 
+// strings up to this size, terminator included, are returned as String without temporary buffers
+#ifndef KVSTORE_UNOR4_RESPONSE_SIZE
+#define KVSTORE_UNOR4_RESPONSE_SIZE 128
+#endif // KVSTORE_UNOR4_RESPONSE_SIZE
+
+// serial port connected to the ESP32-S3 coprocessor, the same used by the modem object
+#ifndef KVSTORE_MODEM_SERIAL
+#define KVSTORE_MODEM_SERIAL Serial2
+#endif // KVSTORE_MODEM_SERIAL
+
+/** SerialModemTransport class
+ *
+ * KVModemTransport on a serial port, a write waits only for the room in the transmit buffer.
+ * The port is shared with the modem object of WiFiS3, which has no non-blocking interface: the two must
+ * not exchange data at the same time, otherwise the replies of one are taken by the other
+ */
+class SerialModemTransport: public KVModemTransport {
+public:
+    SerialModemTransport(Stream& serial): serial(serial) {}
+
+    size_t available() override                         { return serial.available(); }
+    int read() override                                 { return serial.read(); }
+    size_t write(const uint8_t data[], size_t len) override  { return serial.write(data, len); }
+
+private:
+    Stream& serial;
+};
+
 class Unor4KVStore: public KVStoreInterface {
 public:
-    Unor4KVStore(): name(DEFAULT_KVSTORE_NAME) {}
+    typedef ATPipeline::handle_t handle_t;
+
+    Unor4KVStore(): name(DEFAULT_KVSTORE_NAME), transport(KVSTORE_MODEM_SERIAL), async(&transport) {}
 
     bool begin() override;
     bool begin(const char* name, bool readOnly=false, const char* partitionLabel=nullptr);
@@ -31,12 +61,85 @@ public:
     typename KVStoreInterface::res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
     size_t getBytesLength(const key_t& key) const override;
 
+    Type getType(const key_t& key) const;
+
     size_t getString(const key_t& key, char value[], size_t maxLen) override;
     String getString(const key_t& key, const String defaultValue = String()) override;
 
+    /*
+     * Asynchronous operations: they are queued and return immediately, several of them are sent
+     * to the coprocessor without waiting for the replies of the previous ones. They progress
+     * only while poll() is called, for example from loop(), and report their completion through
+     * the callback or state() and result(). The buffers passed to them must stay valid until they complete.
+     * The blocking methods go through the same queue, thus they wait for the operations submitted before them
+     * and the callbacks of those can be called from within them.
+     *
+     * The link is shared with the modem object, that WiFiS3 uses for the network: it must not be used while
+     * pending() is not 0, i.e. the network is serviced between the asynchronous operations, after poll()
+     * returned false or after flush(). When a blocking method returns no operation is pending.
+     */
+
+    /**
+     * @brief queue the write of a blob
+     *
+     * @returns the handle of the operation, 0 if it cannot be queued
+     */
+    handle_t putBytesAsync(const key_t& key, const uint8_t b[], size_t s,
+        ATPipeline::Callback callback=nullptr, void* arg=nullptr);
+
+    /**
+     * @brief queue the read of a blob, the result is the size of the value
+     *
+     * @returns the handle of the operation, 0 if it cannot be queued
+     */
+    handle_t getBytesAsync(const key_t& key, uint8_t b[], size_t s,
+        ATPipeline::Callback callback=nullptr, void* arg=nullptr);
+
+    /**
+     * @brief queue the removal of a key
+     *
+     * @returns the handle of the operation, 0 if it cannot be queued
+     */
+    handle_t removeAsync(const key_t& key, ATPipeline::Callback callback=nullptr, void* arg=nullptr);
+
+    /**
+     * @brief make the asynchronous operations progress without blocking
+     *
+     * @returns true if there are operations that did not complete yet
+     */
+    bool poll()                                     { return async.poll(); }
+
+    /**
+     * @brief write back the deferred references and wait for the asynchronous operations to complete
+     *
+     * @returns true if all of them succeeded
+     */
+    bool flush() override;
+
+    // number of asynchronous operations that did not complete yet
+    size_t pending() const                          { return async.pending(); }
+
+    ATPipeline::State state(handle_t handle) const  { return async.state(handle); }
+    int result(handle_t handle) const               { return async.result(handle); }
+
 protected:
     res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
     res_t _get(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
 private:
+    // write a blob or a string followed by its raw bytes
+    res_t passthrough(const key_t& key, const uint8_t value[], size_t len, Type t);
+
+    // submit an operation and wait for it to complete, returns its handle
+    ATPipeline::handle_t call(const char* prompt, const char* cmd, const uint8_t payload[]=nullptr,
+        size_t payloadLen=0, uint8_t out[]=nullptr, size_t outLen=0) const;
+
     const char* name;
+
+    // all the exchanges with the coprocessor go through the pipeline: commands are built on the stack,
+    // numeric replies are parsed in its line buffer and data lands in the buffer of the caller
+    SerialModemTransport transport;
+    mutable ATPipeline async;
+
+    char response[KVSTORE_UNOR4_RESPONSE_SIZE];
 };
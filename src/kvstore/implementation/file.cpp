@@ -0,0 +1,730 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#if defined(__linux__)
+#include "file.h"
+#include "../utility/crc.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// the log starts with a magic string and a version
+constexpr uint8_t FILE_HEADER[] = { 'K', 'V', 'L', 'G', 1, 0, 0, 0 };
+constexpr size_t FILE_HEADER_SIZE = sizeof(FILE_HEADER);
+
+// crc (4 bytes), type (1), flags (1), key length (2), value length (4), followed by the key and the value
+constexpr size_t RECORD_HEADER_SIZE = 12;
+constexpr uint8_t RECORD_REMOVED = 0x01;
+
+// the mapping of the log is enlarged in steps, in order not to remap it at every append
+constexpr size_t MAP_GRANULARITY = 1024 * 1024;
+constexpr size_t COPY_BUFFER_SIZE = 64 * 1024;
+
+enum {
+    COMPACT_IDLE, COMPACT_RUNNING, COMPACT_DONE, COMPACT_FAILED,
+};
+
+static bool writeAll(int fd, const uint8_t* data, size_t len, size_t offset) {
+    while(len > 0) {
+        ssize_t res = pwrite(fd, data, len, offset);
+
+        if(res <= 0) {
+            return false;
+        }
+
+        data += res;
+        len -= res;
+        offset += res;
+    }
+
+    return true;
+}
+
+// the rename of a file is durable only after its directory has been flushed
+static bool syncDirectory(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) {
+        return false;
+    }
+
+    bool res = fsync(dirFd) == 0;
+    ::close(dirFd);
+
+    return res;
+}
+
+FileKVStore::FileKVStore(const char* path, float compactionRatio, bool syncWrites)
+: path(path), compactionRatio(compactionRatio), syncWrites(syncWrites),
+  fd(-1), mapped(nullptr), mappedSize(0), logEnd(0), dead(0), batching(false),
+  writtenBytes(0), compactions(0), inTransaction(false),
+  compactState(COMPACT_IDLE), compactFd(-1), compactStart(0), compactEnd(0) { }
+
+bool FileKVStore::begin() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd >= 0) {
+        return false;
+    }
+
+    if(!open()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool FileKVStore::begin(const char* filePath) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd >= 0 || filePath == nullptr) {
+        return false;
+    }
+
+    path = filePath;
+    return begin();
+}
+
+bool FileKVStore::end() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0) {
+        return true;
+    }
+
+    // uncommitted modifications are lost, a compaction that already completed is applied
+    rollback();
+    closeRead();
+
+    bool res = KVStoreInterface::flush();
+
+    if(!finishCompaction(true)) {
+        abortCompaction();
+    }
+
+    res = sync() && res;
+    close();
+
+    return res;
+}
+
+bool FileKVStore::clear() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0) {
+        return false;
+    }
+
+    if(inTransaction) {
+        transaction.clear();
+        return true;
+    }
+
+    abortCompaction();
+
+    if(ftruncate(fd, FILE_HEADER_SIZE) != 0) {
+        return false;
+    }
+
+    index.clear();
+    logEnd = FILE_HEADER_SIZE;
+    dead = 0;
+
+    return sync();
+}
+
+typename KVStoreInterface::res_t FileKVStore::remove(const key_t& key) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0 || key == nullptr) {
+        return -1;
+    }
+
+    if(inTransaction) {
+        return transaction.remove(key) ? 1 : -1;
+    }
+
+    finishCompaction(false);
+
+    auto it = index.find(std::string(key.c_str(), key.length()));
+    if(it == index.end()) {
+        return 0;
+    }
+
+    size_t size = recordSize(it->second);
+
+    // the removal is recorded in the log, in order to be replayed when the store is opened
+    if(append(key.c_str(), key.length(), nullptr, 0, PT_INVALID, true) < 0) {
+        return -1;
+    }
+
+    index.erase(it);
+    dead += size + RECORD_HEADER_SIZE + key.length();
+
+    startCompaction(false);
+    return 1;
+}
+
+bool FileKVStore::exists(const key_t& key) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    const uint8_t* value;
+    size_t len;
+    if(inTransaction && transaction.lookup(key, &value, &len)) {
+        return value != nullptr;
+    }
+
+    return lookup(key) != nullptr;
+}
+
+typename KVStoreInterface::res_t FileKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    return skipPut(key, b, s, PT_BLOB) ? (res_t)s : _put(key, b, s, PT_BLOB);
+}
+
+typename KVStoreInterface::res_t FileKVStore::getBytes(const key_t& key, uint8_t b[], size_t s) const {
+    View view = getView(key);
+
+    if(view.data == nullptr) {
+        return 0;
+    }
+
+    memcpy(b, view.data, s < view.len ? s : view.len);
+    return view.len;
+}
+
+size_t FileKVStore::getBytesLength(const key_t& key) const {
+    return getView(key).len;
+}
+
+typename KVStoreInterface::View FileKVStore::getView(const key_t& key) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    const uint8_t* value;
+    size_t len;
+    if(inTransaction && transaction.lookup(key, &value, &len)) {
+        return { value, value != nullptr ? len : 0 };
+    }
+
+    const entry_t* e = lookup(key);
+
+    if(e == nullptr) {
+        return { nullptr, 0 };
+    }
+
+    return { valueOf(*e), e->len };
+}
+
+bool FileKVStore::beginTransaction() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0 || inTransaction) {
+        return false;
+    }
+
+    inTransaction = true;
+    return true;
+}
+
+bool FileKVStore::commit() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0 || !inTransaction) {
+        return false;
+    }
+
+    inTransaction = false;
+
+    // the buffered operations are appended one after the other and flushed together
+    batching = true;
+    bool res = transaction.apply(*this);
+    batching = false;
+
+    return sync() && res;
+}
+
+bool FileKVStore::rollback() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(!inTransaction) {
+        return false;
+    }
+
+    inTransaction = false;
+    transaction.discard();
+    return true;
+}
+
+bool FileKVStore::flush() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    bool res = KVStoreInterface::flush();
+
+    return fd >= 0 && sync() && res;
+}
+
+bool FileKVStore::compact() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0 || inTransaction) {
+        return false;
+    }
+
+    // a compaction started in the background keeps the records overwritten while it was running
+    if(compactState != COMPACT_IDLE) {
+        finishCompaction(true);
+    }
+
+    startCompaction(true);
+    return finishCompaction(true);
+}
+
+size_t FileKVStore::fileSize() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    return logEnd;
+}
+
+size_t FileKVStore::deadSize() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    return dead;
+}
+
+bool FileKVStore::physicalWear(PhysicalWear& wear) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    memset(&wear, 0, sizeof(wear));
+
+    wear.programBytes = writtenBytes;
+    wear.gcCount = compactions;
+
+    return true;
+}
+
+typename KVStoreInterface::res_t FileKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0 || key == nullptr || key.length() == 0 || key.length() > UINT16_MAX ||
+            len > UINT32_MAX || (value == nullptr && len > 0)) {
+        return -1;
+    }
+
+    if(inTransaction) {
+        return transaction.put(key, value, len, t) ? len : -1;
+    }
+
+    std::string k(key.c_str(), key.length());
+    auto it = index.find(k);
+    size_t offset = logEnd;
+
+    // a value may come from a view over the log: it is written before a completed compaction replaces
+    // the log, the record is then copied as any other one written while the compaction was running
+    if(append(k.c_str(), k.length(), value, len, t, false) < 0) {
+        return -1;
+    }
+
+    if(it != index.end()) {
+        dead += recordSize(it->second);
+        it->second = { offset, len, (uint16_t)k.length(), t };
+    } else {
+        index.emplace(std::move(k), entry_t{ offset, len, (uint16_t)key.length(), t });
+    }
+
+    finishCompaction(false);
+    startCompaction(false);
+    return len;
+}
+
+typename KVStoreInterface::Status FileKVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0 || len == 0) {
+        return ST_ERROR;
+    }
+
+    const uint8_t* data;
+    size_t size;
+    Type stored = PT_BLOB;
+
+    if(!inTransaction || !transaction.lookup(key, &data, &size, &stored)) {
+        const entry_t* e = lookup(key);
+
+        data = e != nullptr ? valueOf(*e) : nullptr;
+        size = e != nullptr ? e->len : 0;
+        stored = e != nullptr ? e->type : PT_BLOB;
+    }
+
+    if(data == nullptr) {
+        return ST_NOT_FOUND;
+    }
+
+    if(t == PT_STR) {
+        size_t n = size < len ? size : len - 1;
+
+        memcpy(value, data, n);
+        value[n] = '\0';
+        return ST_FOUND;
+    }
+
+    // fixed size types must match both the type and the size of the stored value
+    if(t != PT_BLOB && ((stored != PT_BLOB && stored != t) || size != len)) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    memcpy(value, data, size < len ? size : len);
+    return ST_FOUND;
+}
+
+typename KVStoreInterface::res_t FileKVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    if(fd < 0) {
+        return -1;
+    }
+
+    // the iteration covers only committed keys, modifications buffered in a transaction are not visited
+    res_t count = 0;
+    for(auto& el: index) {
+        count++;
+
+        if(!callback({ el.first.c_str(), el.second.type, sizes ? el.second.len : 0 }, arg)) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+bool FileKVStore::open() {
+    // a compaction interrupted by a reset left its file behind
+    unlink((path + ".compact").c_str());
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        return false;
+    }
+
+    if(st.st_size == 0) {
+        if(!writeAll(fd, FILE_HEADER, FILE_HEADER_SIZE, 0) || fsync(fd) != 0) {
+            return false;
+        }
+        st.st_size = FILE_HEADER_SIZE;
+    }
+
+    if((size_t)st.st_size < FILE_HEADER_SIZE || !map(st.st_size) ||
+            memcmp(mapped, FILE_HEADER, FILE_HEADER_SIZE) != 0) {
+        return false;
+    }
+
+    logEnd = st.st_size;
+    return replay();
+}
+
+void FileKVStore::close() {
+    if(mapped != nullptr) {
+        munmap(mapped, mappedSize);
+    }
+
+    if(fd >= 0) {
+        ::close(fd);
+    }
+
+    fd = -1;
+    mapped = nullptr;
+    mappedSize = 0;
+    logEnd = 0;
+    dead = 0;
+    index.clear();
+}
+
+bool FileKVStore::replay() {
+    size_t offset = FILE_HEADER_SIZE;
+
+    while(offset + RECORD_HEADER_SIZE <= logEnd) {
+        const uint8_t* record = mapped + offset;
+
+        uint32_t crc, len;
+        uint16_t keyLen;
+        memcpy(&crc, record, sizeof(crc));
+        memcpy(&keyLen, record + 6, sizeof(keyLen));
+        memcpy(&len, record + 8, sizeof(len));
+
+        size_t size = RECORD_HEADER_SIZE + keyLen + len;
+
+        // a record that was not completely written ends the log
+        if(keyLen == 0 || size > logEnd - offset || crc32(0, record + 4, size - 4) != crc) {
+            break;
+        }
+
+        std::string key((const char*)record + RECORD_HEADER_SIZE, keyLen);
+        auto it = index.find(key);
+
+        if(it != index.end()) {
+            dead += recordSize(it->second);
+        }
+
+        if(record[5] & RECORD_REMOVED) {
+            dead += size;
+
+            if(it != index.end()) {
+                index.erase(it);
+            }
+        } else if(it != index.end()) {
+            it->second = { offset, len, keyLen, (Type)record[4] };
+        } else {
+            index.emplace(std::move(key), entry_t{ offset, len, keyLen, (Type)record[4] });
+        }
+
+        offset += size;
+    }
+
+    if(offset < logEnd) {
+        if(ftruncate(fd, offset) != 0) {
+            return false;
+        }
+
+        logEnd = offset;
+    }
+
+    return true;
+}
+
+bool FileKVStore::map(size_t size) {
+    if(mapped != nullptr && size <= mappedSize) {
+        return true;
+    }
+
+    size_t newSize = (size / MAP_GRANULARITY + 1) * MAP_GRANULARITY;
+    newSize = newSize > 2 * mappedSize ? newSize : 2 * mappedSize;
+
+    // the mapping can be bigger than the file, pages past its end are never accessed
+    void* res = mapped == nullptr ?
+        mmap(nullptr, newSize, PROT_READ, MAP_SHARED, fd, 0) :
+        mremap(mapped, mappedSize, newSize, MREMAP_MAYMOVE);
+
+    if(res == MAP_FAILED) {
+        return false;
+    }
+
+    mapped = (uint8_t*)res;
+    mappedSize = newSize;
+
+    return true;
+}
+
+typename KVStoreInterface::res_t FileKVStore::append(
+        const char* key, size_t keyLen, const uint8_t value[], size_t len, Type t, bool removed) {
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint16_t k = keyLen;
+    uint32_t l = len;
+
+    header[4] = t;
+    header[5] = removed ? RECORD_REMOVED : 0;
+    memcpy(header + 6, &k, sizeof(k));
+    memcpy(header + 8, &l, sizeof(l));
+
+    uint32_t crc = crc32(0, header + 4, RECORD_HEADER_SIZE - 4);
+    crc = crc32(crc, (const uint8_t*)key, keyLen);
+    crc = crc32(crc, value, len);
+    memcpy(header, &crc, sizeof(crc));
+
+    struct iovec iov[] = {
+        { header, RECORD_HEADER_SIZE },
+        { (void*)key, keyLen },
+        { (void*)value, len },
+    };
+
+    size_t size = RECORD_HEADER_SIZE + keyLen + len;
+    ssize_t res = pwritev(fd, iov, len > 0 ? 3 : 2, logEnd);
+
+    // a partial record would be dropped by replay, it is removed now in order to keep appending after it
+    if(res != (ssize_t)size || !map(logEnd + size)) {
+        res = ftruncate(fd, logEnd);
+        return -1;
+    }
+
+    logEnd += size;
+    writtenBytes += size;
+
+    if(syncWrites && !batching && fdatasync(fd) != 0) {
+        return -1;
+    }
+
+    return len;
+}
+
+bool FileKVStore::sync() {
+    return fd >= 0 && (!syncWrites || fdatasync(fd) == 0);
+}
+
+const FileKVStore::entry_t* FileKVStore::lookup(const key_t& key) const {
+    if(fd < 0 || key == nullptr) {
+        return nullptr;
+    }
+
+    auto it = index.find(std::string(key.c_str(), key.length()));
+
+    return it != index.end() ? &it->second : nullptr;
+}
+
+const uint8_t* FileKVStore::valueOf(const entry_t& e) const {
+    return mapped + e.offset + RECORD_HEADER_SIZE + e.keyLen;
+}
+
+size_t FileKVStore::recordSize(const entry_t& e) const {
+    return RECORD_HEADER_SIZE + e.keyLen + e.len;
+}
+
+void FileKVStore::startCompaction(bool force) {
+    if(compactState != COMPACT_IDLE || inTransaction) {
+        return;
+    }
+
+    if(!force && (logEnd < DEFAULT_COMPACTION_MIN_SIZE || dead < compactionRatio * logEnd)) {
+        return;
+    }
+
+    compactFd = ::open((path + ".compact").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(compactFd < 0) {
+        return;
+    }
+
+    // the live records are copied in the order they appear in the log, which is read sequentially
+    moves.clear();
+    moves.reserve(index.size());
+
+    for(auto& el: index) {
+        moves.push_back({ el.second.offset, 0, recordSize(el.second) });
+    }
+
+    std::sort(moves.begin(), moves.end(), [](const move_t& a, const move_t& b) { return a.from < b.from; });
+
+    compactEnd = FILE_HEADER_SIZE;
+    for(auto& m: moves) {
+        m.to = compactEnd;
+        compactEnd += m.size;
+    }
+
+    compactStart = logEnd;
+    compactState = COMPACT_RUNNING;
+    compactor = std::thread(copyRecords, fd, compactFd, &moves, &compactState);
+}
+
+bool FileKVStore::finishCompaction(bool wait) {
+    if(compactState == COMPACT_IDLE || (!wait && compactState == COMPACT_RUNNING)) {
+        return false;
+    }
+
+    compactor.join();
+
+    if(compactState != COMPACT_DONE) {
+        abortCompaction();
+        return false;
+    }
+
+    // records written after the start of the compaction are copied now, the others have been moved
+    std::vector<size_t> offsets;
+    offsets.reserve(index.size());
+    size_t live = 0;
+
+    for(auto& el: index) {
+        const entry_t& e = el.second;
+        live += recordSize(e);
+
+        if(e.offset < compactStart) {
+            auto m = std::lower_bound(moves.begin(), moves.end(), e.offset,
+                [](const move_t& m, size_t offset) { return m.from < offset; });
+            offsets.push_back(m->to);
+            continue;
+        }
+
+        if(!writeAll(compactFd, mapped + e.offset, recordSize(e), compactEnd)) {
+            abortCompaction();
+            return false;
+        }
+
+        offsets.push_back(compactEnd);
+        compactEnd += recordSize(e);
+    }
+
+    if(fdatasync(compactFd) != 0 || rename((path + ".compact").c_str(), path.c_str()) != 0) {
+        abortCompaction();
+        return false;
+    }
+    syncDirectory(path);
+
+    size_t i = 0;
+    for(auto& el: index) {
+        el.second.offset = offsets[i++];
+    }
+
+    munmap(mapped, mappedSize);
+    ::close(fd);
+
+    fd = compactFd;
+    mapped = nullptr;
+    mappedSize = 0;
+    logEnd = compactEnd;
+    dead = logEnd - FILE_HEADER_SIZE - live;
+    writtenBytes += compactEnd;
+    compactions++;
+
+    compactFd = -1;
+    moves.clear();
+    compactState = COMPACT_IDLE;
+
+    return map(logEnd);
+}
+
+void FileKVStore::abortCompaction() {
+    if(compactState == COMPACT_IDLE) {
+        return;
+    }
+
+    if(compactor.joinable()) {
+        compactor.join();
+    }
+
+    ::close(compactFd);
+    unlink((path + ".compact").c_str());
+
+    compactFd = -1;
+    moves.clear();
+    compactState = COMPACT_IDLE;
+}
+
+void FileKVStore::copyRecords(int from, int to, const std::vector<move_t>* moves, std::atomic<int>* state) {
+    uint8_t* buffer = new uint8_t[COPY_BUFFER_SIZE];
+    bool res = writeAll(to, FILE_HEADER, FILE_HEADER_SIZE, 0);
+
+    for(auto it = moves->begin(); res && it != moves->end(); it++) {
+        for(size_t done = 0; res && done < it->size;) {
+            size_t n = it->size - done < COPY_BUFFER_SIZE ? it->size - done : COPY_BUFFER_SIZE;
+
+            res = pread(from, buffer, n, it->from + done) == (ssize_t)n && writeAll(to, buffer, n, it->to + done);
+            done += n;
+        }
+    }
+
+    delete [] buffer;
+    *state = res ? COMPACT_DONE : COMPACT_FAILED;
+}
+
+#endif // defined(__linux__)
@@ -0,0 +1,159 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#if defined(__linux__)
+#include "../kvstore.h"
+#include "../utility/transaction.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+constexpr const char* DEFAULT_FILE_KVSTORE_PATH = "kvstore.log";
+constexpr float DEFAULT_COMPACTION_RATIO = 0.5f;
+constexpr size_t DEFAULT_COMPACTION_MIN_SIZE = 64 * 1024;
+
+/** FileKVStore class
+ *
+ * Durable store for Linux that appends every modification as a record at the end of a log file, thus
+ * the file is only written sequentially. Every record holds a CRC of its content: when the store is
+ * opened the log is replayed to build an in-memory index of the offsets of the live records, and a
+ * record that was not completely written is dropped. Values are read from a read-only mmap of the file,
+ * they can be accessed without copies with getView, until the next modification of the store.
+ *
+ * Overwritten and removed records are dead space, when it exceeds a ratio of the size of the file
+ * the live records are copied in a new file by a background thread. The new file replaces the log
+ * during the next modification, after the records appended in the meantime have been copied as well.
+ *
+ * Every modification is flushed to the disk unless sync is disabled, transactions are buffered in RAM
+ * and flushed once when they are committed. Records are written in the native byte order.
+ * All the methods can be called from multiple threads.
+ */
+class FileKVStore: public KVStoreInterface {
+public:
+    FileKVStore(const char* path=DEFAULT_FILE_KVSTORE_PATH, float compactionRatio=DEFAULT_COMPACTION_RATIO,
+        bool syncWrites=true);
+    ~FileKVStore() { end(); }
+
+    bool begin() override;
+    bool begin(const char* filePath);
+    bool end() override;
+    bool clear() override;
+
+    res_t remove(const key_t& key) override;
+    bool exists(const key_t& key) const override;
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
+    size_t getBytesLength(const key_t& key) const override;
+    View getView(const key_t& key) const override;
+
+    bool beginTransaction() override;
+    bool commit() override;
+    bool rollback() override;
+
+    /**
+     * @brief write back the deferred references and flush the log to the disk
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool flush() override;
+
+    /**
+     * @brief copy the live records in a new log and replace the current one, waiting for the end of
+     *        a compaction running in the background
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool compact();
+
+    /**
+     * @brief get the size of the log file
+     */
+    size_t fileSize() const;
+
+    /**
+     * @brief get the number of bytes of the log taken by overwritten and removed records
+     */
+    size_t deadSize() const;
+
+    /**
+     * @brief the bytes appended to the log and copied by the compactions since the store was opened
+     */
+    bool physicalWear(PhysicalWear& wear) const override;
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
+
+private:
+    typedef struct {
+        size_t offset; // of the record in the log
+        size_t len;
+        uint16_t keyLen;
+        Type type;
+    } entry_t;
+
+    // record copied by the background compaction, from the offset in the old log to the one in the new log
+    typedef struct {
+        size_t from;
+        size_t to;
+        size_t size;
+    } move_t;
+
+    bool open();
+    void close();
+    bool replay();
+    bool map(size_t size);
+    res_t append(const char* key, size_t keyLen, const uint8_t value[], size_t len, Type t, bool removed);
+    bool sync();
+
+    const entry_t* lookup(const key_t& key) const;
+    const uint8_t* valueOf(const entry_t& e) const;
+    size_t recordSize(const entry_t& e) const;
+
+    void startCompaction(bool force);
+    bool finishCompaction(bool wait);
+    void abortCompaction();
+    static void copyRecords(int from, int to, const std::vector<move_t>* moves, std::atomic<int>* state);
+
+    std::string path;
+    const float compactionRatio;
+    const bool syncWrites;
+
+    int fd;
+    uint8_t* mapped;
+    size_t mappedSize;
+    size_t logEnd;
+    size_t dead;
+    bool batching; // the log is flushed once at the end of a batch of writes
+    uint64_t writtenBytes;
+    uint32_t compactions;
+
+    std::unordered_map<std::string, entry_t> index;
+
+    TransactionBuffer transaction;
+    bool inTransaction;
+
+    // the thread reads only the file descriptors and the moves, that are not modified until it is joined
+    std::thread compactor;
+    std::atomic<int> compactState;
+    int compactFd;
+    size_t compactStart; // end of the log when the compaction started
+    size_t compactEnd;   // end of the new log
+    std::vector<move_t> moves;
+
+    mutable std::recursive_mutex mutex;
+};
+
+#endif // defined(__linux__)
@@ -11,7 +11,9 @@
 #if defined(ARDUINO_PORTENTA_C33)
 #include "portentac33.h"
 
-PortentaC33KVStore::PortentaC33KVStore(): kvstore(nullptr), bd(nullptr) {}
+PortentaC33KVStore::PortentaC33KVStore(): kvstore(nullptr), bd(nullptr), inTransaction(false), writeHandle(nullptr) {
+    readKey[0] = '\0';
+}
 
 bool PortentaC33KVStore::begin() {
     return begin(false);
@@ -39,6 +41,11 @@ bool PortentaC33KVStore::begin(bool reformat, mbed::KVStore* store) {
 bool PortentaC33KVStore::end() {
     bool res = false;
 
+    // uncommitted modifications and streams that were not finalized are lost
+    rollback();
+    abortWrite();
+    closeRead();
+
     if(kvstore != nullptr && bd == nullptr) {
         res = kvstore->deinit() == KVSTORE_SUCCESS;
         kvstore = nullptr;
@@ -57,18 +64,44 @@ bool PortentaC33KVStore::end() {
 
 template<typename T=int>
 static inline typename KVStoreInterface::res_t fromMbedErrors(int error, T res=1) {
-    return error == KVSTORE_SUCCESS ? res : -error;
+    // mbed error codes are already negative, keep them that way so callers testing
+    // for res < 0 see the failure; anything else non zero is flipped to negative
+    return error == KVSTORE_SUCCESS ? res : (error < 0 ? error : -error);
 }
 
 bool PortentaC33KVStore::clear() {
-    return kvstore != nullptr ? kvstore->reset() : false;
+    if(kvstore != nullptr && inTransaction) {
+        transaction.clear();
+        return true;
+    }
+
+    return kvstore != nullptr ? kvstore->reset() == KVSTORE_SUCCESS : false;
 }
 
 typename KVStoreInterface::res_t PortentaC33KVStore::remove(const key_t& key) {
-    return kvstore != nullptr ? fromMbedErrors(kvstore->remove(key)) : -1;
+    if(kvstore != nullptr && inTransaction) {
+        return transaction.remove(key) ? 1 : -1;
+    }
+
+    if(kvstore == nullptr) {
+        return -1;
+    }
+
+    int res = kvstore->remove(key);
+
+    // as the other backends, a missing key is not an error: nothing is removed
+    return res == KVSTORE_ERROR_ITEM_NOT_FOUND ? 0 : fromMbedErrors(res);
 }
 
 typename KVStoreInterface::res_t PortentaC33KVStore::putBytes(const key_t& key, const uint8_t buf[], size_t len) {
+    if(skipPut(key, buf, len, PT_BLOB)) {
+        return len;
+    }
+
+    if(kvstore != nullptr && inTransaction) {
+        return transaction.put(key, buf, len) ? len : -1;
+    }
+
     return kvstore != nullptr ? fromMbedErrors(kvstore->set(key, buf, len, 0), len) : -1; // TODO flags
 }
 
@@ -77,6 +110,18 @@ typename KVStoreInterface::res_t PortentaC33KVStore::getBytes(const key_t& key,
         return -1;
     }
 
+    const uint8_t* value;
+    size_t len;
+    if(inTransaction && transaction.lookup(key, &value, &len)) {
+        if(value == nullptr) {
+            return -1;
+        }
+
+        len = len < maxLen ? len : maxLen;
+        memcpy(buf, value, len);
+        return len;
+    }
+
     size_t actual_size = maxLen;
     auto res = kvstore->get(key, buf, maxLen, &actual_size);
 
@@ -88,6 +133,12 @@ size_t PortentaC33KVStore::getBytesLength(const key_t& key) const {
         return 0;
     }
 
+    const uint8_t* value;
+    size_t len;
+    if(inTransaction && transaction.lookup(key, &value, &len)) {
+        return len;
+    }
+
     mbed::KVStore::info_t info;
     auto res = kvstore->get_info(key, &info);
 
@@ -97,4 +148,241 @@ size_t PortentaC33KVStore::getBytesLength(const key_t& key) const {
 bool PortentaC33KVStore::exists(const key_t& key) const {
     return getBytesLength(key) > 0;
 }
+
+typename KVStoreInterface::Status PortentaC33KVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    if(kvstore == nullptr || len == 0) {
+        return ST_ERROR;
+    }
+
+    // strings are null terminated, thus the value can use one byte less than the buffer
+    size_t maxLen = t == PT_STR ? len-1 : len;
+    size_t size = 0;
+
+    bool scalar = t != PT_STR && t != PT_BLOB;
+
+    const uint8_t* buffered;
+    if(inTransaction && transaction.lookup(key, &buffered, &size)) {
+        if(buffered == nullptr) {
+            return ST_NOT_FOUND;
+        } else if(scalar && size != len) {
+            return ST_TYPE_MISMATCH;
+        }
+
+        memcpy(value, buffered, size < maxLen ? size : maxLen);
+    } else if(scalar) {
+        // get reports at most the size of the buffer, one more byte tells apart a longer value
+        uint8_t buffer[sizeof(uint64_t) + 1];
+        auto res = len < sizeof(buffer) ? kvstore->get(key, buffer, len + 1, &size) : KVSTORE_SUCCESS;
+
+        if(res == KVSTORE_ERROR_ITEM_NOT_FOUND) {
+            return ST_NOT_FOUND;
+        } else if(res != KVSTORE_SUCCESS) {
+            return ST_ERROR;
+        } else if(size != len) {
+            return ST_TYPE_MISMATCH;
+        }
+
+        memcpy(value, buffer, len);
+    } else {
+        auto res = kvstore->get(key, value, maxLen, &size);
+
+        if(res == KVSTORE_ERROR_ITEM_NOT_FOUND) {
+            return ST_NOT_FOUND;
+        } else if(res != KVSTORE_SUCCESS) {
+            return ST_ERROR;
+        }
+    }
+
+    if(t == PT_STR) {
+        value[size < maxLen ? size : maxLen] = '\0';
+    }
+
+    return ST_FOUND;
+}
+
+typename KVStoreInterface::res_t PortentaC33KVStore::removePrefix(const char* prefix) {
+    if(kvstore == nullptr || prefix == nullptr) {
+        return kvstore == nullptr ? -1 : 0;
+    }
+
+    if(!inTransaction) {
+        return KVStoreInterface::removePrefix(prefix);
+    }
+
+    // during a transaction removals are only buffered, thus the store can be iterated while removing
+    struct context_t {
+        TransactionBuffer* transaction;
+        res_t count;
+    } ctx = { &transaction, (res_t)transaction.removePrefix(prefix) };
+
+    res_t res = _scanPrefix(prefix, [](const KeyInfo& info, void* arg) {
+        context_t* ctx = (context_t*)arg;
+        const uint8_t* value;
+        size_t len;
+
+        // keys already removed in this transaction must not be counted again
+        if(ctx->transaction->lookup(info.key, &value, &len) && value == nullptr) {
+            return true;
+        }
+
+        if(ctx->transaction->remove(info.key)) {
+            ctx->count++;
+        }
+        return true;
+    }, &ctx, false);
+
+    return res < 0 ? res : ctx.count;
+}
+
+typename KVStoreInterface::res_t PortentaC33KVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    return _scanPrefix(nullptr, callback, arg, sizes);
+}
+
+typename KVStoreInterface::res_t PortentaC33KVStore::_scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const {
+    if(kvstore == nullptr) {
+        return -1;
+    }
+
+    mbed::KVStore::iterator_t it;
+    if(kvstore->iterator_open(&it, prefix) != KVSTORE_SUCCESS) {
+        return -1;
+    }
+
+    // the iteration covers only committed keys, modifications buffered in a transaction are not visited
+    char key[mbed::KVStore::MAX_KEY_SIZE];
+    res_t count = 0;
+    while(kvstore->iterator_next(it, key, sizeof(key)) == KVSTORE_SUCCESS) {
+        KeyInfo info = { key, PT_BLOB, 0 };
+
+        mbed::KVStore::info_t kinfo;
+        if(sizes && kvstore->get_info(key, &kinfo) == KVSTORE_SUCCESS) {
+            info.size = kinfo.size;
+        }
+
+        count++;
+        if(!callback(info, arg)) {
+            break;
+        }
+    }
+    kvstore->iterator_close(it);
+
+    return count;
+}
+
+bool PortentaC33KVStore::openWrite(const key_t& key, size_t totalSize) {
+    abortWrite();
+
+    if(kvstore == nullptr || key == nullptr || totalSize == 0) {
+        return false;
+    }
+
+    // during a transaction the value must be buffered together with the other modifications
+    if(inTransaction) {
+        return KVStoreInterface::openWrite(key, totalSize);
+    }
+
+    if(kvstore->set_start(&writeHandle, key, totalSize, 0) != KVSTORE_SUCCESS) {
+        writeHandle = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+typename KVStoreInterface::res_t PortentaC33KVStore::write(const uint8_t chunk[], size_t len) {
+    if(writeHandle == nullptr) {
+        return KVStoreInterface::write(chunk, len);
+    }
+
+    return fromMbedErrors(kvstore->set_add_data(writeHandle, chunk, len), len);
+}
+
+bool PortentaC33KVStore::finalize() {
+    if(writeHandle == nullptr) {
+        return KVStoreInterface::finalize();
+    }
+
+    // the handle is released also when the finalization fails
+    int res = kvstore->set_finalize(writeHandle);
+    writeHandle = nullptr;
+
+    return res == KVSTORE_SUCCESS;
+}
+
+size_t PortentaC33KVStore::openRead(const key_t& key) {
+    closeRead();
+
+    const uint8_t* value;
+    size_t len;
+
+    if(kvstore == nullptr || key.length() == 0 || key.length() >= sizeof(readKey)) {
+        return 0;
+    }
+
+    // values modified in a transaction are read from the buffer
+    if(inTransaction && transaction.lookup(key, &value, &len)) {
+        return KVStoreInterface::openRead(key);
+    }
+
+    mbed::KVStore::info_t info;
+    if(kvstore->get_info(key, &info) != KVSTORE_SUCCESS) {
+        return 0;
+    }
+
+    strcpy(readKey, key);
+    return info.size;
+}
+
+typename KVStoreInterface::res_t PortentaC33KVStore::read(uint8_t chunk[], size_t len, size_t offset) {
+    if(readKey[0] == '\0') {
+        return KVStoreInterface::read(chunk, len, offset);
+    }
+
+    size_t actual = 0;
+    int res = kvstore->get(readKey, chunk, len, &actual, offset);
+
+    return fromMbedErrors(res, actual);
+}
+
+void PortentaC33KVStore::closeRead() {
+    readKey[0] = '\0';
+    KVStoreInterface::closeRead();
+}
+
+void PortentaC33KVStore::abortWrite() {
+    // finalizing a write that did not receive all the data discards it
+    if(writeHandle != nullptr) {
+        kvstore->set_finalize(writeHandle);
+        writeHandle = nullptr;
+    }
+}
+
+bool PortentaC33KVStore::beginTransaction() {
+    if(kvstore == nullptr || inTransaction) {
+        return false;
+    }
+
+    inTransaction = true;
+    return true;
+}
+
+bool PortentaC33KVStore::commit() {
+    if(kvstore == nullptr || !inTransaction) {
+        return false;
+    }
+
+    inTransaction = false;
+    return transaction.apply(*this);
+}
+
+bool PortentaC33KVStore::rollback() {
+    if(!inTransaction) {
+        return false;
+    }
+
+    inTransaction = false;
+    transaction.discard();
+    return true;
+}
+
 #endif // defined(ARDUINO_PORTENTA_C33)
@@ -9,6 +9,7 @@
  */
 #pragma once
 #include "../kvstore.h"
+#include "../utility/transaction.h"
 #include <KVStore.h>
 #include <TDBStore.h>
 #include "QSPIFlashBlockDevice.h"
@@ -31,7 +32,35 @@ public:
     typename KVStoreInterface::res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
     typename KVStoreInterface::res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
     size_t getBytesLength(const key_t& key) const override;
+
+    bool openWrite(const key_t& key, size_t totalSize) override;
+    res_t write(const uint8_t chunk[], size_t len) override;
+    bool finalize() override;
+    size_t openRead(const key_t& key) override;
+    res_t read(uint8_t chunk[], size_t len, size_t offset) override;
+    void closeRead() override;
+
+    bool beginTransaction() override;
+    bool commit() override;
+    bool rollback() override;
+
+    res_t removePrefix(const char* prefix) override;
+
+protected:
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
+    res_t _scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const override;
 private:
+    void abortWrite();
+
     MBRBlockDevice* bd;
     mbed::KVStore* kvstore;
+
+    // TDBStore commits every set, writes performed during a transaction are buffered in RAM
+    TransactionBuffer transaction;
+    bool inTransaction;
+
+    // streams opened outside of a transaction are mapped on set_start and offset reads
+    mbed::KVStore::set_handle_t writeHandle;
+    char readKey[mbed::KVStore::MAX_KEY_SIZE];
 };
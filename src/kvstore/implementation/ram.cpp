@@ -0,0 +1,422 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "ram.h"
+
+// control bytes of the slots that do not hold a key, full slots hold 7 bits of the hash of their key
+constexpr uint8_t CONTROL_EMPTY   = 0x80;
+constexpr uint8_t CONTROL_DELETED = 0xFE;
+
+constexpr uint64_t LSBS = 0x0101010101010101ULL;
+constexpr uint64_t MSBS = 0x8080808080808080ULL;
+
+// FNV-1a spreads short keys poorly over the high bits, they are mixed before being used by the index
+static inline uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static inline size_t h1(uint32_t hash)  { return hash >> 7; }
+static inline uint8_t h2(uint32_t hash) { return hash & 0x7F; }
+
+// the bytes are assembled explicitly, in order to have the first control byte in the lowest byte on every platform
+static inline uint64_t loadGroup(const uint8_t* controls) {
+    uint64_t group = 0;
+
+    for(size_t i=0; i<8; i++) {
+        group |= (uint64_t)controls[i] << (8 * i);
+    }
+
+    return group;
+}
+
+// the highest bit of every byte equal to h is set, a byte next to a matching one may be reported as well
+static inline uint64_t matchControl(uint64_t group, uint8_t h) {
+    uint64_t x = group ^ (LSBS * h);
+
+    return (x - LSBS) & ~x & MSBS;
+}
+
+static inline uint64_t matchEmpty(uint64_t group) {
+    return group & ~(group << 6) & MSBS;
+}
+
+static inline uint64_t matchEmptyOrDeleted(uint64_t group) {
+    return group & ~(group << 7) & MSBS;
+}
+
+static inline size_t lowestMatch(uint64_t match) {
+    return __builtin_ctzll(match) >> 3;
+}
+
+RamKVStore::RamKVStore(size_t chunkSize)
+: arena(chunkSize), slots(nullptr), controls(nullptr), capacity(0), count(0), growthLeft(0) { }
+
+bool RamKVStore::begin() {
+    return true;
+}
+
+bool RamKVStore::end() {
+    return clear();
+}
+
+bool RamKVStore::clear() {
+    arena.reset();
+
+    delete [] slots;
+    delete [] controls;
+
+    slots = nullptr;
+    controls = nullptr;
+    capacity = 0;
+    count = 0;
+    growthLeft = 0;
+
+    return true;
+}
+
+typename KVStoreInterface::res_t RamKVStore::remove(const key_t& key) {
+    if(key == nullptr) {
+        return 0;
+    }
+
+    size_t i = find(key, mix(key.hash()));
+
+    if(i == NOT_FOUND) {
+        return 0;
+    }
+
+    erase(i);
+    return 1;
+}
+
+bool RamKVStore::exists(const key_t& key) const {
+    return key != nullptr && find(key, mix(key.hash())) != NOT_FOUND;
+}
+
+typename KVStoreInterface::res_t RamKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    return skipPut(key, b, s, PT_BLOB) ? (res_t)s : _put(key, b, s, PT_BLOB);
+}
+
+typename KVStoreInterface::res_t RamKVStore::getBytes(const key_t& key, uint8_t b[], size_t s) const {
+    size_t i = key != nullptr ? find(key, mix(key.hash())) : NOT_FOUND;
+
+    if(i == NOT_FOUND) {
+        return 0;
+    }
+
+    const slot_t& slot = slots[i];
+
+    memcpy(b, valueOf(slot), s < slot.len ? s : slot.len);
+    return slot.len;
+}
+
+size_t RamKVStore::getBytesLength(const key_t& key) const {
+    size_t i = key != nullptr ? find(key, mix(key.hash())) : NOT_FOUND;
+
+    return i != NOT_FOUND ? slots[i].len : 0;
+}
+
+typename KVStoreInterface::View RamKVStore::getView(const key_t& key) const {
+    size_t i = key != nullptr ? find(key, mix(key.hash())) : NOT_FOUND;
+
+    if(i == NOT_FOUND) {
+        return { nullptr, 0 };
+    }
+
+    return { valueOf(slots[i]), slots[i].len };
+}
+
+typename KVStoreInterface::res_t RamKVStore::removePrefix(const char* prefix) {
+    if(prefix == nullptr) {
+        return 0;
+    }
+
+    size_t len = strlen(prefix);
+    res_t removed = 0;
+
+    // slots are only marked as deleted, thus the index can be modified while it is visited
+    for(size_t i=0; i<capacity; i++) {
+        if((controls[i] & CONTROL_EMPTY) == 0 && strncmp((const char*)slots[i].block, prefix, len) == 0) {
+            erase(i);
+            removed++;
+        }
+    }
+
+    return removed;
+}
+
+bool RamKVStore::reserve(size_t keys) {
+    size_t newCapacity = GROUP_SIZE;
+
+    while(newCapacity - newCapacity / 8 < keys) {
+        newCapacity *= 2;
+    }
+
+    return newCapacity <= capacity || rehash(newCapacity);
+}
+
+size_t RamKVStore::memoryUsage() const {
+    size_t index = capacity > 0 ? capacity * (sizeof(slot_t) + 1) + GROUP_SIZE - 1 : 0;
+
+    return arena.reserved() + index;
+}
+
+typename KVStoreInterface::res_t RamKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(key == nullptr || key.length() == 0 || key.length() > UINT16_MAX || (value == nullptr && len > 0)) {
+        return 0;
+    }
+
+    const uint32_t hash = mix(key.hash());
+    const size_t size = key.length() + 1 + len;
+    size_t i = find(key, hash);
+
+    if(i != NOT_FOUND) {
+        slot_t& slot = slots[i];
+        size_t oldSize = slot.keyLen + 1 + slot.len;
+
+        // the new value may come from a view over the old one
+        if(arena.capacity(oldSize) != arena.capacity(size)) {
+            uint8_t* block = arena.allocate(size);
+            uint8_t* old = slot.block;
+
+            // the old block is released only after the copy, since the free list is written in it
+            memcpy(block, old, slot.keyLen + 1);
+            memcpy(block + slot.keyLen + 1, value, len);
+            slot.block = block;
+            arena.release(old, oldSize);
+        } else {
+            // the block is reused when the new value falls in the same size class
+            memmove(valueOf(slot), value, len);
+        }
+        slot.len = len;
+        slot.type = t;
+
+        return len;
+    }
+
+    if(capacity == 0 && !grow()) {
+        return 0;
+    }
+
+    i = findFree(hash);
+
+    // deleted slots are reused without reducing the space left for new keys
+    if(controls[i] == CONTROL_EMPTY && growthLeft == 0) {
+        if(!grow()) {
+            return 0;
+        }
+
+        i = findFree(hash);
+    }
+
+    if(controls[i] == CONTROL_EMPTY) {
+        growthLeft--;
+    }
+
+    slot_t& slot = slots[i];
+
+    slot.block = arena.allocate(size);
+    slot.len = len;
+    slot.hash = hash;
+    slot.keyLen = key.length();
+    slot.type = t;
+
+    memcpy(slot.block, key.c_str(), slot.keyLen);
+    slot.block[slot.keyLen] = '\0';
+    memcpy(valueOf(slot), value, len);
+
+    setControl(i, h2(hash));
+    count++;
+
+    return len;
+}
+
+typename KVStoreInterface::res_t RamKVStore::_get(const key_t& key, uint8_t value[], size_t len, Type t) {
+    if(t != PT_STR) {
+        return getBytes(key, value, len);
+    }
+
+    size_t i = key != nullptr ? find(key, mix(key.hash())) : NOT_FOUND;
+
+    if(i == NOT_FOUND || len == 0) {
+        return 0;
+    }
+
+    const slot_t& slot = slots[i];
+    size_t n = slot.len < len ? slot.len : len - 1;
+
+    memcpy(value, valueOf(slot), n);
+    value[n] = '\0';
+
+    return slot.len;
+}
+
+typename KVStoreInterface::Status RamKVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    size_t i = key != nullptr ? find(key, mix(key.hash())) : NOT_FOUND;
+
+    if(i == NOT_FOUND) {
+        return ST_NOT_FOUND;
+    }
+
+    const slot_t& slot = slots[i];
+
+    if(t == PT_STR) {
+        _get(key, value, len, t);
+        return ST_FOUND;
+    }
+
+    // fixed size types must match both the type and the size of the stored value
+    if(t != PT_BLOB && ((slot.type != PT_BLOB && slot.type != t) || slot.len != len)) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    memcpy(value, valueOf(slot), len < slot.len ? len : slot.len);
+    return ST_FOUND;
+}
+
+typename KVStoreInterface::res_t RamKVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    return _scanPrefix(nullptr, callback, arg, sizes);
+}
+
+typename KVStoreInterface::res_t RamKVStore::_scanPrefix(
+        const char* prefix, KeyCallback callback, void* arg, bool sizes) const {
+    size_t len = prefix != nullptr ? strlen(prefix) : 0;
+    res_t res = 0;
+
+    for(size_t i=0; i<capacity; i++) {
+        const slot_t& slot = slots[i];
+
+        if((controls[i] & CONTROL_EMPTY) != 0 || strncmp((const char*)slot.block, prefix != nullptr ? prefix : "", len) != 0) {
+            continue;
+        }
+
+        res++;
+        if(!callback({ (const char*)slot.block, slot.type, sizes ? slot.len : 0 }, arg)) {
+            break;
+        }
+    }
+
+    return res;
+}
+
+size_t RamKVStore::find(const key_t& key, uint32_t hash) const {
+    if(capacity == 0) {
+        return NOT_FOUND;
+    }
+
+    const size_t mask = capacity - 1;
+    size_t pos = h1(hash) & mask;
+
+    // groups are probed with increasing steps, every slot is visited once the steps cover the capacity
+    for(size_t step = GROUP_SIZE;; step += GROUP_SIZE) {
+        uint64_t group = loadGroup(controls + pos);
+
+        for(uint64_t match = matchControl(group, h2(hash)); match != 0; match &= match - 1) {
+            const slot_t& slot = slots[(pos + lowestMatch(match)) & mask];
+
+            if(slot.hash == hash && slot.keyLen == key.length() && memcmp(slot.block, key.c_str(), slot.keyLen) == 0) {
+                return (pos + lowestMatch(match)) & mask;
+            }
+        }
+
+        // a key is never placed after an empty slot of its probe sequence
+        if(matchEmpty(group) != 0) {
+            return NOT_FOUND;
+        }
+
+        pos = (pos + step) & mask;
+    }
+}
+
+size_t RamKVStore::findFree(uint32_t hash) const {
+    const size_t mask = capacity - 1;
+    size_t pos = h1(hash) & mask;
+
+    for(size_t step = GROUP_SIZE;; step += GROUP_SIZE) {
+        uint64_t match = matchEmptyOrDeleted(loadGroup(controls + pos));
+
+        if(match != 0) {
+            return (pos + lowestMatch(match)) & mask;
+        }
+
+        pos = (pos + step) & mask;
+    }
+}
+
+// deleted slots are dropped when the index is rebuilt, its size is doubled only if it is more than half full
+bool RamKVStore::grow() {
+    if(capacity == 0) {
+        return rehash(GROUP_SIZE);
+    }
+
+    return rehash(count < capacity / 2 ? capacity : capacity * 2);
+}
+
+bool RamKVStore::rehash(size_t newCapacity) {
+    slot_t* oldSlots = slots;
+    uint8_t* oldControls = controls;
+    size_t oldCapacity = capacity;
+
+    slots = new slot_t[newCapacity];
+    controls = new uint8_t[newCapacity + GROUP_SIZE - 1];
+    capacity = newCapacity;
+    growthLeft = newCapacity - newCapacity / 8 - count;
+
+    if(slots == nullptr || controls == nullptr) {
+        delete [] slots;
+        delete [] controls;
+
+        slots = oldSlots;
+        controls = oldControls;
+        capacity = oldCapacity;
+        growthLeft = 0;
+        return false;
+    }
+
+    memset(controls, CONTROL_EMPTY, newCapacity + GROUP_SIZE - 1);
+
+    for(size_t i=0; i<oldCapacity; i++) {
+        if((oldControls[i] & CONTROL_EMPTY) == 0) {
+            size_t j = findFree(oldSlots[i].hash);
+
+            slots[j] = oldSlots[i];
+            setControl(j, oldControls[i]);
+        }
+    }
+
+    delete [] oldSlots;
+    delete [] oldControls;
+
+    return true;
+}
+
+void RamKVStore::erase(size_t index) {
+    slot_t& slot = slots[index];
+
+    arena.release(slot.block, slot.keyLen + 1 + slot.len);
+    slot.block = nullptr;
+
+    setControl(index, CONTROL_DELETED);
+    count--;
+}
+
+void RamKVStore::setControl(size_t index, uint8_t control) {
+    controls[index] = control;
+
+    // the copy allows to load a group starting from any slot without wrapping around
+    if(index < GROUP_SIZE - 1) {
+        controls[capacity + index] = control;
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include "../kvstore.h"
+#include "../utility/arena.h"
+
+/** RamKVStore class
+ *
+ * Volatile store that keeps keys and values in RAM, available on every platform. It is meant to be used
+ * as a fast scratch store and as the backing store of caching layers.
+ * Every key is stored together with its value in a block taken from an Arena, blocks are reused when
+ * a value is overwritten with one of a similar size.
+ * Keys are indexed by an open addressing hash table with one control byte per slot, holding 7 bits of
+ * the hash of the key. Lookups compare a group of 8 control bytes at once and access only the slots
+ * whose control byte matches. Missing keys are reported with return values, never with exceptions.
+ * Values can be accessed without copies with getView, a view is invalidated by a modification of its key.
+ * The content of the store is lost when end is called.
+ */
+class RamKVStore: public KVStoreInterface {
+public:
+    RamKVStore(size_t chunkSize=DEFAULT_ARENA_CHUNK_SIZE);
+    ~RamKVStore() { end(); }
+
+    bool begin() override;
+    bool end() override;
+    bool clear() override;
+
+    res_t remove(const key_t& key) override;
+    bool exists(const key_t& key) const override;
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
+    size_t getBytesLength(const key_t& key) const override;
+    View getView(const key_t& key) const override;
+
+    res_t removePrefix(const char* prefix) override;
+
+    /**
+     * @brief size the index in order to hold a number of keys without being rebuilt
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool reserve(size_t keys);
+
+    /**
+     * @brief get the number of keys in the store
+     */
+    inline size_t size() const { return count; }
+
+    /**
+     * @brief get the number of bytes taken from the heap by the index, the keys and the values
+     */
+    size_t memoryUsage() const;
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+    res_t _get(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
+    res_t _scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const override;
+
+private:
+    // the block of a slot holds the null terminated key followed by the value
+    typedef struct {
+        uint8_t* block;
+        size_t len;
+        uint32_t hash;
+        uint16_t keyLen;
+        Type type;
+    } slot_t;
+
+    static constexpr size_t GROUP_SIZE = 8;
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    size_t find(const key_t& key, uint32_t hash) const;
+    size_t findFree(uint32_t hash) const;
+    bool grow();
+    bool rehash(size_t newCapacity);
+    void erase(size_t index);
+    void setControl(size_t index, uint8_t control);
+
+    inline uint8_t* valueOf(const slot_t& s) const { return s.block + s.keyLen + 1; }
+
+    Arena arena;
+
+    slot_t* slots;
+    uint8_t* controls; // one byte per slot, followed by a copy of the first GROUP_SIZE-1 bytes
+    size_t capacity;   // number of slots, a power of two
+    size_t count;
+    size_t growthLeft; // number of empty slots that can be used before the index is rebuilt
+};
@@ -0,0 +1,640 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "tdb.h"
+#include "../utility/crc.h"
+
+// magic (4 bytes), version (2), reserved (2), counter (4), crc (4)
+constexpr uint32_t AREA_MAGIC = 0x54444241; // TDBA
+constexpr uint16_t AREA_VERSION = 1;
+constexpr size_t AREA_HEADER_SIZE = 16;
+
+// magic (4 bytes), key length (2), flags (2), value length (4), crc (4), followed by the key and the value
+constexpr uint32_t RECORD_MAGIC = 0x54444252; // TDBR
+constexpr size_t RECORD_HEADER_SIZE = 16;
+
+// the lowest byte of the flags marks removals, the highest one holds the type of the value
+constexpr uint16_t RECORD_REMOVED = 0x0001;
+
+constexpr size_t WORK_BUFFER_SIZE = 256;
+constexpr size_t NOT_FOUND = SIZE_MAX;
+
+static void packRecordHeader(uint8_t header[RECORD_HEADER_SIZE], uint16_t keyLen, uint16_t flags, uint32_t len) {
+    memcpy(header, &RECORD_MAGIC, 4);
+    memcpy(header + 4, &keyLen, 2);
+    memcpy(header + 6, &flags, 2);
+    memcpy(header + 8, &len, 4);
+}
+
+TDBKVStore::TDBKVStore(KVBlockDevice& bd)
+: bd(bd), started(false), programSize(1), areaSize(0), activeArea(0), counter(0), freeOffset(0),
+  table(nullptr), entries(0), capacity(0), work(nullptr), workSize(0), stageAddr(0), stageFill(0) {
+    resetStats();
+}
+
+bool TDBKVStore::begin() {
+    if(started) {
+        return false;
+    }
+
+    if(bd.init() != BD_ERROR_OK) {
+        return false;
+    }
+
+    programSize = bd.getProgramSize();
+    areaSize = bd.size() / 2 / bd.getEraseSize() * bd.getEraseSize();
+
+    if(areaSize == 0 || areaSize > UINT32_MAX) {
+        bd.deinit();
+        return false;
+    }
+
+    workSize = align(WORK_BUFFER_SIZE);
+    work = new uint8_t[workSize];
+    started = true;
+
+    uint32_t counters[2];
+    bool valid[2] = { readAreaHeader(0, &counters[0]), readAreaHeader(1, &counters[1]) };
+
+    // the area written last is the active one
+    if(!valid[0] && !valid[1]) {
+        activeArea = 0;
+        entries = 0;
+
+        if(!format(1)) {
+            end();
+            return false;
+        }
+        return true;
+    }
+
+    activeArea = valid[1] && (!valid[0] || counters[1] > counters[0]) ? 1 : 0;
+    counter = counters[activeArea];
+
+    if(!scan()) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+bool TDBKVStore::end() {
+    if(!started) {
+        return true;
+    }
+
+    delete [] table;
+    delete [] work;
+
+    table = nullptr;
+    work = nullptr;
+    entries = 0;
+    capacity = 0;
+    started = false;
+
+    return bd.deinit() == BD_ERROR_OK;
+}
+
+bool TDBKVStore::clear() {
+    if(!started) {
+        return false;
+    }
+
+    // the second area is erased as well, in order not to find its records again at the next begin
+    if(!erase(areaStart(1), areaSize)) {
+        return false;
+    }
+
+    entries = 0;
+    activeArea = 0;
+
+    return format(counter + 1);
+}
+
+typename KVStoreInterface::res_t TDBKVStore::remove(const key_t& key) {
+    if(!started || key == nullptr || key.length() == 0 || key.length() > TDB_MAX_KEY_SIZE) {
+        return -1;
+    }
+
+    size_t pos = find(key.c_str(), key.length(), key.hash(), nullptr);
+
+    if(pos == NOT_FOUND) {
+        return 0;
+    }
+
+    // the removal is recorded in order not to find the previous records of the key at the next begin
+    return append(key.c_str(), key.length(), key.hash(), nullptr, 0, RECORD_REMOVED) < 0 ? -1 : 1;
+}
+
+bool TDBKVStore::exists(const key_t& key) const {
+    return started && key != nullptr && key.length() <= TDB_MAX_KEY_SIZE &&
+        find(key.c_str(), key.length(), key.hash(), nullptr) != NOT_FOUND;
+}
+
+typename KVStoreInterface::res_t TDBKVStore::putBytes(const key_t& key, const uint8_t b[], size_t s) {
+    return skipPut(key, b, s, PT_BLOB) ? (res_t)s : _put(key, b, s, PT_BLOB);
+}
+
+typename KVStoreInterface::res_t TDBKVStore::getBytes(const key_t& key, uint8_t b[], size_t s) const {
+    if(!started || key == nullptr || key.length() > TDB_MAX_KEY_SIZE) {
+        return -1;
+    }
+
+    record_t record;
+    size_t pos = find(key.c_str(), key.length(), key.hash(), &record);
+
+    if(pos == NOT_FOUND) {
+        return 0;
+    }
+
+    size_t n = s < record.len ? s : record.len;
+    if(bd.read(b, table[pos].offset + RECORD_HEADER_SIZE + record.keyLen, n) != BD_ERROR_OK) {
+        return -1;
+    }
+
+    return record.len;
+}
+
+size_t TDBKVStore::getBytesLength(const key_t& key) const {
+    if(!started || key == nullptr || key.length() > TDB_MAX_KEY_SIZE) {
+        return 0;
+    }
+
+    record_t record;
+    return find(key.c_str(), key.length(), key.hash(), &record) != NOT_FOUND ? record.len : 0;
+}
+
+bool TDBKVStore::gc() {
+    if(!started) {
+        return false;
+    }
+
+    size_t standby = 1 - activeArea;
+    size_t offset = areaStart(standby) + align(AREA_HEADER_SIZE);
+    uint32_t* offsets = new uint32_t[entries > 0 ? entries : 1];
+    bool res = erase(areaStart(standby), areaSize);
+
+    // records are copied as they are, their size is already a multiple of the program size
+    for(size_t i=0; res && i<entries; i++) {
+        record_t record;
+        res = readRecord(table[i].offset, &record, nullptr);
+
+        size_t size = align(RECORD_HEADER_SIZE + record.keyLen + record.len);
+        for(size_t done = 0; res && done < size;) {
+            size_t n = size - done < workSize ? size - done : workSize;
+
+            res = bd.read(work, table[i].offset + done, n) == BD_ERROR_OK &&
+                program(work, offset + done, n);
+            done += n;
+        }
+
+        offsets[i] = offset;
+        offset += size;
+        stats.gcBytes += size;
+    }
+
+    // the area becomes valid only once all the records have been copied
+    res = res && writeAreaHeader(standby, counter + 1);
+
+    if(res) {
+        for(size_t i=0; i<entries; i++) {
+            table[i].offset = offsets[i];
+        }
+
+        activeArea = standby;
+        counter++;
+        freeOffset = offset;
+        stats.gcCount++;
+    }
+
+    delete [] offsets;
+    return res;
+}
+
+size_t TDBKVStore::getFreeSpace() const {
+    return started ? areaStart(activeArea) + areaSize - freeOffset : 0;
+}
+
+void TDBKVStore::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool TDBKVStore::physicalWear(PhysicalWear& wear) const {
+    memset(&wear, 0, sizeof(wear));
+
+    wear.eraseCount = stats.eraseCount;
+    wear.programBytes = stats.programBytes;
+    wear.gcCount = stats.gcCount;
+
+    return true;
+}
+
+typename KVStoreInterface::res_t TDBKVStore::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(!started || key == nullptr || key.length() == 0 || key.length() > TDB_MAX_KEY_SIZE ||
+            len > UINT32_MAX || (value == nullptr && len > 0)) {
+        return -1;
+    }
+
+    return append(key.c_str(), key.length(), key.hash(), value, len, (uint16_t)t << 8);
+}
+
+typename KVStoreInterface::Status TDBKVStore::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    if(!started || key == nullptr || key.length() > TDB_MAX_KEY_SIZE || len == 0) {
+        return ST_ERROR;
+    }
+
+    record_t record;
+    size_t pos = find(key.c_str(), key.length(), key.hash(), &record);
+
+    if(pos == NOT_FOUND) {
+        return ST_NOT_FOUND;
+    }
+
+    Type stored = (Type)(record.flags >> 8);
+
+    // fixed size types must match both the type and the size of the stored value
+    if(t != PT_STR && t != PT_BLOB && ((stored != PT_BLOB && stored != t) || record.len != len)) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    size_t maxLen = t == PT_STR ? len - 1 : len;
+    size_t n = record.len < maxLen ? record.len : maxLen;
+
+    if(bd.read(value, table[pos].offset + RECORD_HEADER_SIZE + record.keyLen, n) != BD_ERROR_OK) {
+        return ST_ERROR;
+    }
+
+    if(t == PT_STR) {
+        value[n] = '\0';
+    }
+
+    return ST_FOUND;
+}
+
+typename KVStoreInterface::res_t TDBKVStore::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    if(!started) {
+        return -1;
+    }
+
+    char key[TDB_MAX_KEY_SIZE + 1];
+    res_t count = 0;
+
+    for(size_t i=0; i<entries; i++) {
+        record_t record;
+
+        if(!readRecord(table[i].offset, &record, key)) {
+            return -1;
+        }
+
+        count++;
+        if(!callback({ key, (Type)(record.flags >> 8), sizes ? record.len : 0 }, arg)) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+bool TDBKVStore::format(uint32_t counter) {
+    if(!erase(areaStart(activeArea), areaSize) || !writeAreaHeader(activeArea, counter)) {
+        return false;
+    }
+
+    this->counter = counter;
+    freeOffset = areaStart(activeArea) + align(AREA_HEADER_SIZE);
+
+    return true;
+}
+
+bool TDBKVStore::scan() {
+    const size_t end = areaStart(activeArea) + areaSize;
+    size_t offset = areaStart(activeArea) + align(AREA_HEADER_SIZE);
+    char key[TDB_MAX_KEY_SIZE + 1];
+
+    stats.scanRecords = 0;
+    stats.scanBytes = 0;
+
+    while(offset + RECORD_HEADER_SIZE <= end) {
+        uint8_t header[RECORD_HEADER_SIZE];
+        record_t record;
+        uint32_t magic, crc;
+
+        if(bd.read(header, offset, RECORD_HEADER_SIZE) != BD_ERROR_OK) {
+            return false;
+        }
+
+        memcpy(&magic, header, 4);
+        memcpy(&record.keyLen, header + 4, 2);
+        memcpy(&record.flags, header + 6, 2);
+        memcpy(&record.len, header + 8, 4);
+        memcpy(&crc, header + 12, 4);
+
+        size_t size = align(RECORD_HEADER_SIZE + record.keyLen + record.len);
+
+        if(magic != RECORD_MAGIC || record.keyLen == 0 || record.keyLen > TDB_MAX_KEY_SIZE || size > end - offset) {
+            break;
+        }
+
+        // the key and the value are read in chunks in order to check the CRC
+        uint32_t actual = crc32(0, header, RECORD_HEADER_SIZE - 4);
+        size_t len = record.keyLen + record.len;
+
+        for(size_t done = 0; done < len;) {
+            size_t n = len - done < workSize ? len - done : workSize;
+
+            if(bd.read(work, offset + RECORD_HEADER_SIZE + done, n) != BD_ERROR_OK) {
+                return false;
+            }
+
+            if(done < record.keyLen) {
+                size_t k = record.keyLen - done < n ? record.keyLen - done : n;
+                memcpy(key + done, work, k);
+            }
+
+            actual = crc32(actual, work, n);
+            done += n;
+        }
+
+        stats.scanRecords++;
+        stats.scanBytes += RECORD_HEADER_SIZE + len;
+
+        if(actual != crc) {
+            break;
+        }
+
+        key[record.keyLen] = '\0';
+        uint32_t hash = Key::hash(key, record.keyLen);
+        size_t pos = find(key, record.keyLen, hash, nullptr);
+
+        if(record.flags & RECORD_REMOVED) {
+            if(pos != NOT_FOUND) {
+                removeEntry(pos);
+            }
+        } else if(pos != NOT_FOUND) {
+            table[pos].offset = offset;
+        } else {
+            insertEntry(hash, offset);
+        }
+
+        offset += size;
+    }
+
+    freeOffset = offset;
+
+    // a record that was not completely written leaves bytes that cannot be programmed again
+    uint8_t tail[RECORD_HEADER_SIZE];
+    size_t n = end - offset < RECORD_HEADER_SIZE ? end - offset : RECORD_HEADER_SIZE;
+
+    if(n > 0 && bd.read(tail, offset, n) != BD_ERROR_OK) {
+        return false;
+    }
+
+    for(size_t i=0; i<n; i++) {
+        if(tail[i] != bd.getEraseValue()) {
+            return gc();
+        }
+    }
+
+    return true;
+}
+
+size_t TDBKVStore::find(const char* key, size_t keyLen, uint32_t hash, record_t* record) const {
+    size_t low = 0, high = entries;
+
+    while(low < high) {
+        size_t mid = (low + high) / 2;
+
+        if(table[mid].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // different keys may share the hash, the key of every candidate is read from the device
+    for(size_t i = low; i < entries && table[i].hash == hash; i++) {
+        char stored[TDB_MAX_KEY_SIZE + 1];
+        record_t r;
+
+        if(readRecord(table[i].offset, &r, stored) && r.keyLen == keyLen && memcmp(stored, key, keyLen) == 0) {
+            if(record != nullptr) {
+                *record = r;
+            }
+            return i;
+        }
+    }
+
+    return NOT_FOUND;
+}
+
+bool TDBKVStore::readRecord(uint32_t offset, record_t* record, char* key) const {
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint32_t magic;
+
+    if(bd.read(header, offset, RECORD_HEADER_SIZE) != BD_ERROR_OK) {
+        return false;
+    }
+
+    memcpy(&magic, header, 4);
+    memcpy(&record->keyLen, header + 4, 2);
+    memcpy(&record->flags, header + 6, 2);
+    memcpy(&record->len, header + 8, 4);
+
+    if(magic != RECORD_MAGIC || record->keyLen > TDB_MAX_KEY_SIZE) {
+        return false;
+    }
+
+    if(key != nullptr) {
+        if(bd.read(key, offset + RECORD_HEADER_SIZE, record->keyLen) != BD_ERROR_OK) {
+            return false;
+        }
+        key[record->keyLen] = '\0';
+    }
+
+    return true;
+}
+
+typename KVStoreInterface::res_t TDBKVStore::append(
+        const char* key, size_t keyLen, uint32_t hash, const uint8_t value[], size_t len, uint16_t flags) {
+    size_t size = align(RECORD_HEADER_SIZE + keyLen + len);
+
+    if(!reserve(size)) {
+        return -1;
+    }
+
+    uint8_t header[RECORD_HEADER_SIZE];
+    packRecordHeader(header, keyLen, flags, len);
+
+    uint32_t crc = crc32(0, header, RECORD_HEADER_SIZE - 4);
+    crc = crc32(crc, (const uint8_t*)key, keyLen);
+    crc = crc32(crc, value, len);
+    memcpy(header + 12, &crc, 4);
+
+    size_t offset = freeOffset;
+    stageAddr = offset;
+    stageFill = 0;
+
+    // the area after a partial record cannot be used anymore
+    freeOffset += size;
+
+    if(!stage(header, RECORD_HEADER_SIZE) || !stage(key, keyLen) || !stage(value, len) || !stageEnd()) {
+        return -1;
+    }
+
+    stats.userBytes += keyLen + len;
+    stats.recordBytes += size;
+
+    size_t pos = find(key, keyLen, hash, nullptr);
+
+    if(flags & RECORD_REMOVED) {
+        if(pos != NOT_FOUND) {
+            removeEntry(pos);
+        }
+    } else if(pos != NOT_FOUND) {
+        table[pos].offset = offset;
+    } else {
+        insertEntry(hash, offset);
+    }
+
+    return len;
+}
+
+bool TDBKVStore::reserve(size_t size) {
+    size_t end = areaStart(activeArea) + areaSize;
+
+    if(freeOffset + size <= end) {
+        return true;
+    }
+
+    if(size > areaSize - align(AREA_HEADER_SIZE)) {
+        return false;
+    }
+
+    return gc() && freeOffset + size <= areaStart(activeArea) + areaSize;
+}
+
+bool TDBKVStore::writeAreaHeader(size_t area, uint32_t counter) {
+    uint8_t header[AREA_HEADER_SIZE];
+    uint16_t reserved = 0;
+
+    memcpy(header, &AREA_MAGIC, 4);
+    memcpy(header + 4, &AREA_VERSION, 2);
+    memcpy(header + 6, &reserved, 2);
+    memcpy(header + 8, &counter, 4);
+
+    uint32_t crc = crc32(0, header, AREA_HEADER_SIZE - 4);
+    memcpy(header + 12, &crc, 4);
+
+    stageAddr = areaStart(area);
+    stageFill = 0;
+
+    return stage(header, AREA_HEADER_SIZE) && stageEnd();
+}
+
+bool TDBKVStore::readAreaHeader(size_t area, uint32_t* counter) const {
+    uint8_t header[AREA_HEADER_SIZE];
+    uint32_t magic, crc;
+    uint16_t version;
+
+    if(bd.read(header, areaStart(area), AREA_HEADER_SIZE) != BD_ERROR_OK) {
+        return false;
+    }
+
+    memcpy(&magic, header, 4);
+    memcpy(&version, header + 4, 2);
+    memcpy(counter, header + 8, 4);
+    memcpy(&crc, header + 12, 4);
+
+    return magic == AREA_MAGIC && version == AREA_VERSION && crc == crc32(0, header, AREA_HEADER_SIZE - 4);
+}
+
+bool TDBKVStore::erase(size_t addr, size_t size) {
+    size_t eraseSize = bd.getEraseSize();
+
+    stats.eraseCount += (size + eraseSize - 1) / eraseSize;
+
+    return bd.erase(addr, size) == BD_ERROR_OK;
+}
+
+bool TDBKVStore::program(const void* buffer, size_t addr, size_t size) {
+    stats.programBytes += size;
+
+    return bd.program(buffer, addr, size) == BD_ERROR_OK;
+}
+
+bool TDBKVStore::stage(const void* data, size_t len) {
+    const uint8_t* src = (const uint8_t*)data;
+
+    while(len > 0) {
+        size_t n = workSize - stageFill < len ? workSize - stageFill : len;
+
+        memcpy(work + stageFill, src, n);
+        stageFill += n;
+        src += n;
+        len -= n;
+
+        if(stageFill == workSize) {
+            if(!program(work, stageAddr, workSize)) {
+                return false;
+            }
+
+            stageAddr += workSize;
+            stageFill = 0;
+        }
+    }
+
+    return true;
+}
+
+// the last bytes are padded to the program size with the value of erased bytes
+bool TDBKVStore::stageEnd() {
+    if(stageFill == 0) {
+        return true;
+    }
+
+    size_t size = align(stageFill);
+    memset(work + stageFill, bd.getEraseValue(), size - stageFill);
+
+    bool res = program(work, stageAddr, size);
+
+    stageAddr += size;
+    stageFill = 0;
+
+    return res;
+}
+
+void TDBKVStore::insertEntry(uint32_t hash, uint32_t offset) {
+    if(entries == capacity) {
+        size_t newCapacity = capacity > 0 ? capacity * 2 : 16;
+        ram_entry_t* newTable = new ram_entry_t[newCapacity];
+
+        if(table != nullptr) {
+            memcpy(newTable, table, entries * sizeof(ram_entry_t));
+        }
+
+        delete [] table;
+        table = newTable;
+        capacity = newCapacity;
+    }
+
+    // the table is kept sorted by hash
+    size_t pos;
+    for(pos = entries; pos > 0 && table[pos - 1].hash > hash; pos--) {
+        table[pos] = table[pos - 1];
+    }
+
+    table[pos] = { hash, offset };
+    entries++;
+}
+
+void TDBKVStore::removeEntry(size_t pos) {
+    memmove(table + pos, table + pos + 1, (entries - pos - 1) * sizeof(ram_entry_t));
+    entries--;
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include "../kvstore.h"
+#include "../utility/blockdevice.h"
+
+constexpr size_t TDB_MAX_KEY_SIZE = 128;
+
+/** TDBKVStore class
+ *
+ * Log structured store on a KVBlockDevice, that follows the model of the mbed TDBStore used by the
+ * Portenta backends, for the platforms where it is not available and for measuring the behaviour
+ * of a key/value mix on the host with a RamBlockDevice.
+ *
+ * The device is split in two areas, only one of them is active. Every put and remove appends a record,
+ * made of a header with a CRC, the key and the value, at the end of the active area. The RAM holds
+ * a table with the hash and the offset of every live record, sorted by hash.
+ * When the active area is full the live records are copied to the other area, which becomes the
+ * active one once the copy is complete, thus the erases are spread over the whole device.
+ * begin scans the active area in order to build the table, a record that was not completely written
+ * ends the scan and causes a garbage collection, since the area after it cannot be programmed.
+ */
+class TDBKVStore: public KVStoreInterface {
+public:
+    typedef struct {
+        size_t gcCount;         // garbage collections performed
+        size_t gcBytes;         // bytes copied by the garbage collections
+        size_t scanRecords;     // records read by the last begin
+        size_t scanBytes;       // bytes read by the last begin
+        size_t userBytes;       // bytes of keys and values written by put and remove
+        size_t recordBytes;     // bytes of records programmed by put and remove, including headers and padding
+        size_t eraseCount;      // blocks erased on the device
+        size_t programBytes;    // bytes programmed on the device by any operation
+    } stats_t;
+
+    TDBKVStore(KVBlockDevice& bd);
+    ~TDBKVStore() { end(); }
+
+    bool begin() override;
+    bool end() override;
+    bool clear() override;
+
+    res_t remove(const key_t& key) override;
+    bool exists(const key_t& key) const override;
+    res_t putBytes(const key_t& key, const uint8_t b[], size_t s) override;
+    res_t getBytes(const key_t& key, uint8_t b[], size_t s) const override;
+    size_t getBytesLength(const key_t& key) const override;
+
+    /**
+     * @brief copy the live records to the other area and make it the active one
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool gc();
+
+    /**
+     * @brief get the number of bytes that can be appended to the active area before a garbage collection
+     */
+    size_t getFreeSpace() const;
+
+    inline const stats_t& getStats() const { return stats; }
+    void resetStats();
+
+    bool physicalWear(PhysicalWear& wear) const override;
+
+protected:
+    res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t) override;
+    Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t) override;
+    res_t _forEach(KeyCallback callback, void* arg, bool sizes) const override;
+
+private:
+    typedef struct {
+        uint32_t hash;
+        uint32_t offset;
+    } ram_entry_t;
+
+    typedef struct {
+        uint16_t keyLen;
+        uint16_t flags;
+        uint32_t len;
+    } record_t;
+
+    bool format(uint32_t counter);
+    bool scan();
+    size_t find(const char* key, size_t keyLen, uint32_t hash, record_t* record) const;
+    bool readRecord(uint32_t offset, record_t* record, char* key) const;
+    res_t append(const char* key, size_t keyLen, uint32_t hash, const uint8_t value[], size_t len, uint16_t flags);
+    bool reserve(size_t size);
+
+    bool writeAreaHeader(size_t area, uint32_t counter);
+    bool readAreaHeader(size_t area, uint32_t* counter) const;
+
+    // the device is erased and programmed only through these, in order to account for the wear
+    bool erase(size_t addr, size_t size);
+    bool program(const void* buffer, size_t addr, size_t size);
+
+    bool stage(const void* data, size_t len);
+    bool stageEnd();
+
+    void insertEntry(uint32_t hash, uint32_t offset);
+    void removeEntry(size_t pos);
+
+    inline size_t align(size_t size) const { return (size + programSize - 1) / programSize * programSize; }
+    inline size_t areaStart(size_t area) const { return area * areaSize; }
+
+    KVBlockDevice& bd;
+    bool started;
+
+    size_t programSize;
+    size_t areaSize;
+    size_t activeArea;
+    uint32_t counter;
+    size_t freeOffset;
+
+    ram_entry_t* table;
+    size_t entries;
+    size_t capacity;
+
+    // buffer used to program records in units of the program size and to copy them
+    uint8_t* work;
+    size_t workSize;
+    size_t stageAddr;
+    size_t stageFill;
+
+    stats_t stats;
+};
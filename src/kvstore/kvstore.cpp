@@ -9,35 +9,51 @@
  */
 #include "kvstore.h"
 
-template<typename T>
-typename KVStoreInterface::res_t KVStoreInterface::put(const key_t& key, T value) {
-    return _put(key, (uint8_t*)&value, sizeof(value), getType(value));
-}
+// size of the stack buffer used to read short strings into an Arduino String
+constexpr size_t STRING_BUFFER_SIZE = 32;
+
+// memory used by removePrefix to collect the keys to remove, bigger than the longest key of every backend
+constexpr size_t REMOVE_PREFIX_BUFFER_SIZE = 256;
+
+// size of the stack buffer used to compare short values with the stored ones
+constexpr size_t COMPARE_BUFFER_SIZE = 64;
 
 template<>
 typename KVStoreInterface::res_t KVStoreInterface::put<const char*>(const key_t& key, const char* value) {
-    return _put(key, (uint8_t*)value, strlen(value), PT_STR);
+    return _putString(key, value, strlen(value), putIfChangedMode);
+}
+
+template<>
+typename KVStoreInterface::res_t KVStoreInterface::putIfChanged<const char*>(const key_t& key, const char* value) {
+    return _putString(key, value, strlen(value), true);
 }
 
 #ifdef ARDUINO
 template<>
 typename KVStoreInterface::res_t KVStoreInterface::put<String>(const key_t& key, String value) {
-    return _put(key, (uint8_t*)value.c_str(), value.length(), PT_STR);
+    return _putString(key, value.c_str(), value.length(), putIfChangedMode);
+}
+
+template<>
+typename KVStoreInterface::res_t KVStoreInterface::putIfChanged<String>(const key_t& key, String value) {
+    return _putString(key, value.c_str(), value.length(), true);
 }
 #endif // ARDUINO
 
-template<typename T> // TODO this could be called when class is const
-KVStoreInterface::reference<T> KVStoreInterface::get(const key_t& key, const T def) {
-    if(exists(key)) {
-        T t;
-        auto res = _get(key, (uint8_t*)&t, sizeof(t), getType(t));
+typename KVStoreInterface::res_t KVStoreInterface::_putString(const key_t& key, const char* value, size_t len, bool ifChanged) {
+    if(ifChanged && _unchanged(key, (const uint8_t*)value, len, PT_STR)) {
+        return len;
+    }
 
-        if(res > 0) {
-            return KVStoreInterface::reference<T>(key, t, *this);
-        }
+    return _put(key, (const uint8_t*)value, len, PT_STR);
+}
+
+typename KVStoreInterface::res_t KVStoreInterface::putBytesIfChanged(const key_t& key, const uint8_t b[], size_t s) {
+    if(_unchanged(key, b, s, PT_BLOB)) {
+        return s;
     }
 
-    return KVStoreInterface::reference<T>(key, def, *this);
+    return putBytes(key, b, s);
 }
 
 size_t   KVStoreInterface::putChar(const key_t& key, const int8_t value)             { return put(key, value); }
@@ -73,24 +89,366 @@ uint64_t KVStoreInterface::getULong64(const key_t& key, const uint64_t defaultVa
 float    KVStoreInterface::getFloat(const key_t& key, const float defaultValue)      { return get(key, defaultValue); }
 double   KVStoreInterface::getDouble(const key_t& key, const double defaultValue)    { return get(key, defaultValue); }
 bool     KVStoreInterface::getBool(const key_t& key, const bool defaultValue)        { return get(key, defaultValue); }
-size_t   KVStoreInterface::getString(const key_t& key, char* value, size_t maxLen)   { return _get(key, (uint8_t*)value, maxLen, PT_STR); }
+
+size_t KVStoreInterface::getString(const key_t& key, char* value, size_t maxLen) {
+    if(value == nullptr || maxLen == 0) {
+        return getBytesLength(key);
+    }
+
+    if(_get(key, (uint8_t*)value, maxLen, PT_STR) <= 0) {
+        value[0] = '\0';
+        return 0;
+    }
+
+    size_t len = strlen(value);
+
+    // the length is asked to the store only when the buffer was filled and the string may be truncated
+    return len + 1 < maxLen ? len : getBytesLength(key);
+}
 
 #ifdef ARDUINO
+/*
+ * String filled in place: the value is written in the reserved buffer and the length is set afterwards.
+ * The ESP cores keep the length behind an accessor, the others in a protected member
+ */
+class StringBuffer: public String {
+public:
+    void setLength(size_t n) {
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+        setLen(n);
+#else
+        len = n;
+#endif
+    }
+};
+
 String KVStoreInterface::getString(const key_t& key, const String defaultValue) {
-    size_t len = getBytesLength(key);
-    char *str = new char[len+1];
+    char buf[STRING_BUFFER_SIZE];
+    size_t len = getString(key, buf, sizeof(buf));
+
+    if(len == 0) {
+        // nothing was read, the key may hold an empty string
+        return exists(key) ? String() : defaultValue;
+    } else if(len < sizeof(buf)) {
+        return String(buf);
+    }
+
+    // the String is reserved once and filled without intermediate copies of the whole value
+    StringBuffer res;
+    if(!res.reserve(len)) {
+        return defaultValue;
+    }
 
-    getString(key, str, len+1);
-    str[len] = '\0';
+    View view = getView(key);
+    if(view.data != nullptr) {
+        res.concat((const char*)view.data, strnlen((const char*)view.data, view.len));
+        return res;
+    }
 
-    String res(str);
-    delete str;
-    str = nullptr;
+    // reserve provides room also for the terminator
+    char* str = res.begin();
+    if(getString(key, str, len + 1) != len) {
+        return defaultValue;
+    }
+    res.setLength(strlen(str));
 
     return res;
 }
 #endif // ARDUINO
 
+KVStoreInterface::KVStoreInterface()
+: cells(nullptr), putIfChangedMode(false), writeStream{ nullptr, nullptr, 0, 0 }, readStream{ nullptr, nullptr, 0, 0 } {}
+
+KVStoreInterface::~KVStoreInterface() {
+    closeStream(writeStream);
+    closeStream(readStream);
+}
+
+typename KVStoreInterface::View KVStoreInterface::getView(const key_t& key) const {
+    (void) key;
+
+    return { nullptr, 0 };
+}
+
+bool KVStoreInterface::openWrite(const key_t& key, size_t totalSize) {
+    closeStream(writeStream);
+
+    if(key == nullptr || totalSize == 0) {
+        return false;
+    }
+
+    // the value can only be put as a whole, thus it is collected in RAM until finalize is called
+    size_t keyLen = key.length();
+    writeStream.key = new char[keyLen + 1];
+    memcpy(writeStream.key, key, keyLen + 1);
+
+    writeStream.buffer = new uint8_t[totalSize];
+    writeStream.size = totalSize;
+    writeStream.offset = 0;
+
+    return true;
+}
+
+typename KVStoreInterface::res_t KVStoreInterface::write(const uint8_t chunk[], size_t len) {
+    if(writeStream.key == nullptr || chunk == nullptr || writeStream.offset + len > writeStream.size) {
+        return -1;
+    }
+
+    memcpy(writeStream.buffer + writeStream.offset, chunk, len);
+    writeStream.offset += len;
+
+    return len;
+}
+
+bool KVStoreInterface::finalize() {
+    bool res = writeStream.key != nullptr && writeStream.offset == writeStream.size &&
+        putBytes(writeStream.key, writeStream.buffer, writeStream.size) == (res_t)writeStream.size;
+
+    closeStream(writeStream);
+
+    return res;
+}
+
+size_t KVStoreInterface::openRead(const key_t& key) {
+    closeStream(readStream);
+
+    if(key == nullptr) {
+        return 0;
+    }
+
+    size_t len = getBytesLength(key);
+    if(len == 0) {
+        return 0;
+    }
+
+    size_t keyLen = key.length();
+    readStream.key = new char[keyLen + 1];
+    memcpy(readStream.key, key, keyLen + 1);
+    readStream.size = len;
+
+    // values in RAM are read through a view, the others need to be loaded as a whole
+    if(getView(key).data == nullptr) {
+        readStream.buffer = new uint8_t[len];
+
+        if(getBytes(key, readStream.buffer, len) != (res_t)len) {
+            closeStream(readStream);
+            return 0;
+        }
+    }
+
+    return len;
+}
+
+typename KVStoreInterface::res_t KVStoreInterface::read(uint8_t chunk[], size_t len, size_t offset) {
+    if(readStream.key == nullptr || chunk == nullptr || offset > readStream.size) {
+        return -1;
+    }
+
+    // a view is invalidated by modifications, it is requested again at every read
+    const uint8_t* data = readStream.buffer;
+    size_t size = readStream.size;
+
+    if(data == nullptr) {
+        View view = getView(readStream.key);
+        data = view.data;
+        size = view.len;
+    }
+
+    if(data == nullptr || offset > size) {
+        return -1;
+    }
+
+    size_t n = size - offset < len ? size - offset : len;
+    memcpy(chunk, data + offset, n);
+
+    return n;
+}
+
+void KVStoreInterface::closeRead() {
+    closeStream(readStream);
+}
+
+void KVStoreInterface::closeStream(stream_t& stream) {
+    delete [] stream.key;
+    delete [] stream.buffer;
+
+    stream = { nullptr, nullptr, 0, 0 };
+}
+
+bool KVStoreInterface::flush() {
+    bool res = true;
+
+    for(cell_t* c = cells; c != nullptr; c = c->next) {
+        res = flushCell(c) && res;
+    }
+
+    return res;
+}
+
+typename KVStoreInterface::cell_t* KVStoreInterface::acquireCell(const key_t& key, Type t, size_t size, const uint8_t* def) {
+    for(cell_t* c = cells; c != nullptr; c = c->next) {
+        if(c->type == t && c->key.hash() == key.hash() && strcmp(c->key, key) == 0) {
+            c->refs++;
+            return c;
+        }
+    }
+
+    size_t keyLen = key.length();
+
+    cell_t* c = new cell_t;
+    char* copy = new char[keyLen + 1];
+    memcpy(copy, key, keyLen + 1);
+    c->key = copy;
+
+    c->value = new uint8_t[size];
+    c->size = size;
+    c->type = t;
+    c->dirty = false;
+    c->refs = 1;
+
+    if(_tryGet(key, c->value, size, t) != ST_FOUND) {
+        memcpy(c->value, def, size);
+    }
+
+    c->next = cells;
+    cells = c;
+
+    return c;
+}
+
+void KVStoreInterface::releaseCell(cell_t* c) {
+    if(--c->refs > 0) {
+        return;
+    }
+
+    flushCell(c);
+
+    cell_t** prev = &cells;
+    while(*prev != c) {
+        prev = &(*prev)->next;
+    }
+    *prev = c->next;
+
+    delete [] c->key.c_str();
+    delete [] c->value;
+    delete c;
+}
+
+bool KVStoreInterface::flushCell(cell_t* c) {
+    if(!c->dirty) {
+        return true;
+    }
+
+    if(_put(c->key, c->value, c->size, c->type) <= 0) {
+        return false;
+    }
+
+    c->dirty = false;
+    return true;
+}
+
+void KVStoreInterface::loadCell(cell_t* c) {
+    uint8_t* value = new uint8_t[c->size];
+
+    // the value is left untouched if the key is missing
+    if(_tryGet(c->key, value, c->size, c->type) == ST_FOUND) {
+        memcpy(c->value, value, c->size);
+    }
+    c->dirty = false;
+
+    delete [] value;
+}
+
+size_t KVStoreInterface::putMany(Entry entries[], size_t count) {
+    size_t res = 0;
+
+    for(size_t i=0; i<count; i++) {
+        entries[i].res = _put(entries[i].key, entries[i].value, entries[i].len, entries[i].type);
+
+        if(entries[i].res > 0) {
+            res++;
+        }
+    }
+
+    return res;
+}
+
+size_t KVStoreInterface::getMany(Entry entries[], size_t count) {
+    size_t res = 0;
+
+    for(size_t i=0; i<count; i++) {
+        entries[i].res = _get(entries[i].key, entries[i].value, entries[i].len, entries[i].type);
+
+        if(entries[i].res > 0) {
+            res++;
+        }
+    }
+
+    return res;
+}
+
+bool KVStoreInterface::beginTransaction() {
+    return false;
+}
+
+bool KVStoreInterface::commit() {
+    return false;
+}
+
+bool KVStoreInterface::rollback() {
+    return false;
+}
+
+typename KVStoreInterface::res_t KVStoreInterface::removePrefix(const char* prefix) {
+    if(prefix == nullptr) {
+        return 0;
+    }
+
+    // keys cannot be removed while the store is being iterated, they are collected in a fixed size buffer
+    // and removed after every pass, a new pass is needed only when the buffer was not big enough
+    struct context_t {
+        char keys[REMOVE_PREFIX_BUFFER_SIZE];
+        size_t used;
+        bool full;
+    } ctx;
+
+    res_t removed = 0;
+    bool progress = true;
+
+    do {
+        ctx.used = 0;
+        ctx.full = false;
+
+        res_t res = _scanPrefix(prefix, [](const KeyInfo& info, void* arg) {
+            context_t* ctx = (context_t*)arg;
+            size_t len = strlen(info.key) + 1;
+
+            if(ctx->used + len > sizeof(ctx->keys)) {
+                ctx->full = true;
+                return false;
+            }
+
+            memcpy(ctx->keys + ctx->used, info.key, len);
+            ctx->used += len;
+            return true;
+        }, &ctx, false);
+
+        if(res < 0) {
+            return removed > 0 ? removed : res;
+        }
+
+        progress = false;
+        for(size_t i=0; i<ctx.used; i+=strlen(ctx.keys + i) + 1) {
+            if(remove(ctx.keys + i) > 0) {
+                removed++;
+                progress = true;
+            }
+        }
+    } while(ctx.full && progress);
+
+    return removed;
+}
+
 typename KVStoreInterface::res_t KVStoreInterface::_put(const key_t& key, const uint8_t value[], size_t len, Type t) {
     (void) t;
 
@@ -104,7 +462,10 @@ typename KVStoreInterface::res_t KVStoreInterface::_get(const key_t& key, uint8_
         res_t res=0;
         if(t == PT_STR) {
             res = getBytes(key, value, len-1);
-            value[res] = '\0';
+
+            // getBytes returns the size of the value, that may be bigger than the buffer
+            size_t n = res <= 0 ? 0 : ((size_t)res < len ? res : len-1);
+            value[n] = '\0';
         } else {
             res = getBytes(key, value, len);
         }
@@ -114,3 +475,92 @@ typename KVStoreInterface::res_t KVStoreInterface::_get(const key_t& key, uint8_
         return 0;
     }
 }
+
+typename KVStoreInterface::Status KVStoreInterface::_tryGet(const key_t& key, uint8_t value[], size_t len, Type t) {
+    if(!exists(key)) {
+        return ST_NOT_FOUND;
+    }
+
+    res_t res = _get(key, value, len, t);
+
+    if(res <= 0) {
+        return ST_ERROR;
+    }
+
+    // fixed size types must match exactly the size of the stored value
+    if(t != PT_STR && t != PT_BLOB && (size_t)res != len) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    return ST_FOUND;
+}
+
+bool KVStoreInterface::_unchanged(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(key == nullptr || (value == nullptr && len > 0)) {
+        return false;
+    }
+
+    // backends like NVS count the terminator of strings in their length
+    size_t stored = getBytesLength(key);
+    if(stored != len && (t != PT_STR || stored != len + 1)) {
+        return false;
+    }
+
+    // strings are read with room for one more character, in order to tell apart a longer stored string.
+    // The type is checked by the backends that store it
+    size_t size = t == PT_STR ? len + 2 : len;
+    uint8_t stack[COMPARE_BUFFER_SIZE];
+    uint8_t* buffer = size <= sizeof(stack) ? stack : new uint8_t[size];
+
+    bool res = _tryGet(key, buffer, size, t) == ST_FOUND && memcmp(buffer, value, len) == 0 &&
+        (t != PT_STR || buffer[len] == '\0');
+
+    if(buffer != stack) {
+        delete [] buffer;
+    }
+
+    return res;
+}
+
+typename KVStoreInterface::res_t KVStoreInterface::_forEach(KeyCallback callback, void* arg, bool sizes) const {
+    (void) callback;
+    (void) arg;
+    (void) sizes;
+
+    return -1;
+}
+
+typename KVStoreInterface::res_t KVStoreInterface::_scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const {
+    if(prefix == nullptr) {
+        return _forEach(callback, arg, sizes);
+    }
+
+    struct context_t {
+        const KVStoreInterface* store;
+        const char* prefix;
+        size_t len;
+        KeyCallback callback;
+        void* arg;
+        bool sizes;
+        res_t count;
+    } ctx = { this, prefix, strlen(prefix), callback, arg, sizes, 0 };
+
+    // sizes are read only for the matching keys
+    res_t res = _forEach([](const KeyInfo& info, void* arg) {
+        context_t* ctx = (context_t*)arg;
+
+        if(strncmp(info.key, ctx->prefix, ctx->len) != 0) {
+            return true;
+        }
+
+        KeyInfo i = info;
+        if(ctx->sizes) {
+            i.size = ctx->store->getBytesLength(info.key);
+        }
+
+        ctx->count++;
+        return ctx->callback(i, ctx->arg);
+    }, &ctx, false);
+
+    return res < 0 ? res : ctx.count;
+}
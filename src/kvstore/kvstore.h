@@ -17,6 +17,7 @@
 #endif // ARDUINO
 
 #include <math.h>
+#include <array>
 #include <type_traits>
 
 /** KVStoreInterface class
@@ -30,7 +31,51 @@
 class KVStoreInterface {
 public:
 
-    typedef const char* Key;
+    /** Key class
+     *
+     * Key of a value in the store, it carries the length and the 32 bit FNV-1a hash of the string
+     * it points to. When a key is declared constexpr from a string literal they are computed at compile
+     * time, e.g. constexpr KVStoreInterface::Key OFFSET("offset"); otherwise they are computed once when
+     * the key is built. Keys are implicitly built from and converted to const char*, the string is not copied
+     */
+    class Key {
+    public:
+        constexpr Key(): Key(nullptr, 0) {}
+
+        // string literals and char arrays, the length is the one of the string they contain
+        template<size_t N>
+        constexpr Key(const char (&s)[N]): Key(s, strLength(s, N)) {}
+
+        // any other null terminated string
+        template<typename T, typename std::enable_if<
+            std::is_convertible<T, const char*>::value && !std::is_array<T>::value, int>::type = 0>
+        constexpr Key(const T& s): Key(s, strLength(s, SIZE_MAX)) {}
+
+        constexpr operator const char*() const  { return str; }
+
+        constexpr const char* c_str() const     { return str; }
+        constexpr size_t length() const         { return len; }
+        constexpr uint32_t hash() const         { return h; }
+
+        // hash of a string that is not available as a Key
+        static constexpr uint32_t hash(const char* s, size_t n, uint32_t h = FNV_OFFSET) {
+            return n == 0 ? h : hash(s + 1, n - 1, static_cast<uint32_t>((h ^ static_cast<uint8_t>(*s)) * FNV_PRIME));
+        }
+    private:
+        constexpr Key(const char* s, size_t n): str(s), len(n), h(hash(s, n)) {}
+
+        static constexpr size_t strLength(const char* s, size_t max, size_t n = 0) {
+            return s == nullptr || n == max || s[n] == '\0' ? n : strLength(s, max, n + 1);
+        }
+
+        static constexpr uint32_t FNV_OFFSET = 2166136261u;
+        static constexpr uint32_t FNV_PRIME = 16777619u;
+
+        const char* str;
+        size_t len;
+        uint32_t h;
+    };
+
     typedef Key key_t;
     typedef int res_t;
 
@@ -38,6 +83,68 @@ public:
         PT_I8, PT_U8, PT_I16, PT_U16, PT_I32, PT_U32, PT_I64, PT_U64, PT_STR, PT_BLOB, PT_INVALID, PT_FLOAT, PT_DOUBLE,
     } Type;
 
+    /** Status enum
+     *
+     * outcome of a read performed with tryGet
+     */
+    typedef enum {
+        ST_FOUND, ST_NOT_FOUND, ST_TYPE_MISMATCH, ST_ERROR,
+    } Status;
+
+    /** Entry struct
+     *
+     * key/value/type triple used by the batch operations putMany and getMany.
+     * After the batch is executed res holds the result of the single operation,
+     * with the same meaning of the value returned by put and get
+     */
+    typedef struct {
+        key_t key;
+        uint8_t* value;
+        size_t len;
+        Type type;
+        res_t res;
+    } Entry;
+
+    /** KeyInfo struct
+     *
+     * information about a stored key provided while iterating over the store,
+     * key points to a buffer that is valid only during the callback
+     */
+    typedef struct {
+        const char* key;
+        Type type;
+        size_t size;
+    } KeyInfo;
+
+    /**
+     * callback called for every key while iterating over the store,
+     * it returns false to stop the iteration
+     */
+    typedef bool (*KeyCallback)(const KeyInfo& info, void* arg);
+
+    /** PhysicalWear struct
+     *
+     * activity on the storage medium as seen by the backend, including metadata, padding and the copies
+     * made by garbage collections. Counters that the backend cannot observe are left to 0
+     */
+    typedef struct {
+        uint32_t eraseCount;    // erased blocks
+        uint64_t programBytes;  // programmed bytes
+        uint32_t gcCount;       // garbage collections or compactions
+        uint32_t usedEntries;   // entries in use, for the backends made of fixed size entries
+        uint32_t freeEntries;   // entries still available, for the backends made of fixed size entries
+    } PhysicalWear;
+
+    /** View struct
+     *
+     * read-only span over a value kept in RAM by the store, it is valid until the next modification
+     * of the store. data is nullptr when the key does not exist or the store cannot provide a view
+     */
+    typedef struct {
+        const uint8_t* data;
+        size_t len;
+    } View;
+
     // TODO this is an utility function for kvstore should this stay here?
     /**
      * @brief This function translate a cpp kind to a Preferences Type at compile time
@@ -100,10 +207,86 @@ public:
         KVStoreInterface& owner;
     };
 
+private:
+    // value shared by all the deferred references to the same key
+    typedef struct cell {
+        key_t key; // copy owned by the cell
+        uint8_t* value;
+        size_t size;
+        Type type;
+        bool dirty;
+        size_t refs;
+
+        struct cell* next;
+    } cell_t;
+
+public:
+    /** deferred_reference class
+     *
+     * Handle to a value of the store that is written back only when the last handle to its key
+     * is destroyed or when flush is called. All the handles to the same key share a single value,
+     * thus a write through one of them is seen by the others without reloading it.
+     * Handles must not outlive the store they belong to
+     */
+    template<typename T>
+    class deferred_reference {
+    public:
+        deferred_reference(const key_t &key, const T& def, KVStoreInterface& owner)
+        : cell(owner.acquireCell(key, getType(def), sizeof(T), (const uint8_t*)&def)), owner(owner) {}
+
+        deferred_reference(const deferred_reference<T>& r) noexcept
+        : cell(r.cell), owner(r.owner) {
+            cell->refs++;
+        }
+
+        // the last handle to a key writes back its value
+        ~deferred_reference()        { owner.releaseCell(cell); }
+
+        // assign a new value to the reference, the store is updated later
+        deferred_reference& operator=(T t) noexcept {
+            memcpy(cell->value, &t, sizeof(T));
+            cell->dirty = true;
+            return *this;
+        }
+
+        // assign a new value to the reference copying from another reference value
+        deferred_reference& operator=(const deferred_reference<T>& r) noexcept {
+            return *this = r.getValue();
+        }
+
+        // get the referenced value
+        T operator*() const noexcept { return getValue(); }
+
+        // cast the reference to the value it contains -> get the value references
+        operator T () const noexcept { return getValue(); }
+
+        inline key_t getKey() const  { return cell->key; }
+        inline T getValue() const    { T t; memcpy(&t, cell->value, sizeof(T)); return t; }
+        inline bool isDirty() const  { return cell->dirty; }
+
+        // discard the modifications and load the stored value
+        void load()                  { owner.loadCell(cell); }
+
+        // write back the value if it was modified
+        bool flush()                 { return owner.flushCell(cell); }
+
+        // check if this reference is contained in the store
+        bool exists() const          { return owner.exists(cell->key); }
+
+        // remove this reference from the store, pending modifications are discarded
+        res_t remove()               { cell->dirty = false; return owner.remove(cell->key); }
+    private:
+        cell_t* cell;
+
+        KVStoreInterface& owner;
+    };
+
+    KVStoreInterface();
+
     /**
-     * @brief virtual empty destructor
+     * @brief virtual destructor, it releases the streams left open
      */
-    virtual ~KVStoreInterface() {};
+    virtual ~KVStoreInterface();
 
     /**
      * @brief function that provides initializatiopn for the KV store
@@ -175,9 +358,194 @@ public:
      */
     virtual size_t getBytesLength(const key_t& key) const = 0;
 
+    /**
+     * @brief get a read-only view over the value referenced by key without copying it,
+     *        available only for the stores that keep their values in RAM.
+     *        The view is invalidated by any following modification of the store
+     *
+     * @param[in]  key              Key
+     *
+     * @returns a view with data != nullptr if the key exists and its value is in RAM,
+     *          an empty view otherwise, in that case getBytes must be used
+     */
+    virtual View getView(const key_t& key) const;
+
+    /**
+     * @brief start writing a value in chunks, without the need of having it in a single buffer.
+     *        The value is not visible in the store until finalize is called, only one write
+     *        can be open at a time, opening a new one discards the previous one.
+     *        Backends that cannot write in chunks buffer the whole value in RAM
+     *
+     * @param[in]  key              Key
+     * @param[in]  totalSize        size of the value, the sum of all the chunks must match it
+     *
+     * @returns true on correct execution false otherwise
+     */
+    virtual bool openWrite(const key_t& key, size_t totalSize);
+
+    /**
+     * @brief append a chunk to the value opened with openWrite
+     *
+     * @param[in]  chunk            data to append
+     * @param[in]  len              length of the chunk
+     *
+     * @returns the number of bytes written, 0 or less on error
+     */
+    virtual res_t write(const uint8_t chunk[], size_t len);
+
+    /**
+     * @brief store the value opened with openWrite, it fails if less than totalSize bytes were written
+     *
+     * @returns true on correct execution false otherwise
+     */
+    virtual bool finalize();
+
+    /**
+     * @brief start reading a value in chunks, only one read can be open at a time.
+     *        Backends that cannot read at an offset load the whole value in RAM, unless
+     *        they provide a view over it
+     *
+     * @param[in]  key              Key
+     *
+     * @returns the size of the value, 0 if the key does not exist
+     */
+    virtual size_t openRead(const key_t& key);
+
+    /**
+     * @brief read a chunk of the value opened with openRead
+     *
+     * @param[out] chunk            buffer where the chunk is copied
+     * @param[in]  len              size of the buffer
+     * @param[in]  offset           offset in the value of the first byte to read
+     *
+     * @returns the number of bytes read, less than len at the end of the value, negative on error
+     */
+    virtual res_t read(uint8_t chunk[], size_t len, size_t offset);
+
+    /**
+     * @brief release the resources held by the read opened with openRead
+     */
+    virtual void closeRead();
+
+    /**
+     * @brief put a batch of values in the store as a single unit. The default implementation
+     *        puts one entry after the other, backends should override it when they can
+     *        perform the whole batch with a single access to the storage
+     *
+     * @param[in,out] entries       array of entries to insert, res is updated for every entry
+     * @param[in]  count            the number of entries in the array
+     *
+     * @returns the number of entries correctly inserted
+     */
+    virtual size_t putMany(Entry entries[], size_t count);
+
+    /**
+     * @brief get a batch of values from the store as a single unit. The default implementation
+     *        gets one entry after the other, backends should override it when they can
+     *        perform the whole batch with a single access to the storage
+     *
+     * @param[in,out] entries       array of entries to get, value is filled with at most len bytes
+     *                              and res is updated for every entry
+     * @param[in]  count            the number of entries in the array
+     *
+     * @returns the number of entries correctly retrieved
+     */
+    virtual size_t getMany(Entry entries[], size_t count);
+
+    /**
+     * @brief start a transaction, all the modifications performed until commit or rollback are called
+     *        are applied to the store together. Backends that do not support transactions return false
+     *        and apply every modification immediately
+     *
+     * @returns true on correct execution false otherwise
+     */
+    virtual bool beginTransaction();
+
+    /**
+     * @brief apply all the modifications performed since beginTransaction was called. Backends that
+     *        buffer the modifications in RAM replay them one by one, if one of them fails the
+     *        following ones are dropped while the ones before it stay applied
+     *
+     * @returns true on correct execution false otherwise
+     */
+    virtual bool commit();
+
+    /**
+     * @brief discard all the modifications performed since beginTransaction was called
+     *
+     * @returns true on correct execution false if the modifications could not be discarded
+     */
+    virtual bool rollback();
+
+    /**
+     * @brief iterate over all the keys contained in the store, without loading them all in memory.
+     *        Backends that do not keep track of the type of values report PT_BLOB
+     *
+     * @param[in]  callback         function called for every key, if it returns false the iteration stops
+     * @param[in]  arg              argument passed to the callback
+     * @param[in]  sizes            if true the size of every value is provided, this may require
+     *                              an additional access to the store for every key
+     *
+     * @returns the number of keys visited, a negative value if the store cannot be iterated
+     */
+    inline res_t forEach(KeyCallback callback, void* arg=nullptr, bool sizes=false) const {
+        return _forEach(callback, arg, sizes);
+    }
+
+    /**
+     * @brief iterate over all the keys contained in the store with a callable object,
+     *        it must accept a const KeyInfo& and return a bool
+     *
+     * @param[in]  f                callable called for every key, if it returns false the iteration stops
+     * @param[in]  sizes            if true the size of every value is provided
+     *
+     * @returns the number of keys visited, a negative value if the store cannot be iterated
+     */
+    template<typename F>
+    res_t forEach(F f, bool sizes=false) const;
+
+    /**
+     * @brief iterate over the keys starting with a prefix, e.g. "sensor/3/" for all the keys of a device.
+     *        Backends that can filter keys natively visit only the matching ones
+     *
+     * @param[in]  prefix           prefix the keys must start with
+     * @param[in]  callback         function called for every matching key, if it returns false the iteration stops
+     * @param[in]  arg              argument passed to the callback
+     * @param[in]  sizes            if true the size of every value is provided
+     *
+     * @returns the number of keys visited, a negative value if the store cannot be iterated
+     */
+    inline res_t scanPrefix(const char* prefix, KeyCallback callback, void* arg=nullptr, bool sizes=false) const {
+        return _scanPrefix(prefix, callback, arg, sizes);
+    }
+
+    /**
+     * @brief iterate over the keys starting with a prefix with a callable object,
+     *        it must accept a const KeyInfo& and return a bool
+     *
+     * @param[in]  prefix           prefix the keys must start with
+     * @param[in]  f                callable called for every matching key, if it returns false the iteration stops
+     * @param[in]  sizes            if true the size of every value is provided
+     *
+     * @returns the number of keys visited, a negative value if the store cannot be iterated
+     */
+    template<typename F>
+    res_t scanPrefix(const char* prefix, F f, bool sizes=false) const;
+
+    /**
+     * @brief remove all the keys starting with a prefix, without the need of knowing them in advance
+     *
+     * @param[in]  prefix           prefix the keys must start with
+     *
+     * @returns the number of keys removed, a negative value if the store cannot be iterated
+     */
+    virtual res_t removePrefix(const char* prefix);
+
     /**
      * @brief templated method that puts a value of a certain type T
-     *        by converting it to a bytearray and puts it into the KV store
+     *        by converting it to a bytearray and puts it into the KV store.
+     *        Trivially copyable structs and std::array are stored as a single blob, prefixed by a descriptor
+     *        of their layout that is checked when they are read back
      *
      * @param[in]  key              Key
      * @param[in]  value            Value to insert
@@ -187,6 +555,72 @@ public:
     template<typename T> // TODO handle std::string
     res_t put(const key_t& key, T value);
 
+    /**
+     * @brief put an array as a single blob, e.g. a float[3][3] matrix is written at once
+     *        instead of using a key for every element. char arrays are stored as strings
+     *
+     * @param[in]  key              Key
+     * @param[in]  value            array to insert
+     *
+     * @returns the size of the array on correct execution anything else otherwise
+     */
+    template<typename T, size_t N, typename std::enable_if<
+        !std::is_same<typename std::remove_cv<T>::type, char>::value, int>::type = 0>
+    res_t put(const key_t& key, const T (&value)[N]) {
+        return _putValue(key, value, std::true_type(), putIfChangedMode);
+    }
+
+    /**
+     * @brief put a value only if it is different from the stored one: the stored length, type and content
+     *        are read and compared first, the write is skipped when they are equal. This saves a flash
+     *        cycle and a commit at the cost of a read, it pays off when the same values are saved repeatedly
+     *
+     * @param[in]  key              Key
+     * @param[in]  value            Value to insert
+     *
+     * @returns the size of the value both when it is written and when it was already stored,
+     *          anything else otherwise
+     */
+    template<typename T>
+    res_t putIfChanged(const key_t& key, T value);
+
+    /**
+     * @brief putBytes only if the stored value is different, see putIfChanged
+     *
+     * @param[in]  key              Key
+     * @param[in]  b                buffer to insert
+     * @param[in]  s                size of the buffer
+     *
+     * @returns the size of the buffer both when it is written and when it was already stored,
+     *          anything else otherwise
+     */
+    res_t putBytesIfChanged(const key_t& key, const uint8_t b[], size_t s);
+
+    /**
+     * @brief make every put of the store behave as putIfChanged, decorators apply it to the wrapped store too
+     *
+     * @param[in]  enable           true to compare the values before writing them
+     */
+    virtual void setPutIfChanged(bool enable) { putIfChangedMode = enable; }
+
+    /**
+     * @returns true if the puts are skipped when the stored value is equal to the new one
+     */
+    inline bool getPutIfChanged() const { return putIfChangedMode; }
+
+    /**
+     * @brief templated method that reads a value of a certain type T, telling apart the reasons of
+     *        a failure with a single access to the store on the backends that support it
+     *
+     * @param[in]  key              Key
+     * @param[out] value            the value read, it is modified only if ST_FOUND is returned
+     *
+     * @returns ST_FOUND if the value was read, ST_NOT_FOUND if the key does not exist,
+     *          ST_TYPE_MISMATCH if the stored value has a different type and ST_ERROR otherwise
+     */
+    template<typename T>
+    Status tryGet(const key_t& key, T& value);
+
     /**
      * @brief templated method that gets a value of a certain type T. If it doesn't exist in the store a
      *        reference is returned, which is not saved, until the proper method is called
@@ -206,8 +640,8 @@ public:
      * @returns a reference to the desired key
      */
     template<typename T>
-    inline reference<T>& operator[](const key_t& key) { // write access to the value
-        return get<T>(key);
+    inline deferred_reference<T> operator[](const key_t& key) { // write access to the value
+        return getDeferred<T>(key);
     }
 
     /**
@@ -218,10 +652,43 @@ public:
      * @returns a read-only reference to the desired key
      */
     template<typename T>
-    inline const reference<T>& operator[](const key_t& key) const { // ro access to the value
-        return get<T>(key);
+    inline const deferred_reference<T> operator[](const key_t& key) const { // ro access to the value
+        // the handle is const, thus it cannot modify the store
+        return const_cast<KVStoreInterface*>(this)->getDeferred<T>(key);
     }
 
+    /**
+     * @brief templated method that gets a deferred reference to a value of a certain type T.
+     *        Assignments are kept in RAM and written back when the last reference to the key
+     *        is destroyed or when flush is called
+     *
+     * @param[in]  key              Key
+     * @param[in]  def              value of the reference if the key does not exist in the store
+     *
+     * @returns a deferred reference to the desired key
+     */
+    template<typename T>
+    inline deferred_reference<T> getDeferred(const key_t& key, const T def = 0) {
+        return deferred_reference<T>(key, def, *this);
+    }
+
+    /**
+     * @brief write back the values modified through deferred references
+     *
+     * @returns true on correct execution false otherwise
+     */
+    virtual bool flush();
+
+    /**
+     * @brief get the erase and program counters of the storage medium, in order to compute
+     *        the write amplification of the backend
+     *
+     * @param[out] wear             the counters, set to 0 before being filled
+     *
+     * @returns true if the backend exposes the counters, false otherwise
+     */
+    virtual bool physicalWear(PhysicalWear& wear) const { memset(&wear, 0, sizeof(wear)); return false; }
+
     // TODO all these methods should be const
     /**
      * @brief put a char in the kvstore
@@ -506,28 +973,39 @@ public:
     virtual bool        getBool(const key_t& key, const bool defaultValue = false);
 
     /**
-     * @brief get a C string in the kvstore
+     * @brief get a C string in the kvstore without allocating memory, the buffer is always null terminated.
+     *        As snprintf does, a string that does not fit is truncated, backends that cannot read
+     *        a string partially leave the buffer empty
      *
      * @param[in]  key              Key
-     * @param[in]  defaultValue     in the case the key do not exist this value is returned
+     * @param[out] value            buffer where the string is copied, it can be nullptr if maxLen is 0
+     * @param[in]  maxLen           size of the buffer, including the terminator
      *
-     * @returns the value present in the kvstore or defaultValue if not present
+     * @returns the length of the stored string, 0 if the key does not exist. If it is greater than
+     *          or equal to maxLen the string was truncated and a buffer of at least the returned
+     *          value + 1 bytes is required
      */
     virtual size_t      getString(const key_t& key, char* value, size_t maxLen);
 
 #ifdef ARDUINO
     /**
-     * @brief get an Arduino String in the kvstore
+     * @brief get an Arduino String in the kvstore, short strings are read on the stack
+     *        and longer ones straight into the reserved String, or copied from a view
      *
      * @param[in]  key              Key
      * @param[in]  defaultValue     in the case the key do not exist this value is returned
      *
-     * @returns the value present in the kvstore or defaultValue if not present
+     * @returns the value present in the kvstore, also when empty, or defaultValue if not present
      */
     virtual String getString(const key_t& key, const String defaultValue = String());
 #endif // ARDUINO
 
 protected:
+    // decorators need to forward the protected methods to the store they wrap
+    friend class KVStoreDecorator;
+    // transactions buffered in RAM replay the puts with their type
+    friend class TransactionBuffer;
+
     // some implementations may need type-specific get and put methods, this can be performed by passing
     // type information as parameter to the get call and overcome the limitation of not being able to
     // override a templated method in cpp
@@ -535,6 +1013,91 @@ protected:
     virtual res_t _put(const key_t& key, const uint8_t value[], size_t len, Type t);
 
     virtual res_t _get(const key_t& key, uint8_t value[], size_t len, Type t);
+
+    // the default implementation checks the existence of the key before reading it, backends that are able
+    // to tell a missing key from a failure in a single access should override it
+    virtual Status _tryGet(const key_t& key, uint8_t value[], size_t len, Type t);
+
+    // the default implementation reports that the store cannot be iterated
+    virtual res_t _forEach(KeyCallback callback, void* arg, bool sizes) const;
+
+    // the default implementation filters the keys visited by _forEach
+    virtual res_t _scanPrefix(const char* prefix, KeyCallback callback, void* arg, bool sizes) const;
+
+    // the default implementation reads the stored value and compares it, backends that keep the size
+    // or a digest of the values in RAM can override it in order to avoid the read
+    virtual bool _unchanged(const key_t& key, const uint8_t value[], size_t len, Type t);
+
+    // putBytes of the backends calls it first, in order to honour the mode set with setPutIfChanged
+    inline bool skipPut(const key_t& key, const uint8_t value[], size_t len, Type t) {
+        return putIfChangedMode && _unchanged(key, value, len, t);
+    }
+
+private:
+    // trivially copyable structs and arrays are stored as a single blob prefixed by a descriptor
+    template<typename T>
+    struct is_composite: std::integral_constant<bool, std::is_trivially_copyable<T>::value &&
+        (std::is_class<T>::value || std::is_array<T>::value)> {};
+
+    // scalar type and number of the elements of a composite value, nested arrays are flattened
+    template<typename T>
+    struct composite_traits {
+        typedef T element_type;
+        static constexpr size_t count() { return 1; }
+    };
+
+    template<typename T, size_t N>
+    struct composite_traits<T[N]> {
+        typedef typename composite_traits<T>::element_type element_type;
+        static constexpr size_t count() { return N * composite_traits<T>::count(); }
+    };
+
+    template<typename T, size_t N>
+    struct composite_traits<std::array<T, N>> {
+        typedef typename composite_traits<T>::element_type element_type;
+        static constexpr size_t count() { return N * composite_traits<T>::count(); }
+    };
+
+    // element type, element size and element count, little endian
+    static constexpr size_t DESCRIPTOR_SIZE = 5;
+
+    template<typename T>
+    static void describe(uint8_t descriptor[DESCRIPTOR_SIZE]);
+
+    template<typename T>
+    res_t _putValue(const key_t& key, const T& value, std::false_type, bool ifChanged);
+
+    template<typename T>
+    res_t _putValue(const key_t& key, const T& value, std::true_type, bool ifChanged);
+
+    res_t _putString(const key_t& key, const char* value, size_t len, bool ifChanged);
+
+    template<typename T>
+    Status _tryGetValue(const key_t& key, T& value, std::false_type);
+
+    template<typename T>
+    Status _tryGetValue(const key_t& key, T& value, std::true_type);
+
+    cell_t* acquireCell(const key_t& key, Type t, size_t size, const uint8_t* def);
+    void releaseCell(cell_t* c);
+    bool flushCell(cell_t* c);
+    void loadCell(cell_t* c);
+
+    cell_t* cells;
+    bool putIfChangedMode;
+
+    // state of the streams opened with the default implementation of openWrite and openRead
+    typedef struct {
+        char* key;
+        uint8_t* buffer;
+        size_t size;
+        size_t offset;
+    } stream_t;
+
+    stream_t writeStream;
+    stream_t readStream;
+
+    static void closeStream(stream_t& stream);
 };
 
 /* We need to ignore the warning "unused parameter" since we cannot add more instructions
@@ -599,3 +1162,136 @@ template<>
 constexpr typename KVStoreInterface::Type KVStoreInterface::getType<const uint8_t*>(const uint8_t* t)   { return PT_BLOB; }
 
 #pragma GCC diagnostic pop
+
+template<typename T>
+typename KVStoreInterface::res_t KVStoreInterface::put(const key_t& key, T value) {
+    return _putValue(key, value, is_composite<T>(), putIfChangedMode);
+}
+
+template<>
+typename KVStoreInterface::res_t KVStoreInterface::put<const char*>(const key_t& key, const char* value);
+
+#ifdef ARDUINO
+template<>
+typename KVStoreInterface::res_t KVStoreInterface::put<String>(const key_t& key, String value);
+#endif // ARDUINO
+
+template<typename T>
+typename KVStoreInterface::res_t KVStoreInterface::putIfChanged(const key_t& key, T value) {
+    return _putValue(key, value, is_composite<T>(), true);
+}
+
+template<>
+typename KVStoreInterface::res_t KVStoreInterface::putIfChanged<const char*>(const key_t& key, const char* value);
+
+#ifdef ARDUINO
+template<>
+typename KVStoreInterface::res_t KVStoreInterface::putIfChanged<String>(const key_t& key, String value);
+#endif // ARDUINO
+
+template<typename T> // TODO this could be called when class is const
+KVStoreInterface::reference<T> KVStoreInterface::get(const key_t& key, const T def) {
+    T t;
+
+    if(tryGet(key, t) == ST_FOUND) {
+        return KVStoreInterface::reference<T>(key, t, *this);
+    }
+
+    return KVStoreInterface::reference<T>(key, def, *this);
+}
+
+template<typename T>
+typename KVStoreInterface::Status KVStoreInterface::tryGet(const key_t& key, T& value) {
+    return _tryGetValue(key, value, is_composite<T>());
+}
+
+template<typename T>
+void KVStoreInterface::describe(uint8_t descriptor[DESCRIPTOR_SIZE]) {
+    typedef typename composite_traits<T>::element_type E;
+
+    const uint8_t type = std::is_arithmetic<E>::value ? getType(E()) : PT_BLOB;
+    const size_t size = sizeof(E);
+    const size_t count = composite_traits<T>::count();
+
+    static_assert(sizeof(E) <= UINT16_MAX && composite_traits<T>::count() <= UINT16_MAX,
+        "the value is too big to be described");
+
+    descriptor[0] = type;
+    descriptor[1] = size & 0xFF;
+    descriptor[2] = size >> 8;
+    descriptor[3] = count & 0xFF;
+    descriptor[4] = count >> 8;
+}
+
+template<typename T>
+typename KVStoreInterface::res_t KVStoreInterface::_putValue(const key_t& key, const T& value, std::false_type, bool ifChanged) {
+    if(ifChanged && _unchanged(key, (const uint8_t*)&value, sizeof(value), getType(value))) {
+        return sizeof(value);
+    }
+
+    return _put(key, (const uint8_t*)&value, sizeof(value), getType(value));
+}
+
+template<typename T>
+typename KVStoreInterface::res_t KVStoreInterface::_putValue(const key_t& key, const T& value, std::true_type, bool ifChanged) {
+    uint8_t buffer[DESCRIPTOR_SIZE + sizeof(T)];
+
+    describe<T>(buffer);
+    memcpy(buffer + DESCRIPTOR_SIZE, &value, sizeof(T));
+
+    if(ifChanged && _unchanged(key, buffer, sizeof(buffer), PT_BLOB)) {
+        return sizeof(T);
+    }
+
+    res_t res = _put(key, buffer, sizeof(buffer), PT_BLOB);
+
+    // the descriptor is not part of the size of the value
+    return res > (res_t)DESCRIPTOR_SIZE ? res - (res_t)DESCRIPTOR_SIZE : res;
+}
+
+template<typename T>
+typename KVStoreInterface::Status KVStoreInterface::_tryGetValue(const key_t& key, T& value, std::false_type) {
+    T t;
+    Status res = _tryGet(key, (uint8_t*)&t, sizeof(t), getType(T()));
+
+    if(res == ST_FOUND) {
+        value = t;
+    }
+
+    return res;
+}
+
+template<typename T>
+typename KVStoreInterface::Status KVStoreInterface::_tryGetValue(const key_t& key, T& value, std::true_type) {
+    uint8_t descriptor[DESCRIPTOR_SIZE];
+    uint8_t buffer[DESCRIPTOR_SIZE + sizeof(T)];
+
+    Status res = _tryGet(key, buffer, sizeof(buffer), PT_BLOB);
+
+    if(res != ST_FOUND) {
+        return res;
+    }
+
+    // a value with a different layout, or not written by put, has a different descriptor
+    describe<T>(descriptor);
+    if(memcmp(descriptor, buffer, DESCRIPTOR_SIZE) != 0) {
+        return ST_TYPE_MISMATCH;
+    }
+
+    memcpy(&value, buffer + DESCRIPTOR_SIZE, sizeof(T));
+    return ST_FOUND;
+}
+
+template<typename F>
+typename KVStoreInterface::res_t KVStoreInterface::forEach(F f, bool sizes) const {
+    return _forEach([](const KeyInfo& info, void* arg) {
+        return (*(F*)arg)(info);
+    }, &f, sizes);
+}
+
+template<typename F>
+typename KVStoreInterface::res_t KVStoreInterface::scanPrefix(const char* prefix, F f, bool sizes) const {
+    return _scanPrefix(prefix, [](const KeyInfo& info, void* arg) {
+        return (*(F*)arg)(info);
+    }, &f, sizes);
+}
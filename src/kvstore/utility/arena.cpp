@@ -0,0 +1,162 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "arena.h"
+#include <string.h>
+
+// the header of a chunk is as big as the smallest block, in order to keep blocks aligned
+constexpr size_t CHUNK_HEADER_SIZE = 16;
+
+// big blocks are preceded by a header of the same size, for the same reason
+constexpr size_t BIG_HEADER_SIZE = 16;
+
+Arena::Arena(size_t chunkSize)
+: chunkSize(chunkSize < 4 * MIN_BLOCK_SIZE ? 4 * MIN_BLOCK_SIZE : chunkSize), maxClass(0),
+  chunks(nullptr), used(0), bigBlocks(nullptr), reservedBytes(0) {
+    static_assert(sizeof(big_t) <= BIG_HEADER_SIZE, "the header of big blocks does not fit");
+
+    while(maxClass + 1 < SIZE_CLASSES && (MIN_BLOCK_SIZE << (maxClass + 1)) <= this->chunkSize / 4) {
+        maxClass++;
+    }
+
+    for(size_t i=0; i<SIZE_CLASSES; i++) {
+        freeLists[i] = nullptr;
+    }
+}
+
+uint8_t* Arena::allocate(size_t size) {
+    size_t cls = sizeClass(size);
+
+    if(cls > maxClass) {
+        uint8_t* raw = new uint8_t[BIG_HEADER_SIZE + size];
+        big_t* big = (big_t*)raw;
+
+        big->prev = nullptr;
+        big->next = bigBlocks;
+        if(bigBlocks != nullptr) {
+            bigBlocks->prev = big;
+        }
+        bigBlocks = big;
+
+        reservedBytes += BIG_HEADER_SIZE + size;
+        return raw + BIG_HEADER_SIZE;
+    }
+
+    if(freeLists[cls] != nullptr) {
+        uint8_t* block = freeLists[cls];
+
+        memcpy(&freeLists[cls], block, sizeof(uint8_t*));
+        return block;
+    }
+
+    size_t blockSize = MIN_BLOCK_SIZE << cls;
+
+    if(chunks == nullptr || used + blockSize > chunkSize) {
+        retire();
+
+        uint8_t* chunk = new uint8_t[CHUNK_HEADER_SIZE + chunkSize];
+        memcpy(chunk, &chunks, sizeof(uint8_t*));
+
+        chunks = chunk;
+        used = 0;
+        reservedBytes += CHUNK_HEADER_SIZE + chunkSize;
+    }
+
+    uint8_t* block = chunks + CHUNK_HEADER_SIZE + used;
+    used += blockSize;
+
+    return block;
+}
+
+void Arena::release(uint8_t* block, size_t size) {
+    if(block == nullptr) {
+        return;
+    }
+
+    size_t cls = sizeClass(size);
+
+    if(cls > maxClass) {
+        big_t* big = (big_t*)(block - BIG_HEADER_SIZE);
+
+        if(big->prev != nullptr) {
+            big->prev->next = big->next;
+        } else {
+            bigBlocks = big->next;
+        }
+        if(big->next != nullptr) {
+            big->next->prev = big->prev;
+        }
+
+        reservedBytes -= BIG_HEADER_SIZE + size;
+        delete [] (uint8_t*)big;
+        return;
+    }
+
+    push(cls, block);
+}
+
+size_t Arena::capacity(size_t size) const {
+    size_t cls = sizeClass(size);
+
+    return cls > maxClass ? size : MIN_BLOCK_SIZE << cls;
+}
+
+void Arena::reset() {
+    while(chunks != nullptr) {
+        uint8_t* chunk = chunks;
+
+        memcpy(&chunks, chunk, sizeof(uint8_t*));
+        delete [] chunk;
+    }
+
+    while(bigBlocks != nullptr) {
+        big_t* big = bigBlocks;
+
+        bigBlocks = big->next;
+        delete [] (uint8_t*)big;
+    }
+
+    for(size_t i=0; i<SIZE_CLASSES; i++) {
+        freeLists[i] = nullptr;
+    }
+
+    used = 0;
+    reservedBytes = 0;
+}
+
+size_t Arena::sizeClass(size_t size) const {
+    size_t cls = 0;
+
+    while(cls < SIZE_CLASSES && (MIN_BLOCK_SIZE << cls) < size) {
+        cls++;
+    }
+
+    return cls;
+}
+
+void Arena::push(size_t cls, uint8_t* block) {
+    memcpy(block, &freeLists[cls], sizeof(uint8_t*));
+    freeLists[cls] = block;
+}
+
+// the space left at the end of the current chunk is split in blocks, instead of being wasted
+void Arena::retire() {
+    if(chunks == nullptr) {
+        return;
+    }
+
+    for(size_t cls = maxClass + 1; cls-- > 0;) {
+        size_t blockSize = MIN_BLOCK_SIZE << cls;
+
+        while(used + blockSize <= chunkSize) {
+            push(cls, chunks + CHUNK_HEADER_SIZE + used);
+            used += blockSize;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+constexpr size_t DEFAULT_ARENA_CHUNK_SIZE = 4096;
+
+/** Arena class
+ *
+ * Allocator that carves blocks out of big chunks, in order to avoid a heap allocation for every value.
+ * The size of a block is rounded up to a power of two and released blocks are kept in a free list
+ * for every size class, to be reused by the next allocation of the same class. Blocks bigger than
+ * a quarter of a chunk do not fit well in the chunks and are allocated on the heap, linked in a list
+ * in order to be freed by reset too. Chunks are returned to the heap only by reset.
+ */
+class Arena {
+public:
+    Arena(size_t chunkSize=DEFAULT_ARENA_CHUNK_SIZE);
+    ~Arena() { reset(); }
+
+    /**
+     * @brief allocate a block of at least size bytes
+     *
+     * @returns the block, the number of bytes that can be used in it is given by capacity(size)
+     */
+    uint8_t* allocate(size_t size);
+
+    /**
+     * @brief give back a block obtained with allocate
+     *
+     * @param[in]  block            block to release
+     * @param[in]  size             the size the block was allocated with
+     */
+    void release(uint8_t* block, size_t size);
+
+    /**
+     * @brief number of bytes that can be used in a block allocated with a certain size
+     */
+    size_t capacity(size_t size) const;
+
+    /**
+     * @brief release all the blocks and all the chunks
+     */
+    void reset();
+
+    /**
+     * @brief get the number of bytes taken from the heap by chunks and big blocks
+     */
+    inline size_t reserved() const { return reservedBytes; }
+
+private:
+    static constexpr size_t MIN_BLOCK_SIZE = 16;
+    static constexpr size_t SIZE_CLASSES = 16;
+
+    // header of the blocks allocated on the heap
+    typedef struct big {
+        struct big* prev;
+        struct big* next;
+    } big_t;
+
+    size_t sizeClass(size_t size) const;
+    void push(size_t cls, uint8_t* block);
+    void retire();
+
+    const size_t chunkSize;
+    size_t maxClass; // blocks of a class bigger than this are allocated on the heap
+
+    // every chunk starts with the pointer to the previous one
+    uint8_t* chunks;
+    size_t used;
+
+    uint8_t* freeLists[SIZE_CLASSES];
+    big_t* bigBlocks;
+    size_t reservedBytes;
+};
@@ -0,0 +1,152 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "atcommand.h"
+#include <limits>
+
+typedef KVStoreInterface::Type Type;
+
+ATCommand::ATCommand(char out[], size_t maxLen, const char* prefix)
+: out(out), maxLen(maxLen), pos(0), first(true), overflow(out == nullptr || maxLen == 0) {
+    if(prefix != nullptr) {
+        append(prefix, strlen(prefix));
+    }
+}
+
+ATCommand& ATCommand::arg(const char* s) {
+    if(separate() && s != nullptr) {
+        append(s, strlen(s));
+    }
+
+    return *this;
+}
+
+ATCommand& ATCommand::arg(int64_t n) {
+    char digits[21];
+    size_t i = sizeof(digits);
+
+    // the magnitude is computed unsigned, in order to handle the lowest negative number
+    uint64_t m = n < 0 ? 0 - (uint64_t)n : (uint64_t)n;
+    do {
+        digits[--i] = '0' + m % 10;
+        m /= 10;
+    } while(m > 0);
+
+    if(n < 0) {
+        digits[--i] = '-';
+    }
+
+    if(separate()) {
+        append(digits + i, sizeof(digits) - i);
+    }
+
+    return *this;
+}
+
+size_t ATCommand::end() {
+    if(!append("\r\n", 2)) {
+        return 0;
+    }
+    out[pos] = '\0';
+
+    return pos;
+}
+
+// leaves room for the terminator
+bool ATCommand::append(const char* s, size_t len) {
+    if(overflow || len >= maxLen - pos) {
+        overflow = true;
+        return false;
+    }
+
+    memcpy(out + pos, s, len);
+    pos += len;
+
+    return true;
+}
+
+bool ATCommand::separate() {
+    if(first) {
+        first = false;
+        return !overflow;
+    }
+
+    return append(",", 1);
+}
+
+bool atIsTextScalar(Type t) {
+    switch(t) {
+    case KVStoreInterface::PT_I8:
+    case KVStoreInterface::PT_U8:
+    case KVStoreInterface::PT_I16:
+    case KVStoreInterface::PT_U16:
+    case KVStoreInterface::PT_I32:
+    case KVStoreInterface::PT_U32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t atScalarCommand(char out[], size_t maxLen, const char* prefix, const char* key, Type t, const uint8_t value[]) {
+    if(prefix == nullptr || key == nullptr || (value != nullptr && !atIsTextScalar(t))) {
+        return 0;
+    }
+
+    ATCommand cmd(out, maxLen, prefix);
+    cmd.arg(key).arg((int64_t)t);
+
+    if(value != nullptr) {
+        int64_t n = 0;
+
+        // the value may not be aligned
+        switch(t) {
+        case KVStoreInterface::PT_I8:  { int8_t v;   memcpy(&v, value, sizeof(v)); n = v; break; }
+        case KVStoreInterface::PT_U8:  { uint8_t v;  memcpy(&v, value, sizeof(v)); n = v; break; }
+        case KVStoreInterface::PT_I16: { int16_t v;  memcpy(&v, value, sizeof(v)); n = v; break; }
+        case KVStoreInterface::PT_U16: { uint16_t v; memcpy(&v, value, sizeof(v)); n = v; break; }
+        case KVStoreInterface::PT_I32: { int32_t v;  memcpy(&v, value, sizeof(v)); n = v; break; }
+        case KVStoreInterface::PT_U32: { uint32_t v; memcpy(&v, value, sizeof(v)); n = v; break; }
+        default: break;
+        }
+
+        cmd.arg(n);
+    }
+
+    return cmd.end();
+}
+
+template<typename T>
+static size_t store(int64_t number, uint8_t value[], size_t len) {
+    if(len < sizeof(T) || number < (int64_t)std::numeric_limits<T>::min() ||
+            number > (int64_t)std::numeric_limits<T>::max()) {
+        return 0;
+    }
+
+    T v = number;
+    memcpy(value, &v, sizeof(v));
+
+    return sizeof(v);
+}
+
+size_t atScalarValue(int64_t number, Type t, uint8_t value[], size_t len) {
+    if(value == nullptr) {
+        return 0;
+    }
+
+    switch(t) {
+    case KVStoreInterface::PT_I8:   return store<int8_t>(number, value, len);
+    case KVStoreInterface::PT_U8:   return store<uint8_t>(number, value, len);
+    case KVStoreInterface::PT_I16:  return store<int16_t>(number, value, len);
+    case KVStoreInterface::PT_U16:  return store<uint16_t>(number, value, len);
+    case KVStoreInterface::PT_I32:  return store<int32_t>(number, value, len);
+    case KVStoreInterface::PT_U32:  return store<uint32_t>(number, value, len);
+    default:                        return 0;
+    }
+}
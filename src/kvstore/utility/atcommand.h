@@ -0,0 +1,80 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "../kvstore.h"
+
+/*
+ * Encoding of the commands and the scalar values exchanged with a coprocessor that stores them through
+ * AT commands. The coprocessor keeps the type of the values and parses the integers up to 32 bits as
+ * decimal text, these functions produce and check that text with no printf, scanf or heap allocation.
+ */
+
+/** ATCommand class
+ *
+ * Builds the command line "<prefix><arg>,<arg>...\r\n" in a buffer owned by the caller
+ */
+class ATCommand {
+public:
+    ATCommand(char out[], size_t maxLen, const char* prefix);
+
+    ATCommand& arg(const char* s);
+    ATCommand& arg(int64_t n);
+
+    /**
+     * @brief terminate the command line
+     *
+     * @returns the length of the command, 0 if it did not fit the buffer
+     */
+    size_t end();
+
+private:
+    bool append(const char* s, size_t len);
+    bool separate();
+
+    char* out;
+    const size_t maxLen;
+    size_t pos;
+    bool first;
+    bool overflow;
+};
+
+/**
+ * @brief check if a type is exchanged as decimal text, 64 bits and floating point values are exchanged
+ *        as blobs since their text form is not supported on both the sides of the link
+ */
+bool atIsTextScalar(KVStoreInterface::Type t);
+
+/**
+ * @brief write the command line "<prefix><key>,<type>[,<value>]\r\n"
+ *
+ * @param[out] out              buffer for the command, it is terminated
+ * @param[in]  maxLen           size of out
+ * @param[in]  prefix           command and separator, e.g. "AT+PREFPUT="
+ * @param[in]  key              key of the value
+ * @param[in]  t                type of the value, an integer up to 32 bits if value is not nullptr
+ * @param[in]  value            value in the memory representation of t, nullptr for commands without value
+ *
+ * @returns the length of the command, 0 if it does not fit out or the type is not a text scalar
+ */
+size_t atScalarCommand(char out[], size_t maxLen, const char* prefix, const char* key,
+    KVStoreInterface::Type t, const uint8_t value[]=nullptr);
+
+/**
+ * @brief store a number received from the coprocessor in the memory representation of a type
+ *
+ * @param[in]  number           the number
+ * @param[in]  t                integer type up to 32 bits
+ * @param[out] value            where the value is written
+ * @param[in]  len              size of value, it must be at least the size of t
+ *
+ * @returns the size of the value, 0 if the type is not a text scalar or the number is out of its range
+ */
+size_t atScalarValue(int64_t number, KVStoreInterface::Type t, uint8_t value[], size_t len);
@@ -0,0 +1,121 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "blockdevice.h"
+#include <string.h>
+
+RamBlockDevice::RamBlockDevice(size_t size, size_t programSize, size_t eraseSize)
+: deviceSize(size - size % eraseSize), programSize(programSize), eraseSize(eraseSize),
+  data(nullptr), eraseCounts(nullptr) {
+    resetStats();
+}
+
+RamBlockDevice::~RamBlockDevice() {
+    delete [] data;
+    delete [] eraseCounts;
+}
+
+int RamBlockDevice::init() {
+    if(data != nullptr) {
+        return BD_ERROR_OK;
+    }
+
+    data = new uint8_t[deviceSize];
+    eraseCounts = new size_t[deviceSize / eraseSize];
+
+    if(data == nullptr || eraseCounts == nullptr) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    memset(data, getEraseValue(), deviceSize);
+    memset(eraseCounts, 0, deviceSize / eraseSize * sizeof(size_t));
+
+    return BD_ERROR_OK;
+}
+
+int RamBlockDevice::deinit() {
+    return BD_ERROR_OK;
+}
+
+int RamBlockDevice::read(void* buffer, size_t addr, size_t size) {
+    if(data == nullptr) {
+        return BD_ERROR_DEVICE_ERROR;
+    } else if(addr > deviceSize || size > deviceSize - addr) {
+        return BD_ERROR_OUT_OF_BOUNDS;
+    }
+
+    memcpy(buffer, data + addr, size);
+
+    stats.reads++;
+    stats.bytesRead += size;
+
+    return BD_ERROR_OK;
+}
+
+int RamBlockDevice::program(const void* buffer, size_t addr, size_t size) {
+    if(data == nullptr) {
+        return BD_ERROR_DEVICE_ERROR;
+    } else if(addr > deviceSize || size > deviceSize - addr) {
+        return BD_ERROR_OUT_OF_BOUNDS;
+    } else if(addr % programSize != 0 || size % programSize != 0) {
+        return BD_ERROR_NOT_ALIGNED;
+    }
+
+    for(size_t i=0; i<size; i++) {
+        if(data[addr + i] != getEraseValue()) {
+            return BD_ERROR_NOT_ERASED;
+        }
+    }
+
+    memcpy(data + addr, buffer, size);
+
+    stats.programs++;
+    stats.bytesProgrammed += size;
+
+    return BD_ERROR_OK;
+}
+
+int RamBlockDevice::erase(size_t addr, size_t size) {
+    if(data == nullptr) {
+        return BD_ERROR_DEVICE_ERROR;
+    } else if(addr > deviceSize || size > deviceSize - addr) {
+        return BD_ERROR_OUT_OF_BOUNDS;
+    } else if(addr % eraseSize != 0 || size % eraseSize != 0) {
+        return BD_ERROR_NOT_ALIGNED;
+    }
+
+    memset(data + addr, getEraseValue(), size);
+
+    for(size_t block = addr / eraseSize; block < (addr + size) / eraseSize; block++) {
+        eraseCounts[block]++;
+    }
+
+    stats.erases++;
+    stats.bytesErased += size;
+
+    return BD_ERROR_OK;
+}
+
+size_t RamBlockDevice::getEraseCount(size_t block) const {
+    return eraseCounts != nullptr && block < deviceSize / eraseSize ? eraseCounts[block] : 0;
+}
+
+size_t RamBlockDevice::getMaxEraseCount() const {
+    size_t res = 0;
+
+    for(size_t i=0; eraseCounts != nullptr && i < deviceSize / eraseSize; i++) {
+        res = eraseCounts[i] > res ? eraseCounts[i] : res;
+    }
+
+    return res;
+}
+
+void RamBlockDevice::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum {
+    BD_ERROR_OK             = 0,
+    BD_ERROR_DEVICE_ERROR   = -1,
+    BD_ERROR_OUT_OF_BOUNDS  = -2,
+    BD_ERROR_NOT_ALIGNED    = -3,
+    BD_ERROR_NOT_ERASED     = -4,
+};
+
+/** KVBlockDevice class
+ *
+ * Storage that is read in bytes, programmed in units of getProgramSize() bytes and erased in units of
+ * getEraseSize() bytes, as a NOR flash. A byte can be programmed only after it has been erased.
+ * It is the interface used by the engines that do not rely on the storage provided by the platform,
+ * the name is different from mbed::BlockDevice in order not to clash with it on mbed boards.
+ */
+class KVBlockDevice {
+public:
+    virtual ~KVBlockDevice() {}
+
+    virtual int init() = 0;
+    virtual int deinit() = 0;
+
+    /**
+     * @brief read size bytes starting from addr
+     *
+     * @returns BD_ERROR_OK on correct execution a negative error otherwise
+     */
+    virtual int read(void* buffer, size_t addr, size_t size) = 0;
+
+    /**
+     * @brief program size bytes starting from addr, both aligned to the program size
+     *
+     * @returns BD_ERROR_OK on correct execution a negative error otherwise
+     */
+    virtual int program(const void* buffer, size_t addr, size_t size) = 0;
+
+    /**
+     * @brief erase size bytes starting from addr, both aligned to the erase size
+     *
+     * @returns BD_ERROR_OK on correct execution a negative error otherwise
+     */
+    virtual int erase(size_t addr, size_t size) = 0;
+
+    virtual size_t getProgramSize() const = 0;
+    virtual size_t getEraseSize() const = 0;
+    virtual size_t size() const = 0;
+
+    // value of the bytes after an erase
+    virtual uint8_t getEraseValue() const { return 0xFF; }
+};
+
+/** RamBlockDevice class
+ *
+ * KVBlockDevice kept in RAM, that behaves like a NOR flash: programming a byte that was not erased
+ * is an error. It counts the operations it receives and the erases of every block, in order to
+ * measure the write amplification and the wear of the engines that use it.
+ */
+class RamBlockDevice: public KVBlockDevice {
+public:
+    typedef struct {
+        size_t reads;
+        size_t programs;
+        size_t erases;
+        size_t bytesRead;
+        size_t bytesProgrammed;
+        size_t bytesErased;
+    } stats_t;
+
+    RamBlockDevice(size_t size, size_t programSize=1, size_t eraseSize=4096);
+    ~RamBlockDevice();
+
+    int init() override;
+    int deinit() override;
+
+    int read(void* buffer, size_t addr, size_t size) override;
+    int program(const void* buffer, size_t addr, size_t size) override;
+    int erase(size_t addr, size_t size) override;
+
+    size_t getProgramSize() const override  { return programSize; }
+    size_t getEraseSize() const override    { return eraseSize; }
+    size_t size() const override            { return deviceSize; }
+
+    /**
+     * @brief get the number of times a block has been erased
+     *
+     * @param[in]  block            index of the block, the address of the block divided by the erase size
+     */
+    size_t getEraseCount(size_t block) const;
+
+    /**
+     * @brief get the highest number of erases of a block
+     */
+    size_t getMaxEraseCount() const;
+
+    inline const stats_t& getStats() const { return stats; }
+    void resetStats();
+
+private:
+    const size_t deviceSize;
+    const size_t programSize;
+    const size_t eraseSize;
+
+    // the content survives a deinit, as it happens for a flash
+    uint8_t* data;
+    size_t* eraseCounts;
+
+    stats_t stats;
+};
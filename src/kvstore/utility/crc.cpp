@@ -0,0 +1,40 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "crc.h"
+
+typedef struct {
+    uint32_t values[256];
+} crc_table_t;
+
+static crc_table_t makeTable() {
+    crc_table_t table;
+
+    for(uint32_t i=0; i<256; i++) {
+        uint32_t c = i;
+
+        for(int k=0; k<8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table.values[i] = c;
+    }
+
+    return table;
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    static const crc_table_t table = makeTable();
+
+    crc = ~crc;
+    for(size_t i=0; i<len; i++) {
+        crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
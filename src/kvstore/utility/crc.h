@@ -0,0 +1,25 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief update the CRC-32 (IEEE 802.3) of a sequence of bytes, the CRC of a sequence split in multiple
+ *        parts is obtained by passing the CRC of the previous part, starting from 0
+ *
+ * @param[in]  crc              CRC of the bytes that precede data
+ * @param[in]  data             bytes to add to the CRC
+ * @param[in]  len              number of bytes
+ *
+ * @returns the updated CRC
+ */
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len);
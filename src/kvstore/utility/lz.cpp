@@ -0,0 +1,189 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "lz.h"
+#include <string.h>
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline size_t hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// write the extension of a length whose nibble is 15, returns false if it does not fit
+static bool putLength(uint8_t* out, size_t maxLen, size_t& pos, size_t len) {
+    for(; len >= 255; len -= 255) {
+        if(pos >= maxLen) {
+            return false;
+        }
+        out[pos++] = 255;
+    }
+
+    if(pos >= maxLen) {
+        return false;
+    }
+    out[pos++] = len;
+
+    return true;
+}
+
+static bool putSequence(uint8_t* out, size_t maxLen, size_t& pos,
+        const uint8_t* literals, size_t literalLen, size_t offset, size_t matchLen) {
+    size_t m = matchLen > 0 ? matchLen - LZ_MIN_MATCH : 0;
+
+    if(pos >= maxLen) {
+        return false;
+    }
+    out[pos++] = (literalLen < 15 ? literalLen : 15) << 4 | (m < 15 ? m : 15);
+
+    if(literalLen >= 15 && !putLength(out, maxLen, pos, literalLen - 15)) {
+        return false;
+    }
+
+    if(literalLen > maxLen - pos) {
+        return false;
+    }
+    memcpy(out + pos, literals, literalLen);
+    pos += literalLen;
+
+    // the last sequence has no match
+    if(matchLen == 0) {
+        return true;
+    }
+
+    if(maxLen - pos < 2) {
+        return false;
+    }
+    out[pos++] = offset & 0xFF;
+    out[pos++] = offset >> 8;
+
+    return m < 15 || putLength(out, maxLen, pos, m - 15);
+}
+
+size_t lzCompress(const uint8_t* in, size_t len, uint8_t* out, size_t maxLen, uint16_t* table) {
+    if(in == nullptr || out == nullptr || table == nullptr || len > LZ_MAX_INPUT_SIZE) {
+        return 0;
+    }
+
+    // positions are stored incremented by one, 0 marks an empty slot
+    memset(table, 0, LZ_HASH_SIZE * sizeof(uint16_t));
+
+    size_t pos = 0;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while(i + LZ_MIN_MATCH <= len) {
+        uint32_t v = read32(in + i);
+        size_t h = hash(v);
+        size_t candidate = table[h];
+        table[h] = i + 1;
+
+        if(candidate == 0 || i - (candidate - 1) > LZ_WINDOW_SIZE || read32(in + candidate - 1) != v) {
+            i++;
+            continue;
+        }
+
+        candidate--;
+        size_t matchLen = LZ_MIN_MATCH;
+        while(i + matchLen < len && in[candidate + matchLen] == in[i + matchLen]) {
+            matchLen++;
+        }
+
+        if(!putSequence(out, maxLen, pos, in + anchor, i - anchor, i - candidate, matchLen)) {
+            return 0;
+        }
+
+        i += matchLen;
+        anchor = i;
+    }
+
+    if(!putSequence(out, maxLen, pos, in + anchor, len - anchor, 0, 0)) {
+        return 0;
+    }
+
+    return pos;
+}
+
+// read the extension of a length whose nibble is 15, returns false if the input ends before it
+static bool getLength(const uint8_t* in, size_t len, size_t& pos, size_t& value) {
+    uint8_t b;
+
+    do {
+        if(pos >= len) {
+            return false;
+        }
+        b = in[pos++];
+        value += b;
+    } while(b == 255);
+
+    return true;
+}
+
+int32_t lzDecompress(const uint8_t* in, size_t len, uint8_t* out, size_t maxLen) {
+    if(in == nullptr || (out == nullptr && maxLen > 0)) {
+        return -1;
+    }
+
+    size_t pos = 0;
+    size_t produced = 0;
+
+    while(pos < len) {
+        uint8_t token = in[pos++];
+        size_t literalLen = token >> 4;
+
+        if(literalLen == 15 && !getLength(in, len, pos, literalLen)) {
+            return -1;
+        }
+
+        if(literalLen > len - pos || literalLen > LZ_MAX_INPUT_SIZE - produced) {
+            return -1;
+        }
+
+        if(produced < maxLen) {
+            size_t n = maxLen - produced < literalLen ? maxLen - produced : literalLen;
+            memcpy(out + produced, in + pos, n);
+        }
+        pos += literalLen;
+        produced += literalLen;
+
+        // the last sequence ends with its literals
+        if(pos == len) {
+            break;
+        }
+
+        if(len - pos < 2) {
+            return -1;
+        }
+
+        size_t offset = in[pos] | in[pos + 1] << 8;
+        size_t matchLen = token & 0x0F;
+        pos += 2;
+
+        if(matchLen == 15 && !getLength(in, len, pos, matchLen)) {
+            return -1;
+        }
+        matchLen += LZ_MIN_MATCH;
+
+        if(offset == 0 || offset > produced || matchLen > LZ_MAX_INPUT_SIZE - produced) {
+            return -1;
+        }
+
+        // the copy is done byte by byte, since the match can overlap the bytes it is producing
+        for(size_t j=0; j<matchLen && produced + j < maxLen; j++) {
+            out[produced + j] = out[produced + j - offset];
+        }
+        produced += matchLen;
+    }
+
+    return produced;
+}
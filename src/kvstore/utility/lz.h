@@ -0,0 +1,54 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * LZ77 codec in the style of the LZ4 block format, small enough for a microcontroller.
+ * The data is a sequence of tokens: the high nibble of the token is the number of literals that follow,
+ * the low nibble the length of a match minus LZ_MIN_MATCH, a nibble equal to 15 is extended by the bytes
+ * that follow it until one is lower than 255. The literals are followed by the 16 bit little endian
+ * offset of the match, the last token has only literals.
+ * Matches are searched within LZ_WINDOW_SIZE bytes through a hash table of the positions, which is
+ * the only memory needed to compress. Decompressing needs no memory besides the output.
+ */
+constexpr size_t LZ_WINDOW_SIZE = 4096;
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_HASH_BITS = 10;
+constexpr size_t LZ_HASH_SIZE = 1 << LZ_HASH_BITS;
+constexpr size_t LZ_MAX_INPUT_SIZE = UINT16_MAX; // positions are kept in 16 bits in the hash table
+
+/**
+ * @brief compress a buffer
+ *
+ * @param[in]  in               data to compress, at most LZ_MAX_INPUT_SIZE bytes
+ * @param[in]  len              size of the data
+ * @param[out] out              buffer where the compressed data is written
+ * @param[in]  maxLen           size of out, the compression fails when the result does not fit
+ * @param[in]  table            work memory of LZ_HASH_SIZE entries, its content is not preserved
+ *
+ * @returns the size of the compressed data, 0 if it does not fit out
+ */
+size_t lzCompress(const uint8_t* in, size_t len, uint8_t* out, size_t maxLen, uint16_t* table);
+
+/**
+ * @brief decompress a buffer written by lzCompress, the input is validated and never read
+ *        or written out of bounds
+ *
+ * @param[in]  in               compressed data
+ * @param[in]  len              size of the compressed data
+ * @param[out] out              buffer where the data is written
+ * @param[in]  maxLen           size of out, the data that does not fit is dropped
+ *
+ * @returns the size of the decompressed data, also when only a part of it fits out, -1 if the input is corrupted
+ */
+int32_t lzDecompress(const uint8_t* in, size_t len, uint8_t* out, size_t maxLen);
@@ -0,0 +1,314 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "pipeline.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif // ARDUINO
+
+ATPipeline::ATPipeline(KVModemTransport* transport, size_t inFlight)
+: transport(transport), inFlight(inFlight > 0 && inFlight <= AT_PIPELINE_DEPTH ? inFlight : AT_PIPELINE_DEPTH),
+  timeout(AT_DEFAULT_TIMEOUT), head(0), count(0), sent(0), nextHandle(1), failures(0),
+  parser(PARSE_LINE), lineLen(0), dataLen(0), dataRead(0), valueParsed(false) {
+    for(size_t i=0; i<AT_PIPELINE_DEPTH; i++) {
+        ops[i].handle = 0;
+        ops[i].state = OP_INVALID;
+    }
+}
+
+typename ATPipeline::handle_t ATPipeline::submit(const char* prompt, const char* command,
+        const uint8_t payload[], size_t payloadLen, uint8_t out[], size_t outLen, Callback callback, void* arg) {
+    size_t len = command != nullptr ? strlen(command) : 0;
+
+    if(transport == nullptr || prompt == nullptr || len == 0 || len >= AT_COMMAND_SIZE ||
+            count == AT_PIPELINE_DEPTH || (payload == nullptr && payloadLen > 0)) {
+        return 0;
+    }
+
+    // the slots are visited starting from a different one every time, in order to keep
+    // the state of the completed operations as long as possible
+    op_t* op = nullptr;
+    size_t index = 0;
+    for(size_t i=0; i<AT_PIPELINE_DEPTH && op == nullptr; i++) {
+        index = (nextHandle + i) % AT_PIPELINE_DEPTH;
+
+        if(ops[index].state != OP_QUEUED && ops[index].state != OP_SENT) {
+            op = &ops[index];
+        }
+    }
+
+    op->handle = nextHandle;
+    op->state = OP_QUEUED;
+    memcpy(op->command, command, len);
+    op->commandLen = len;
+    op->prompt = prompt;
+    op->payload = payload;
+    op->payloadLen = payloadLen;
+    op->written = 0;
+    op->out = out;
+    op->outLen = outLen;
+    op->result = 0;
+    op->number = 0;
+    op->hasNumber = false;
+    op->failureCounted = false;
+    op->sentAt = 0;
+    op->callback = callback;
+    op->arg = arg;
+
+    order[(head + count) % AT_PIPELINE_DEPTH] = index;
+    count++;
+
+    if(++nextHandle == 0) {
+        nextHandle = 1;
+    }
+
+    return op->handle;
+}
+
+bool ATPipeline::poll() {
+    if(transport == nullptr) {
+        return count > 0;
+    }
+
+    send();
+
+    while(transport->available() > 0) {
+        int c = transport->read();
+
+        if(c < 0) {
+            break;
+        }
+        parse(c);
+    }
+
+    // the completed operations leave room for more commands in flight
+    send();
+
+    // the coprocessor is not answering, the operations waiting for a reply are failed
+    if(sent > 0 && now() - ops[order[head]].sentAt >= timeout) {
+        while(sent > 0) {
+            complete(OP_ERROR);
+        }
+    }
+
+    return count > 0;
+}
+
+bool ATPipeline::flush() {
+    while(poll()) { }
+
+    bool res = failures == 0;
+    failures = 0;
+
+    for(size_t i=0; i<AT_PIPELINE_DEPTH; i++) {
+        ops[i].failureCounted = false;
+    }
+
+    return res;
+}
+
+int ATPipeline::wait(handle_t handle) {
+    op_t* op = slot(handle);
+
+    if(op == nullptr) {
+        return -1;
+    }
+
+    while(op->handle == handle && (op->state == OP_QUEUED || op->state == OP_SENT)) {
+        poll();
+    }
+
+    if(op->handle != handle) {
+        return -1;
+    }
+
+    // a failure already reported by flush() is not counted anymore
+    if(op->failureCounted) {
+        op->failureCounted = false;
+        failures--;
+    }
+
+    return result(handle);
+}
+
+typename ATPipeline::State ATPipeline::state(handle_t handle) const {
+    const op_t* op = slot(handle);
+
+    return op != nullptr ? op->state : OP_INVALID;
+}
+
+int ATPipeline::result(handle_t handle) const {
+    const op_t* op = slot(handle);
+
+    return op != nullptr && op->state == OP_DONE ? op->result : -1;
+}
+
+bool ATPipeline::send() {
+    while(sent < count && sent < inFlight) {
+        op_t& op = ops[order[(head + sent) % AT_PIPELINE_DEPTH]];
+
+        if(op.written < op.commandLen) {
+            op.written += transport->write((const uint8_t*)op.command + op.written, op.commandLen - op.written);
+        }
+
+        if(op.written >= op.commandLen && op.written < op.commandLen + op.payloadLen) {
+            size_t offset = op.written - op.commandLen;
+            op.written += transport->write(op.payload + offset, op.payloadLen - offset);
+        }
+
+        if(op.written < op.commandLen + op.payloadLen) {
+            return false;
+        }
+
+        // the timeout of an operation starts when it is the oldest one waiting for a reply
+        op.state = OP_SENT;
+        if(sent == 0) {
+            op.sentAt = now();
+        }
+        sent++;
+    }
+
+    return true;
+}
+
+void ATPipeline::parse(uint8_t c) {
+    // bytes not requested by any command are dropped
+    if(sent == 0) {
+        return;
+    }
+
+    op_t& op = ops[order[head]];
+
+    if(parser == PARSE_DATA) {
+        if(dataRead < op.outLen) {
+            op.out[dataRead] = c;
+        }
+
+        if(++dataRead == dataLen) {
+            parser = PARSE_LINE;
+        }
+        return;
+    }
+
+    if(c == '\n') {
+        line[lineLen] = '\0';
+        parseLine();
+        lineLen = 0;
+        return;
+    }
+
+    if(c == '\r') {
+        return;
+    }
+
+    if(lineLen < AT_LINE_SIZE - 1) {
+        line[lineLen++] = c;
+    }
+
+    // the data of a sized reply follows the '|' and can contain any byte, line terminators included
+    size_t promptLen = strlen(op.prompt);
+    if(c == '|' && op.out != nullptr && !valueParsed && strncmp(line, op.prompt, promptLen) == 0) {
+        line[lineLen] = '\0';
+        dataLen = strtoul(line + promptLen, nullptr, 10);
+        dataRead = 0;
+        lineLen = 0;
+
+        op.result = dataLen;
+        valueParsed = true;
+
+        if(dataLen > 0) {
+            parser = PARSE_DATA;
+        }
+    }
+}
+
+void ATPipeline::parseLine() {
+    op_t& op = ops[order[head]];
+    size_t promptLen = strlen(op.prompt);
+
+    if(strcmp(line, "OK") == 0) {
+        complete(OP_DONE);
+    } else if(strcmp(line, "ERROR") == 0) {
+        complete(OP_ERROR);
+    } else if(op.out == nullptr && !valueParsed && strncmp(line, op.prompt, promptLen) == 0) {
+        char* end;
+        op.number = strtoll(line + promptLen, &end, 10);
+        op.hasNumber = end != line + promptLen;
+        op.result = (int)op.number;
+        valueParsed = true;
+    }
+}
+
+void ATPipeline::complete(State state) {
+    op_t& op = ops[order[head]];
+
+    op.state = state;
+    if(state == OP_ERROR) {
+        op.result = -1;
+        op.failureCounted = true;
+        failures++;
+    }
+
+    head = (head + 1) % AT_PIPELINE_DEPTH;
+    count--;
+    sent--;
+
+    parser = PARSE_LINE;
+    lineLen = 0;
+    valueParsed = false;
+
+    if(sent > 0) {
+        ops[order[head]].sentAt = now();
+    }
+
+    // the callback is called last, since it can submit other operations
+    if(op.callback != nullptr) {
+        op.callback(op.handle, op.result, op.arg);
+    }
+}
+
+bool ATPipeline::number(handle_t handle, int64_t* value) const {
+    const op_t* op = slot(handle);
+
+    if(op == nullptr || op->state != OP_DONE || !op->hasNumber) {
+        return false;
+    }
+
+    *value = op->number;
+
+    return true;
+}
+
+const typename ATPipeline::op_t* ATPipeline::slot(handle_t handle) const {
+    if(handle == 0) {
+        return nullptr;
+    }
+
+    for(size_t i=0; i<AT_PIPELINE_DEPTH; i++) {
+        if(ops[i].handle == handle && ops[i].state != OP_INVALID) {
+            return &ops[i];
+        }
+    }
+
+    return nullptr;
+}
+
+uint32_t ATPipeline::now() {
+#ifdef ARDUINO
+    return millis();
+#else
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif // ARDUINO
+}
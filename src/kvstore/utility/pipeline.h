@@ -0,0 +1,211 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** KVModemTransport class
+ *
+ * Byte stream towards a coprocessor that is driven with AT commands, none of its methods may block.
+ * The name is different from the ModemClass of the cores in order not to clash with it.
+ */
+class KVModemTransport {
+public:
+    virtual ~KVModemTransport() {}
+
+    // number of bytes that can be read without blocking
+    virtual size_t available() = 0;
+
+    // returns the next received byte, -1 if there is none
+    virtual int read() = 0;
+
+    // returns the number of bytes accepted, that can be less than len when the output buffer is full
+    virtual size_t write(const uint8_t data[], size_t len) = 0;
+};
+
+constexpr size_t AT_PIPELINE_DEPTH = 8;         // operations that can be submitted and not completed yet
+constexpr size_t AT_PIPELINE_IN_FLIGHT = 4;     // default number of commands sent without waiting for their reply
+constexpr size_t AT_COMMAND_SIZE = 64;          // longest command line, terminator included
+constexpr size_t AT_LINE_SIZE = 32;             // longest reply line that is parsed, longer ones are truncated
+constexpr uint32_t AT_DEFAULT_TIMEOUT = 10000;  // ms
+
+/** ATPipeline class
+ *
+ * Sends AT commands without waiting for the reply of the previous ones and matches the replies
+ * in order, since the coprocessor executes the commands in the order they are received.
+ * An operation is a command line, optionally followed by a payload, whose reply has the form
+ *
+ *   <prompt> <value>\r\nOK\r\n            or     ERROR\r\n
+ *   <prompt> <size>|<data>\r\nOK\r\n       when the operation has an output buffer
+ *
+ * The result of an operation is the number in the value, or the size of the data. Lines that do not
+ * start with the prompt of the operation waiting for a reply are ignored.
+ *
+ * Nothing blocks: submit() queues the operation and poll() writes the commands that fit the transport
+ * and parses the bytes received so far. The completion is reported by a callback, called from poll(),
+ * or queried with state() and result(). All the memory is allocated in the object, the payload and
+ * the output buffer of an operation are not copied and must stay valid until it completes.
+ */
+class ATPipeline {
+public:
+    typedef uint16_t handle_t;  // 0 is never a valid handle
+
+    typedef enum {
+        OP_INVALID,     // unknown handle, or its slot has been reused by a later operation
+        OP_QUEUED,
+        OP_SENT,
+        OP_DONE,
+        OP_ERROR,       // the coprocessor replied with an error or did not reply before the timeout
+    } State;
+
+    /**
+     * callback called when an operation completes
+     *
+     * @param[in]  handle           handle of the operation
+     * @param[in]  result           result of the operation, -1 if it failed
+     * @param[in]  arg              argument given to submit()
+     */
+    typedef void (*Callback)(handle_t handle, int result, void* arg);
+
+    ATPipeline(KVModemTransport* transport=nullptr, size_t inFlight=AT_PIPELINE_IN_FLIGHT);
+
+    void setTransport(KVModemTransport* transport) { this->transport = transport; }
+
+    /**
+     * @brief set how long an operation waits for its reply once it is the oldest one sent, when it expires
+     *        all the operations sent fail. Replies arriving after that would be matched to the following
+     *        operations, thus the timeout must be longer than the slowest command of the coprocessor
+     */
+    void setTimeout(uint32_t ms) { timeout = ms; }
+
+    /**
+     * @brief queue an operation, nothing is written before the next call to poll()
+     *
+     * @param[in]  prompt           prefix of the reply, e.g. "+PREFGET:"
+     * @param[in]  command          command line, terminator included, it is copied
+     * @param[in]  payload          bytes written right after the command line
+     * @param[in]  payloadLen       size of the payload
+     * @param[out] out              buffer for the data of the reply, the reply is parsed as <size>|<data>
+     *                              when it is not nullptr. Data not fitting the buffer is dropped
+     * @param[in]  outLen           size of out
+     * @param[in]  callback         function called when the operation completes, it can submit operations
+     * @param[in]  arg              argument passed to the callback
+     *
+     * @returns the handle of the operation, 0 if the queue is full or the command is too long
+     */
+    handle_t submit(const char* prompt, const char* command, const uint8_t payload[]=nullptr, size_t payloadLen=0,
+        uint8_t out[]=nullptr, size_t outLen=0, Callback callback=nullptr, void* arg=nullptr);
+
+    /**
+     * @brief write the queued commands, up to the in flight limit, and parse the received bytes
+     *
+     * @returns true if there are operations that did not complete yet
+     */
+    bool poll();
+
+    /**
+     * @brief poll until all the operations complete, it blocks
+     *
+     * @returns true if all the operations succeeded
+     */
+    bool flush();
+
+    /**
+     * @brief poll until an operation completes, it blocks. Its failure is reported only to the caller
+     *
+     * @returns the result of the operation, -1 if it failed
+     */
+    int wait(handle_t handle);
+
+    /**
+     * @brief state of an operation, the state of a completed operation is kept until
+     *        its slot is reused by a later submit()
+     */
+    State state(handle_t handle) const;
+
+    /**
+     * @brief result of a completed operation
+     *
+     * @returns the result, -1 if the operation failed or did not complete
+     */
+    int result(handle_t handle) const;
+
+    /**
+     * @brief number in the reply of a completed operation, with the full range of the 64 bit types
+     *
+     * @param[out] value            the number, set only if it is available
+     *
+     * @returns true if the operation succeeded and its reply had a number
+     */
+    bool number(handle_t handle, int64_t* value) const;
+
+    // number of operations that did not complete yet
+    size_t pending() const { return count; }
+
+private:
+    typedef struct {
+        handle_t handle;
+        State state;
+        char command[AT_COMMAND_SIZE];
+        uint8_t commandLen;
+        const char* prompt;
+        const uint8_t* payload;
+        size_t payloadLen;
+        size_t written;     // bytes of command and payload already written
+        uint8_t* out;
+        size_t outLen;
+        int result;
+        int64_t number;
+        bool hasNumber;
+        bool failureCounted; // the failure is counted in failures, it has not been reported yet
+        uint32_t sentAt;
+        Callback callback;
+        void* arg;
+    } op_t;
+
+    typedef enum {
+        PARSE_LINE,
+        PARSE_DATA,
+    } Parser;
+
+    // write the commands that fit the transport, returns false if it is full
+    bool send();
+
+    void parse(uint8_t c);
+    void parseLine();
+
+    // complete the oldest operation sent
+    void complete(State state);
+
+    const op_t* slot(handle_t handle) const;
+    op_t* slot(handle_t handle) { return const_cast<op_t*>(static_cast<const ATPipeline*>(this)->slot(handle)); }
+
+    static uint32_t now();
+
+    KVModemTransport* transport;
+    const size_t inFlight;
+    uint32_t timeout;
+
+    op_t ops[AT_PIPELINE_DEPTH];
+    uint8_t order[AT_PIPELINE_DEPTH];   // slots in the order they were submitted, starting from head
+    uint8_t head;
+    uint8_t count;
+    uint8_t sent;                       // operations at the head of order whose command has been written
+    handle_t nextHandle;
+    size_t failures;                    // operations failed since the last flush()
+
+    Parser parser;
+    char line[AT_LINE_SIZE];
+    size_t lineLen;
+    size_t dataLen;                     // size of the data of a sized reply
+    size_t dataRead;
+    bool valueParsed;                   // the line with the prompt has been received
+};
@@ -0,0 +1,300 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "../kvstore.h"
+
+/**
+ * @brief declare a field of a KVSchema, e.g. KVSCHEMA_FIELD(Gain, float, "gain", 1.0f);
+ *        the key is the one used by the legacy per-field layout and identifies the field in the record
+ */
+#define KVSCHEMA_FIELD(name, type, key, def)                                                \
+    struct name {                                                                           \
+        typedef type value_type;                                                            \
+        static constexpr KVStoreInterface::Key id() { return KVStoreInterface::Key(key); }  \
+        static constexpr type defaultValue() { return def; }                                \
+    }
+
+namespace kvschema {
+    // compile time layout of the fields, every field is placed right after the previous one
+
+    template<typename... Fields>
+    struct layout {
+        static constexpr size_t size() { return 0; }
+        static constexpr uint32_t hash(uint32_t h) { return h; }
+    };
+
+    template<typename F, typename... Fields>
+    struct layout<F, Fields...> {
+        static constexpr size_t size() {
+            return sizeof(typename F::value_type) + layout<Fields...>::size();
+        }
+
+        // the layout hash changes whenever a field is added, removed, moved or changes its type
+        static constexpr uint32_t hash(uint32_t h) {
+            return layout<Fields...>::hash(mix(mix(mix(h, F::id().hash()),
+                KVStoreInterface::getType(typename F::value_type())), sizeof(typename F::value_type)));
+        }
+
+        static constexpr uint32_t mix(uint32_t h, uint32_t v) {
+            return static_cast<uint32_t>((h ^ v) * 16777619u);
+        }
+    };
+
+    template<typename Field, typename... Fields>
+    struct offset {
+        // a dependent expression is required, in order to fail only when the template is instantiated
+        static_assert(sizeof(Field) == 0, "the field is not part of the schema");
+        static constexpr size_t value() { return 0; }
+    };
+
+    template<typename Field, typename... Fields>
+    struct offset<Field, Field, Fields...> {
+        static constexpr size_t value() { return 0; }
+    };
+
+    template<typename Field, typename F, typename... Fields>
+    struct offset<Field, F, Fields...> {
+        static constexpr size_t value() {
+            return sizeof(typename F::value_type) + offset<Field, Fields...>::value();
+        }
+    };
+}
+
+/** KVSchema class
+ *
+ * Set of typed fields declared at compile time with KVSCHEMA_FIELD and stored as a single packed record
+ * under one key, instead of paying the overhead of an entry and a lookup for every field.
+ * The record is made of a header with the hash of the layout and the number of fields, a table with
+ * the key hash, type and size of every field and then the packed values. get and set access the values
+ * at offsets known at compile time.
+ *
+ * When the stored layout is different from the declared one, the fields are migrated by matching
+ * their key, type and size: new fields get their default value and removed fields are dropped.
+ * When the record does not exist the fields are read from the legacy per-field keys.
+ * The key of the record must outlive the schema, since it is not copied.
+ *
+ * using Settings = KVSchema<Gain, Offset>;
+ * Settings settings(store, "settings");
+ * settings.load();
+ * settings.set<Gain>(settings.get<Gain>() * 2);
+ * settings.save();
+ */
+template<typename... Fields>
+class KVSchema {
+public:
+    typedef KVStoreInterface::key_t key_t;
+
+    KVSchema(KVStoreInterface& store, const key_t& key): store(store), key(key), dirty(false) {
+        fillHeader();
+        reset();
+        dirty = false;
+    }
+
+    /**
+     * @brief hash of the layout of the record, it changes with the fields declared in the schema
+     */
+    static constexpr uint32_t hash() { return kvschema::layout<Fields...>::hash(2166136261u); }
+
+    /**
+     * @brief size of the record written in the store
+     */
+    static constexpr size_t size() { return DATA_OFFSET + kvschema::layout<Fields...>::size(); }
+
+    /**
+     * @brief get the value of a field
+     */
+    template<typename Field>
+    typename Field::value_type get() const {
+        return read<typename Field::value_type>(record + DATA_OFFSET + kvschema::offset<Field, Fields...>::value());
+    }
+
+    /**
+     * @brief set the value of a field, the store is updated when save is called
+     */
+    template<typename Field>
+    void set(const typename Field::value_type& value) {
+        write(record + DATA_OFFSET + kvschema::offset<Field, Fields...>::value(), value);
+        dirty = true;
+    }
+
+    /**
+     * @brief load the record from the store, migrating it if it was written with a different layout
+     *        or reading the legacy per-field keys if it does not exist. Missing fields get their default value
+     *
+     * @returns true if the record was found with the current layout, false if it had to be migrated,
+     *          in that case the schema is marked dirty and it is written with the current layout by save
+     */
+    bool load() {
+        size_t len = store.getBytesLength(key);
+
+        // the record is read in place, the header is checked to be equal to the declared one
+        if(len == size() && store.getBytes(key, record, size()) == (KVStoreInterface::res_t)size() &&
+                read<uint32_t>(record) == hash()) {
+            dirty = false;
+            return true;
+        }
+
+        fillHeader();
+        reset();
+
+        if(len > 0) {
+            migrate(len);
+        } else {
+            legacy();
+        }
+
+        dirty = true;
+        return false;
+    }
+
+    /**
+     * @brief write the record in the store if any field was modified
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool save() {
+        if(!dirty) {
+            return true;
+        }
+
+        if(store.putBytes(key, record, size()) != (KVStoreInterface::res_t)size()) {
+            return false;
+        }
+
+        dirty = false;
+        return true;
+    }
+
+    /**
+     * @brief remove the legacy per-field keys from the store, it should be called once the record
+     *        has been saved and no older firmware needs to read them
+     *
+     * @returns the number of keys removed
+     */
+    size_t removeLegacy() {
+        size_t removed = 0;
+        (void)expand{0, (removed += removeLegacyField<Fields>(), 0)...};
+        return removed;
+    }
+
+    inline bool isDirty() const { return dirty; }
+
+private:
+    static constexpr size_t HEADER_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+    static constexpr size_t FIELD_SIZE = sizeof(uint32_t) + 2 * sizeof(uint8_t);
+    static constexpr size_t DATA_OFFSET = HEADER_SIZE + sizeof...(Fields) * FIELD_SIZE;
+
+    // values are copied byte by byte, since they are not aligned in the packed record
+    template<typename T>
+    static T read(const uint8_t* src) {
+        T t;
+        memcpy(&t, src, sizeof(T));
+        return t;
+    }
+
+    template<typename T>
+    static void write(uint8_t* dst, const T& t) {
+        memcpy(dst, &t, sizeof(T));
+    }
+
+    // pack expansions in a braced list are evaluated in order, one call for every field
+    typedef int expand[];
+
+    void fillHeader() {
+        uint8_t* table = record + HEADER_SIZE;
+
+        write<uint32_t>(record, hash());
+        write<uint16_t>(record + sizeof(uint32_t), sizeof...(Fields));
+        (void)expand{0, (fillField<Fields>(table), table += FIELD_SIZE, 0)...};
+    }
+
+    template<typename F>
+    static void fillField(uint8_t* table) {
+        write<uint32_t>(table, F::id().hash());
+        table[sizeof(uint32_t)] = KVStoreInterface::getType(typename F::value_type());
+        table[sizeof(uint32_t) + 1] = sizeof(typename F::value_type);
+    }
+
+    void reset() {
+        (void)expand{0, (set<Fields>(Fields::defaultValue()), 0)...};
+    }
+
+    void legacy() {
+        (void)expand{0, (legacyField<Fields>(), 0)...};
+    }
+
+    template<typename F>
+    void legacyField() {
+        typename F::value_type value;
+
+        if(store.tryGet(F::id(), value) == KVStoreInterface::ST_FOUND) {
+            set<F>(value);
+        }
+    }
+
+    template<typename F>
+    size_t removeLegacyField() {
+        return store.exists(F::id()) && store.remove(F::id()) > 0 ? 1 : 0;
+    }
+
+    // copy the fields that are still present from a record written with another layout
+    void migrate(size_t len) {
+        uint8_t* old = new uint8_t[len];
+
+        if(len < HEADER_SIZE || store.getBytes(key, old, len) != (KVStoreInterface::res_t)len) {
+            delete [] old;
+            return;
+        }
+
+        size_t count = read<uint16_t>(old + sizeof(uint32_t));
+        size_t data = HEADER_SIZE + count * FIELD_SIZE;
+
+        if(data > len) {
+            delete [] old;
+            return;
+        }
+
+        for(size_t i=0; i<sizeof...(Fields); i++) {
+            const uint8_t* field = record + HEADER_SIZE + i * FIELD_SIZE;
+            size_t offset = data;
+
+            for(size_t j=0; j<count; j++) {
+                const uint8_t* entry = old + HEADER_SIZE + j * FIELD_SIZE;
+                size_t fieldSize = entry[sizeof(uint32_t) + 1];
+
+                if(memcmp(entry, field, FIELD_SIZE) == 0 && offset + fieldSize <= len) {
+                    memcpy(record + DATA_OFFSET + offsetOf(i), old + offset, fieldSize);
+                    break;
+                }
+                offset += fieldSize;
+            }
+        }
+
+        delete [] old;
+    }
+
+    // offset of the i-th field in the data section of the record
+    size_t offsetOf(size_t index) const {
+        size_t offset = 0;
+
+        for(size_t i=0; i<index; i++) {
+            offset += record[HEADER_SIZE + i * FIELD_SIZE + sizeof(uint32_t) + 1];
+        }
+
+        return offset;
+    }
+
+    KVStoreInterface& store;
+    const key_t key;
+    bool dirty;
+
+    uint8_t record[DATA_OFFSET + kvschema::layout<Fields...>::size()];
+};
@@ -0,0 +1,177 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "transaction.h"
+
+bool TransactionBuffer::put(const key_t& key, const uint8_t value[], size_t len, Type t) {
+    if(key == nullptr || value == nullptr || len == 0) {
+        return false;
+    }
+
+    op_t* op = append(key, OP_PUT);
+
+    op->value = new uint8_t[len];
+    memcpy(op->value, value, len);
+    op->len = len;
+    op->t = t;
+
+    return true;
+}
+
+bool TransactionBuffer::remove(const key_t& key) {
+    if(key == nullptr) {
+        return false;
+    }
+
+    append(key, OP_REMOVE);
+
+    return true;
+}
+
+size_t TransactionBuffer::removePrefix(const char* prefix) {
+    size_t len = strlen(prefix);
+    size_t res = 0;
+
+    for(op_t* op = head; op != nullptr; op = op->next) {
+        if(op->type == OP_PUT && strncmp(op->key, prefix, len) == 0) {
+            delete [] op->value;
+
+            op->type = OP_REMOVE;
+            op->value = nullptr;
+            op->len = 0;
+            op->t = KVStoreInterface::PT_INVALID;
+            res++;
+        }
+    }
+
+    return res;
+}
+
+void TransactionBuffer::clear() {
+    discard();
+    cleared = true;
+}
+
+bool TransactionBuffer::lookup(const key_t& key, const uint8_t** value, size_t* len, Type* t) const {
+    op_t* op = find(key);
+
+    if(op == nullptr) {
+        // after a clear all the keys that were not put again do not exist anymore
+        *value = nullptr;
+        *len = 0;
+        if(t != nullptr) {
+            *t = KVStoreInterface::PT_INVALID;
+        }
+        return cleared;
+    }
+
+    *value = op->type == OP_PUT ? op->value : nullptr;
+    *len = op->type == OP_PUT ? op->len : 0;
+    if(t != nullptr) {
+        *t = op->t;
+    }
+
+    return true;
+}
+
+bool TransactionBuffer::apply(KVStoreInterface& store, size_t* applied) {
+    bool res = !cleared || store.clear();
+    size_t count = cleared && res ? 1 : 0;
+
+    for(op_t* op = head; op != nullptr && res; op = op->next) {
+        if(op->type == OP_PUT) {
+            // _put keeps the type, backends that do not record it forward the value to putBytes
+            res = store._put(op->key, op->value, op->len, op->t) > 0;
+        } else {
+            // removing a key that was never committed is not an error
+            res = store.remove(op->key) >= 0;
+        }
+
+        count += res ? 1 : 0;
+    }
+
+    discard();
+
+    if(applied != nullptr) {
+        *applied = count;
+    }
+
+    return res;
+}
+
+void TransactionBuffer::discard() {
+    while(head != nullptr) {
+        op_t* op = head;
+        head = head->next;
+
+        delete [] op->key.c_str();
+        delete [] op->value;
+        delete op;
+    }
+
+    tail = nullptr;
+    cleared = false;
+}
+
+typename TransactionBuffer::op_t* TransactionBuffer::find(const key_t& key) const {
+    for(op_t* op = head; op != nullptr; op = op->next) {
+        if(op->key.hash() == key.hash() && strcmp(op->key, key) == 0) {
+            return op;
+        }
+    }
+
+    return nullptr;
+}
+
+typename TransactionBuffer::op_t* TransactionBuffer::append(const key_t& key, Operation type) {
+    op_t* prev = nullptr;
+    op_t* op = head;
+
+    // the previous operation on the same key is dropped, the new one is appended at the end
+    while(op != nullptr && (op->key.hash() != key.hash() || strcmp(op->key, key) != 0)) {
+        prev = op;
+        op = op->next;
+    }
+
+    if(op != nullptr) {
+        if(prev != nullptr) {
+            prev->next = op->next;
+        } else {
+            head = op->next;
+        }
+
+        if(tail == op) {
+            tail = prev;
+        }
+
+        delete [] op->value;
+    } else {
+        size_t keyLen = key.length();
+
+        op = new op_t;
+        char* copy = new char[keyLen + 1];
+        memcpy(copy, key, keyLen + 1);
+        op->key = copy;
+    }
+
+    op->type = type;
+    op->value = nullptr;
+    op->len = 0;
+    op->t = KVStoreInterface::PT_INVALID;
+    op->next = nullptr;
+
+    if(tail != nullptr) {
+        tail->next = op;
+    } else {
+        head = op;
+    }
+    tail = op;
+
+    return op;
+}
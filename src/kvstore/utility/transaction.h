@@ -0,0 +1,112 @@
+/*
+ * This file is part of Arduino_KVStore.
+ *
+ * Copyright (c) 2024 Arduino SA
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "../kvstore.h"
+
+/** TransactionBuffer class
+ *
+ * Keeps in RAM the modifications performed during a transaction, for the backends that cannot defer
+ * the commit of a write. Only the last operation on every key is kept, when the transaction is
+ * committed the buffered operations are applied to a store in the same order they were issued, puts
+ * are replayed with the type they were issued with.
+ * Applying them is best effort: the store sees them one by one, thus a failure leaves applied the
+ * operations that preceded it.
+ */
+class TransactionBuffer {
+public:
+    typedef KVStoreInterface::key_t key_t;
+    typedef KVStoreInterface::res_t res_t;
+    typedef KVStoreInterface::Type Type;
+
+    typedef enum {
+        OP_PUT, OP_REMOVE,
+    } Operation;
+
+    TransactionBuffer(): head(nullptr), tail(nullptr), cleared(false) {}
+    ~TransactionBuffer() { discard(); }
+
+    /**
+     * @brief buffer a put operation, the value is copied in the buffer
+     *
+     * @param[in]  t                type of the value, the one the store records when it is applied
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool put(const key_t& key, const uint8_t value[], size_t len, Type t=KVStoreInterface::PT_BLOB);
+
+    /**
+     * @brief buffer a remove operation
+     *
+     * @returns true on correct execution false otherwise
+     */
+    bool remove(const key_t& key);
+
+    /**
+     * @brief turn the buffered put operations on keys starting with a prefix into remove operations,
+     *        keys that are only present in the store must be removed one by one
+     *
+     * @returns the number of put operations turned into remove operations
+     */
+    size_t removePrefix(const char* prefix);
+
+    /**
+     * @brief buffer a clear operation, all the operations buffered up to now are dropped
+     */
+    void clear();
+
+    /**
+     * @brief check if the buffer holds the last value written for a key
+     *
+     * @param[in]  key              Key to search for
+     * @param[out] value            pointer to the buffered value, nullptr if the key has been removed
+     * @param[out] len              length of the buffered value
+     * @param[out] t                if not nullptr, type of the buffered value
+     *
+     * @returns true if the store must not be accessed to know the value associated with the key
+     */
+    bool lookup(const key_t& key, const uint8_t** value, size_t* len, Type* t=nullptr) const;
+
+    /**
+     * @brief apply the buffered operations to a store and empty the buffer, the operations following
+     *        the first one that fails are dropped
+     *
+     * @param[in]  store            the store the operations are applied to
+     * @param[out] applied          if not nullptr, the number of operations applied, a buffered clear
+     *                              counts as one. When false is returned it is the index of the failed one
+     *
+     * @returns true if all the operations succeeded false otherwise
+     */
+    bool apply(KVStoreInterface& store, size_t* applied=nullptr);
+
+    /**
+     * @brief drop all the buffered operations
+     */
+    void discard();
+
+    inline bool empty() const { return head == nullptr && !cleared; }
+private:
+    typedef struct op {
+        Operation type;
+        key_t key; // copy owned by the operation
+        uint8_t* value;
+        size_t len;
+        Type t;
+
+        struct op* next;
+    } op_t;
+
+    op_t* find(const key_t& key) const;
+    op_t* append(const key_t& key, Operation type);
+
+    op_t* head;
+    op_t* tail;
+    bool cleared;
+};